@@ -1,6 +1,6 @@
 @echo off
 if not exist build mkdir build
 windres resource.rc -O coff -o resource.o
-g++ main.cpp resource.o -o build/cclank.exe -static -lshlwapi
+g++ main.cpp resource.o -o build/cclank.exe -static -lshlwapi -lpsapi -lws2_32 -lwinmm
 if exist resource.o del resource.o
 echo Build complete: build/cclank.exe
\ No newline at end of file
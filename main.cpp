@@ -1,10 +1,28 @@
 #include <iostream>
 #include <string>
 #include <fstream>
+#include <winsock2.h>
+#include <ws2tcpip.h>
 #include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#include <mmsystem.h>
 #include <direct.h>
 #include <vector>
 #include <map>
+#include <set>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <cmath>
+#include <memory>
 
 // Resource ID for embedded icon
 #define IDR_ICON 101
@@ -20,12 +38,80 @@ struct TomlConfig {
     struct Profile {
         int optLevel = 0;
         bool debug = true;
-        int codegenUnits = 1;
+        int codegenUnits = 1;  // 0 = "auto"
         std::string lto = "off";
+        std::string linker;     // mold, lld, gold or bfd; empty = compiler default
+        std::string targetCpu;  // -march value, "native" for this machine's CPU; empty = compiler default
+        std::vector<std::string> targetCpus;  // x86-64 levels built side by side behind a launcher
+        bool unity = false;
+        int unityBatch = 8;     // sources per unity file; 0 = all in one
+        std::vector<std::string> unityExclude;
+        std::vector<std::string> pgoTrain;  // program arguments of each PGO training run
+        bool splitLink = false;  // dev-link = "split": link src/ directories as shared libraries; ignored in release
+        bool forceFramePointers = false;  // keep frame pointers so samplers can walk the stack
+        bool thinArchive = false;  // static libraries reference their objects instead of holding copies
     };
     
     Profile dev;
     Profile release;
+    
+    // [profile.<name>] sections besides dev and release, as their keys in file order
+    std::map<std::string, std::vector<std::pair<std::string, std::string>>> profileSettings;
+    
+    // [build] section
+    int jobs = 0;  // 0 = one job per CPU
+    bool cache = true;
+    std::string pch;  // header to precompile, "auto", or empty for none
+    std::vector<std::string> sourceInclude;  // globs; empty = everything under src/
+    std::vector<std::string> sourceExclude;
+    std::vector<std::string> remoteHosts;    // host[:port][/slots] running cclank worker
+    
+    // [workspace] and [dependencies] sections
+    bool hasPackage = false;  // a [package] section was present
+    std::vector<std::string> workspaceMembers;
+    
+    struct Dependency {
+        std::string name;
+        std::string path;     // directory of the package, relative to this one
+        std::string version;  // or a version from the local registry
+        std::string tarball;  // or a .tar.gz, relative to this package
+    };
+    std::vector<Dependency> dependencies;
+    
+    // [[bench]] and [[test]] entries
+    struct Target {
+        std::string name;
+        std::string path;               // source file or directory; empty = the package's own binary
+        std::vector<std::string> args;  // program arguments
+        int runs = 10;     // benches only
+        int warmup = 1;
+        int timeout = 0;   // tests only, in seconds; 0 = the default
+    };
+    std::vector<Target> benches;
+    std::vector<Target> tests;
+};
+
+// Options given on the command line for build, run and watch
+struct BuildOptions {
+    bool isRelease = false;
+    int jobs = 0;  // 0 = use cclank.toml or the number of CPUs
+    bool timings = false;    // --timings
+    bool timeTrace = false;  // --time-trace: add the compiler's own timings
+    bool run = false;        // watch --run: restart the program after each build
+    std::string package;     // -p: build only this workspace package and its dependencies
+    bool pgo = false;        // --pgo: train with the profile's pgo commands, then build with the profile
+    
+    // Set by --pgo for each of its builds
+    std::string pgoFlags;     // instrumentation, or the trained profile to use
+    std::string buildSuffix;  // appended to build/<profile>
+    
+    std::string targets;  // "bench" or "test": also build those binaries of the selected packages
+    
+    std::string profile;   // --build-profile: a custom profile, built in build/<profile>; empty = dev or release
+    std::string profiler;  // run --profile=perf: sample the program and write a flame graph
+    
+    bool planAll = false;  // set by watch: plan every unit, even of packages the manifest says are up to date
+    bool noLto = false;    // set by bloat: build the profile without LTO, so code stays in the objects it came from
 };
 
 std::string getHostPlatform() {
@@ -54,6 +140,155 @@ bool fileExists(const std::string& path) {
     return (attrib != INVALID_FILE_ATTRIBUTES && !(attrib & FILE_ATTRIBUTE_DIRECTORY));
 }
 
+// Names of the entries in a directory, sorted
+std::vector<std::string> listDirectory(const std::string& directory) {
+    std::vector<std::string> names;
+    WIN32_FIND_DATAA findData;
+    HANDLE hFind = FindFirstFileA((directory + "\\*").c_str(), &findData);
+    if (hFind == INVALID_HANDLE_VALUE) return names;
+    do {
+        std::string name = findData.cFileName;
+        if (name != "." && name != "..") names.push_back(name);
+    } while (FindNextFileA(hFind, &findData));
+    FindClose(hFind);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+// Creates every missing directory along a path like "build/debug/obj"
+bool createDirectories(const std::string& path) {
+    for (size_t i = 0; i < path.length(); i++) {
+        if ((path[i] == '/' || path[i] == '\\') && i > 0 && path[i - 1] != ':') {
+            if (!createDirectory(path.substr(0, i))) return false;
+        }
+    }
+    return createDirectory(path);
+}
+
+// Deletes a directory and everything in it
+bool removeDirectoryTree(const std::string& path) {
+    bool removed = true;
+    WIN32_FIND_DATAA findData;
+    HANDLE hFind = FindFirstFileA((path + "\\*").c_str(), &findData);
+    if (hFind != INVALID_HANDLE_VALUE) {
+        do {
+            std::string name = findData.cFileName;
+            if (name == "." || name == "..") continue;
+            
+            std::string child = path + "\\" + name;
+            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                removed = removeDirectoryTree(child) && removed;
+            } else {
+                // Read-only files (copied from a read-only source) can't be deleted as they are
+                if (findData.dwFileAttributes & FILE_ATTRIBUTE_READONLY) {
+                    SetFileAttributesA(child.c_str(), FILE_ATTRIBUTE_NORMAL);
+                }
+                removed = DeleteFileA(child.c_str()) && removed;
+            }
+        } while (FindNextFileA(hFind, &findData));
+        FindClose(hFind);
+    }
+    return RemoveDirectoryA(path.c_str()) && removed;
+}
+
+// Returns the last write time of a file, or 0 if it doesn't exist
+ULONGLONG getFileTime(const std::string& path) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) {
+        return 0;
+    }
+    return (static_cast<ULONGLONG>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return "";
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+bool writeFile(const std::string& path, const std::string& content) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    file << content;
+    return file.good();
+}
+
+std::string normalizePath(const std::string& path) {
+    std::string result = path;
+    std::replace(result.begin(), result.end(), '\\', '/');
+    return result;
+}
+
+std::string currentDirectory() {
+    char cwd[MAX_PATH];
+    DWORD length = GetCurrentDirectoryA(MAX_PATH, cwd);
+    return (length > 0 && length < MAX_PATH) ? normalizePath(cwd) : ".";
+}
+
+std::string getEnvironmentVariable(const std::string& name) {
+    char buffer[MAX_PATH * 4];
+    DWORD length = GetEnvironmentVariableA(name.c_str(), buffer, sizeof(buffer));
+    if (length == 0 || length >= sizeof(buffer)) return "";
+    return std::string(buffer, length);
+}
+
+std::string getFileName(const std::string& path) {
+    size_t lastSlash = path.find_last_of("\\/");
+    return (lastSlash != std::string::npos) ? path.substr(lastSlash + 1) : path;
+}
+
+// SHA-256, used to key cached build outputs by their content
+std::string sha256Hex(const std::string& data) {
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+    uint32_t h[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    
+    // Pad to a multiple of 64 bytes with a 1 bit and the message length in bits
+    std::string msg = data;
+    uint64_t bitLength = static_cast<uint64_t>(data.size()) * 8;
+    msg += static_cast<char>(0x80);
+    while (msg.size() % 64 != 56) msg += '\0';
+    for (int i = 7; i >= 0; i--) msg += static_cast<char>((bitLength >> (i * 8)) & 0xff);
+    
+    auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+    
+    for (size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(msg.data() + chunk + i * 4);
+            w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+    }
+    
+    static const char hex[] = "0123456789abcdef";
+    std::string result;
+    for (uint32_t v : h) {
+        for (int i = 28; i >= 0; i -= 4) result += hex[(v >> i) & 0xf];
+    }
+    return result;
+}
+
 std::string trim(const std::string& str) {
     size_t first = str.find_first_not_of(" \t\r\n");
     if (first == std::string::npos) return "";
@@ -77,10 +312,323 @@ std::string removeComments(const std::string& line) {
     return line;
 }
 
-TomlConfig parseToml(const std::string& filename) {
-    TomlConfig config;
+// codegen-units is a number of LTO jobs, or "auto" (0) for one per CPU
+int parseCodegenUnits(const std::string& value) {
+    if (value == "auto") return 0;
+    return std::max(0, std::stoi(value));
+}
+
+std::string parseLinker(const std::string& value) {
+    if (value == "mold" || value == "lld" || value == "gold" || value == "bfd") {
+        return value;
+    }
+    std::cerr << "Warning: Unknown linker '" << value << "', using the compiler default" << std::endl;
+    return "";
+}
+
+// Minimal JSON support for build reports and compiler-generated traces
+
+std::string jsonEscape(const std::string& text) {
+    std::string result;
+    for (char c : text) {
+        switch (c) {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\r': result += "\\r"; break;
+            case '\t': result += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    result += buffer;
+                } else {
+                    result += c;
+                }
+        }
+    }
+    return result;
+}
+
+// Escapes text for HTML and SVG, in content and in quoted attributes
+std::string escapeXml(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '&') escaped += "&amp;";
+        else if (c == '<') escaped += "&lt;";
+        else if (c == '>') escaped += "&gt;";
+        else if (c == '"') escaped += "&quot;";
+        else escaped += c;
+    }
+    return escaped;
+}
+
+struct JsonValue {
+    enum Type { Null, Bool, Number, String, Array, Object };
+    Type type = Null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+    
+    const JsonValue* get(const std::string& key) const {
+        for (const auto& member : object) {
+            if (member.first == key) return &member.second;
+        }
+        return nullptr;
+    }
+    
+    std::string getString(const std::string& key) const {
+        const JsonValue* value = get(key);
+        return value && value->type == String ? value->string : "";
+    }
+    
+    double getNumber(const std::string& key) const {
+        const JsonValue* value = get(key);
+        return value && value->type == Number ? value->number : 0;
+    }
+};
+
+bool parseJsonValue(const std::string& text, size_t& pos, JsonValue& value);
+
+void skipJsonWhitespace(const std::string& text, size_t& pos) {
+    while (pos < text.length() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+        pos++;
+    }
+}
+
+bool parseJsonString(const std::string& text, size_t& pos, std::string& result) {
+    if (pos >= text.length() || text[pos] != '"') return false;
+    pos++;
+    
+    while (pos < text.length() && text[pos] != '"') {
+        char c = text[pos++];
+        if (c != '\\') {
+            result += c;
+            continue;
+        }
+        if (pos >= text.length()) return false;
+        
+        char escape = text[pos++];
+        switch (escape) {
+            case 'n': result += '\n'; break;
+            case 'r': result += '\r'; break;
+            case 't': result += '\t'; break;
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'u': {
+                if (pos + 4 > text.length()) return false;
+                unsigned int code = static_cast<unsigned int>(strtoul(text.substr(pos, 4).c_str(), NULL, 16));
+                pos += 4;
+                // Encode as UTF-8 (surrogate pairs are kept as two separate code points)
+                if (code < 0x80) {
+                    result += static_cast<char>(code);
+                } else if (code < 0x800) {
+                    result += static_cast<char>(0xC0 | (code >> 6));
+                    result += static_cast<char>(0x80 | (code & 0x3F));
+                } else {
+                    result += static_cast<char>(0xE0 | (code >> 12));
+                    result += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    result += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default: result += escape; break;
+        }
+    }
+    
+    if (pos >= text.length()) return false;
+    pos++;
+    return true;
+}
+
+bool parseJsonValue(const std::string& text, size_t& pos, JsonValue& value) {
+    skipJsonWhitespace(text, pos);
+    if (pos >= text.length()) return false;
+    
+    char c = text[pos];
+    if (c == '{') {
+        value.type = JsonValue::Object;
+        pos++;
+        skipJsonWhitespace(text, pos);
+        if (pos < text.length() && text[pos] == '}') {
+            pos++;
+            return true;
+        }
+        while (true) {
+            std::string key;
+            skipJsonWhitespace(text, pos);
+            if (!parseJsonString(text, pos, key)) return false;
+            skipJsonWhitespace(text, pos);
+            if (pos >= text.length() || text[pos] != ':') return false;
+            pos++;
+            
+            JsonValue member;
+            if (!parseJsonValue(text, pos, member)) return false;
+            value.object.emplace_back(key, std::move(member));
+            
+            skipJsonWhitespace(text, pos);
+            if (pos < text.length() && text[pos] == ',') {
+                pos++;
+                continue;
+            }
+            if (pos < text.length() && text[pos] == '}') {
+                pos++;
+                return true;
+            }
+            return false;
+        }
+    }
+    if (c == '[') {
+        value.type = JsonValue::Array;
+        pos++;
+        skipJsonWhitespace(text, pos);
+        if (pos < text.length() && text[pos] == ']') {
+            pos++;
+            return true;
+        }
+        while (true) {
+            JsonValue element;
+            if (!parseJsonValue(text, pos, element)) return false;
+            value.array.push_back(std::move(element));
+            
+            skipJsonWhitespace(text, pos);
+            if (pos < text.length() && text[pos] == ',') {
+                pos++;
+                continue;
+            }
+            if (pos < text.length() && text[pos] == ']') {
+                pos++;
+                return true;
+            }
+            return false;
+        }
+    }
+    if (c == '"') {
+        value.type = JsonValue::String;
+        return parseJsonString(text, pos, value.string);
+    }
+    if (text.compare(pos, 4, "true") == 0) {
+        value.type = JsonValue::Bool;
+        value.boolean = true;
+        pos += 4;
+        return true;
+    }
+    if (text.compare(pos, 5, "false") == 0) {
+        value.type = JsonValue::Bool;
+        pos += 5;
+        return true;
+    }
+    if (text.compare(pos, 4, "null") == 0) {
+        pos += 4;
+        return true;
+    }
+    
+    char* end = NULL;
+    value.number = strtod(text.c_str() + pos, &end);
+    if (end == text.c_str() + pos) return false;
+    value.type = JsonValue::Number;
+    pos = end - text.c_str();
+    return true;
+}
+
+bool parseJson(const std::string& text, JsonValue& value) {
+    size_t pos = 0;
+    return parseJsonValue(text, pos, value);
+}
+
+// Parses a TOML inline table like { path = "../core", version = "1.0" }.
+// Array values are returned as written, for parseStringArray.
+std::map<std::string, std::string> parseInlineTable(const std::string& value) {
+    std::map<std::string, std::string> table;
+    std::string text = trim(value);
+    if (text.length() < 2 || text.front() != '{' || text.back() != '}') {
+        return table;
+    }
+    
+    std::vector<std::string> entries;
+    std::string entry;
+    bool inString = false;
+    int depth = 0;
+    for (size_t i = 1; i < text.length() - 1; i++) {
+        char c = text[i];
+        if (c == '\\' && inString && i + 2 < text.length()) {
+            entry += c;
+            entry += text[++i];
+            continue;
+        }
+        if (c == '"') inString = !inString;
+        if (!inString && c == '[') depth++;
+        if (!inString && c == ']') depth--;
+        if (c == ',' && !inString && depth == 0) {
+            entries.push_back(entry);
+            entry.clear();
+        } else {
+            entry += c;
+        }
+    }
+    entries.push_back(entry);
+    
+    for (const auto& item : entries) {
+        size_t eqPos = item.find('=');
+        if (eqPos == std::string::npos) continue;
+        table[trim(item.substr(0, eqPos))] = removeQuotes(item.substr(eqPos + 1));
+    }
+    return table;
+}
+
+// Parses a TOML array of strings like ["a", "b"]
+std::vector<std::string> parseStringArray(const std::string& value) {
+    std::vector<std::string> items;
+    std::string text = trim(value);
+    if (text.length() < 2 || text.front() != '[' || text.back() != ']') {
+        return items;
+    }
+    
+    std::string item;
+    bool inString = false;
+    for (size_t i = 1; i < text.length() - 1; i++) {
+        char c = text[i];
+        // An escaped character (\" or \\) stands for itself
+        if (c == '\\' && inString && i + 2 < text.length()) {
+            item += text[++i];
+            continue;
+        }
+        if (c == '"') inString = !inString;
+        if (c == ',' && !inString) {
+            if (!trim(item).empty()) items.push_back(removeQuotes(item));
+            item.clear();
+        } else {
+            item += c;
+        }
+    }
+    if (!trim(item).empty()) items.push_back(removeQuotes(item));
     
-    // Set defaults
+    return items;
+}
+
+// Applies one key of a [profile.*] section
+void applyProfileKey(TomlConfig::Profile& profile, const std::string& key, const std::string& value) {
+    if (key == "opt-level") profile.optLevel = std::stoi(value);
+    else if (key == "debug") profile.debug = (value == "true");
+    else if (key == "codegen-units") profile.codegenUnits = parseCodegenUnits(value);
+    else if (key == "lto") profile.lto = value;
+    else if (key == "linker") profile.linker = parseLinker(value);
+    else if (key == "target-cpu") profile.targetCpu = value;
+    else if (key == "target-cpus") profile.targetCpus = parseStringArray(value);
+    else if (key == "force-frame-pointers") profile.forceFramePointers = (value == "true");
+    else if (key == "unity") profile.unity = (value == "true");
+    else if (key == "unity-batch") profile.unityBatch = std::stoi(value);
+    else if (key == "unity-exclude") profile.unityExclude = parseStringArray(value);
+    else if (key == "pgo") profile.pgoTrain = parseStringArray(parseInlineTable(value)["train"]);
+    else if (key == "dev-link") profile.splitLink = (value == "split");
+    else if (key == "thin-archive") profile.thinArchive = (value == "true");
+}
+
+// The settings of a package whose cclank.toml doesn't change them
+TomlConfig defaultConfig() {
+    TomlConfig config;
     config.dev.optLevel = 0;
     config.dev.debug = true;
     config.dev.codegenUnits = 4;
@@ -91,6 +639,14 @@ TomlConfig parseToml(const std::string& filename) {
     config.release.codegenUnits = 1;
     config.release.lto = "fat";
     
+    // Built in, for `cclank run --profile=perf`: optimized, but with debug info and walkable stacks
+    config.profileSettings["profiling"] = {{"inherits", "release"}, {"debug", "true"}, {"force-frame-pointers", "true"}};
+    return config;
+}
+
+TomlConfig parseToml(const std::string& filename) {
+    TomlConfig config = defaultConfig();
+    
     std::ifstream file(filename);
     if (!file) {
         std::cerr << "Warning: Could not open cclank.toml, using defaults" << std::endl;
@@ -109,6 +665,17 @@ TomlConfig parseToml(const std::string& filename) {
         // Parse section headers [section] or [section.subsection]
         if (line.front() == '[' && line.back() == ']') {
             currentSection = line.substr(1, line.length() - 2);
+            if (currentSection == "package") config.hasPackage = true;
+            
+            // [[bench]] and [[test]] start another entry of their array
+            if (currentSection == "[bench]") {
+                config.benches.push_back(TomlConfig::Target());
+                currentSection = "bench";
+            }
+            else if (currentSection == "[test]") {
+                config.tests.push_back(TomlConfig::Target());
+                currentSection = "test";
+            }
             continue;
         }
         
@@ -117,6 +684,17 @@ TomlConfig parseToml(const std::string& filename) {
         if (eqPos != std::string::npos) {
             std::string key = trim(line.substr(0, eqPos));
             std::string value = trim(line.substr(eqPos + 1));
+            
+            // Arrays and inline tables may continue over several lines until the closing bracket
+            char closing = value.empty() ? 0 : (value.front() == '[' ? ']' : (value.front() == '{' ? '}' : 0));
+            if (closing && value.find(closing) == std::string::npos) {
+                std::string next;
+                while (std::getline(file, next)) {
+                    value += " " + trim(removeComments(next));
+                    if (value.find(closing) != std::string::npos) break;
+                }
+            }
+            
             value = removeQuotes(value);
             
             // Package section
@@ -127,19 +705,55 @@ TomlConfig parseToml(const std::string& filename) {
                 else if (key == "type") config.type = value;
                 else if (key == "icon") config.icon = value;
             }
-            // Dev profile
+            // Dev and release profiles
             else if (currentSection == "profile.dev") {
-                if (key == "opt-level") config.dev.optLevel = std::stoi(value);
-                else if (key == "debug") config.dev.debug = (value == "true");
-                else if (key == "codegen-units") config.dev.codegenUnits = std::stoi(value);
-                else if (key == "lto") config.dev.lto = value;
+                applyProfileKey(config.dev, key, value);
             }
-            // Release profile
             else if (currentSection == "profile.release") {
-                if (key == "opt-level") config.release.optLevel = std::stoi(value);
-                else if (key == "debug") config.release.debug = (value == "true");
-                else if (key == "codegen-units") config.release.codegenUnits = std::stoi(value);
-                else if (key == "lto") config.release.lto = value;
+                applyProfileKey(config.release, key, value);
+            }
+            // Custom profiles are resolved against their parent when one is selected
+            else if (currentSection.compare(0, 8, "profile.") == 0) {
+                config.profileSettings[currentSection.substr(8)].push_back({key, value});
+            }
+            // Build settings
+            else if (currentSection == "build") {
+                if (key == "jobs") config.jobs = std::stoi(value);
+                else if (key == "cache") config.cache = (value == "true");
+                else if (key == "pch") config.pch = value;
+                else if (key == "include") config.sourceInclude = parseStringArray(value);
+                else if (key == "exclude") config.sourceExclude = parseStringArray(value);
+                else if (key == "remote") config.remoteHosts = parseStringArray(value);
+            }
+            // Workspace members, relative to this file
+            else if (currentSection == "workspace") {
+                if (key == "members") config.workspaceMembers = parseStringArray(value);
+            }
+            // Benchmarks
+            else if (currentSection == "bench") {
+                TomlConfig::Target& bench = config.benches.back();
+                if (key == "name") bench.name = value;
+                else if (key == "path") bench.path = value;
+                else if (key == "args") bench.args = parseStringArray(value);
+                else if (key == "runs") bench.runs = std::max(1, std::stoi(value));
+                else if (key == "warmup") bench.warmup = std::max(0, std::stoi(value));
+            }
+            // Tests
+            else if (currentSection == "test") {
+                TomlConfig::Target& test = config.tests.back();
+                if (key == "name") test.name = value;
+                else if (key == "path") test.path = value;
+                else if (key == "args") test.args = parseStringArray(value);
+                else if (key == "timeout") test.timeout = std::max(0, std::stoi(value));
+            }
+            // Dependencies: name = { path = "../core" }, { version = "1.2" } or { tarball = "vendor/x.tar.gz" }
+            else if (currentSection == "dependencies") {
+                std::map<std::string, std::string> table = parseInlineTable(value);
+                if (table.count("path") || table.count("version") || table.count("tarball")) {
+                    config.dependencies.push_back({key, table["path"], table["version"], table["tarball"]});
+                } else {
+                    std::cerr << "Warning: Dependency '" << key << "' has no path, version or tarball, ignoring it" << std::endl;
+                }
             }
         }
     }
@@ -148,6 +762,42 @@ TomlConfig parseToml(const std::string& filename) {
     return config;
 }
 
+// The settings of a profile: dev, release, or a custom [profile.<name>] that
+// inherits from one of them directly or through other custom profiles. A
+// custom profile builds like the profile at the root of its chain (isRelease).
+bool resolveProfile(const TomlConfig& config, const std::string& name, TomlConfig::Profile& profile,
+                    bool& isRelease, std::string& error, int depth = 0) {
+    if (name == "dev" || name == "release") {
+        isRelease = name == "release";
+        profile = isRelease ? config.release : config.dev;
+        return true;
+    }
+    auto settings = config.profileSettings.find(name);
+    if (settings == config.profileSettings.end()) {
+        error = "No [profile." + name + "] section in cclank.toml";
+        return false;
+    }
+    std::string parent;
+    for (const auto& setting : settings->second) {
+        if (setting.first == "inherits") parent = setting.second;
+    }
+    if (parent.empty()) {
+        error = "[profile." + name + "] needs inherits = \"dev\", \"release\" or another profile";
+        return false;
+    }
+    if (depth > 16) {
+        error = "[profile." + name + "] inherits from itself";
+        return false;
+    }
+    if (!resolveProfile(config, parent, profile, isRelease, error, depth + 1)) {
+        return false;
+    }
+    for (const auto& setting : settings->second) {
+        applyProfileKey(profile, setting.first, setting.second);
+    }
+    return true;
+}
+
 std::string getOutputFilename(const std::string& name, const std::string& type, const std::string& platform) {
     if (type == "bin") {
         if (platform == "win") return name + ".exe";
@@ -165,408 +815,7466 @@ std::string getOutputFilename(const std::string& name, const std::string& type,
     return name + ".exe";  // Default
 }
 
-std::vector<std::string> findCppFiles(const std::string& directory) {
-    std::vector<std::string> files;
-    WIN32_FIND_DATAA findData;
-    std::string searchPath = directory + "\\*.cpp";
-    HANDLE hFind = FindFirstFileA(searchPath.c_str(), &findData);
+// Source discovery
+//
+// Sources are found by walking directories recursively. The listing of every
+// directory is kept in build/.cclank-index together with the directory's last
+// write time, which changes whenever an entry is added, removed or renamed in
+// it, so later builds only list the directories that changed.
+
+bool isSourceFile(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return false;
+    std::string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".cpp" || ext == ".cc" || ext == ".cxx" || ext == ".c" || ext == ".cppm" || ext == ".ixx";
+}
+
+// C++20 module interface units
+bool isModuleInterfaceFile(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return false;
+    std::string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".cppm" || ext == ".ixx";
+}
+
+bool isCSource(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    return dot != std::string::npos && path.substr(dot) == ".c";
+}
+
+// Matches a path against a glob. * and ? stay within one path component,
+// ** spans any number of them. Comparison ignores case, as Windows does.
+bool globMatch(const char* pattern, const char* path) {
+    if (*pattern == '\0') return *path == '\0';
     
-    if (hFind != INVALID_HANDLE_VALUE) {
-        do {
-            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
-                files.push_back(directory + "\\" + findData.cFileName);
-            }
-        } while (FindNextFileA(hFind, &findData) != 0);
-        FindClose(hFind);
+    if (pattern[0] == '*' && pattern[1] == '*') {
+        const char* rest = pattern + 2;
+        if (*rest == '/') rest++;  // "a/**/b" also matches "a/b"
+        for (const char* p = path; ; p++) {
+            if (globMatch(rest, p)) return true;
+            if (*p == '\0') return false;
+        }
     }
-    
-    return files;
+    if (*pattern == '*') {
+        for (const char* p = path; ; p++) {
+            if (globMatch(pattern + 1, p)) return true;
+            if (*p == '\0' || *p == '/') return false;
+        }
+    }
+    if (*path == '\0') return false;
+    if (*pattern == '?') {
+        return *path != '/' && globMatch(pattern + 1, path + 1);
+    }
+    return tolower(*pattern) == tolower(*path) && globMatch(pattern + 1, path + 1);
 }
 
-std::string buildCommand(const TomlConfig& config, bool isRelease, const std::vector<std::string>& sourceFiles) {
-    const TomlConfig::Profile& profile = isRelease ? config.release : config.dev;
-    std::string profileName = isRelease ? "release" : "debug";
-    
-    std::string cmd = "g++";
-    
-    // Optimization level
-    if (profile.optLevel == 0) cmd += " -O0";
-    else if (profile.optLevel == 1) cmd += " -O1";
-    else if (profile.optLevel == 2) cmd += " -O2";
-    else if (profile.optLevel == 3) cmd += " -O3";
-    
-    // Debug info
-    if (profile.debug) {
-        cmd += " -g";
+// The directory part of a glob before its first wildcard: "src/**/*.cpp" -> "src"
+std::string globBaseDirectory(const std::string& pattern) {
+    std::string base;
+    size_t start = 0;
+    while (true) {
+        size_t slash = pattern.find('/', start);
+        if (slash == std::string::npos) break;
+        std::string component = pattern.substr(start, slash - start);
+        if (component.find_first_of("*?") != std::string::npos) break;
+        base += (base.empty() || base == "/" ? "" : "/") + (slash == 0 ? "/" : component);
+        start = slash + 1;
     }
+    return base.empty() ? "." : base;
+}
+
+struct IndexedDirectory {
+    ULONGLONG mtime = 0;
+    std::vector<std::string> files;
+    std::vector<std::string> subdirectories;
+    bool visited = false;  // reached during this walk; others are dropped on save
+};
+
+struct FileIndex {
+    std::map<std::string, IndexedDirectory> directories;
+    bool changed = false;
+};
+
+void loadFileIndex(FileIndex& index, const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line != "cclank-index 1") return;
     
-    // LTO
-    if (profile.lto == "fat") {
-        cmd += " -flto";
+    IndexedDirectory* current = nullptr;
+    while (std::getline(file, line)) {
+        if (line.length() < 2) continue;
+        std::string rest = line.substr(2);
+        
+        if (line[0] == 'D') {
+            size_t space = rest.find(' ');
+            if (space == std::string::npos) continue;
+            current = &index.directories[rest.substr(space + 1)];
+            current->mtime = std::stoull(rest.substr(0, space));
+        }
+        else if (current && line[0] == 'F') {
+            current->files.push_back(rest);
+        }
+        else if (current && line[0] == 'S') {
+            current->subdirectories.push_back(rest);
+        }
     }
-    
-    // Static library needs compile-only flag
-    if (config.type == "lib") {
-        cmd += " -c";
+}
+
+void saveFileIndex(const FileIndex& index, const std::string& path) {
+    std::string content = "cclank-index 1\n";
+    for (const auto& entry : index.directories) {
+        if (!entry.second.visited) continue;
+        content += "D " + std::to_string(entry.second.mtime) + " " + entry.first + "\n";
+        for (const auto& name : entry.second.subdirectories) content += "S " + name + "\n";
+        for (const auto& name : entry.second.files) content += "F " + name + "\n";
     }
+    writeFile(path, content);
+}
+
+// Appends every file below dir to files, listing only directories whose
+// last write time differs from the index
+void walkDirectory(FileIndex& index, const std::string& dir, std::vector<std::string>& files) {
+    IndexedDirectory& entry = index.directories[dir];
+    if (entry.visited) return;
+    entry.visited = true;
     
-    // Dynamic library needs shared flag and PIC for non-Windows
-    if (config.type == "dylib" || config.type == "dll" || config.type == "so") {
-        cmd += " -shared";
-        if (config.platform != "win") {
-            cmd += " -fPIC";
+    ULONGLONG mtime = getFileTime(dir);
+    if (mtime == 0) return;
+    
+    if (mtime != entry.mtime) {
+        entry.mtime = mtime;
+        entry.files.clear();
+        entry.subdirectories.clear();
+        index.changed = true;
+        
+        WIN32_FIND_DATAA findData;
+        HANDLE hFind = FindFirstFileA((dir + "\\*").c_str(), &findData);
+        if (hFind != INVALID_HANDLE_VALUE) {
+            do {
+                std::string name = findData.cFileName;
+                if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                    // Skip ".", "..", hidden directories like .git, and cclank's own output
+                    if (name[0] == '.' || (dir == "." && name == "build")) continue;
+                    entry.subdirectories.push_back(name);
+                } else {
+                    entry.files.push_back(name);
+                }
+            } while (FindNextFileA(hFind, &findData) != 0);
+            FindClose(hFind);
         }
     }
     
-    // Source files
-    for (const auto& file : sourceFiles) {
-        cmd += " " + file;
+    std::string prefix = (dir == ".") ? "" : dir + "/";
+    for (const auto& name : entry.files) {
+        files.push_back(prefix + name);
     }
     
-    // Icon resource (only for Windows binaries)
-    if (config.platform == "win" && config.type == "bin" && fileExists("icon.ico")) {
-        cmd += " resource.o";
+    // Copy the names first: walking may add entries to the map
+    std::vector<std::string> subdirectories = entry.subdirectories;
+    for (const auto& name : subdirectories) {
+        walkDirectory(index, prefix + name, files);
+    }
+}
+
+// Finds the sources to build: every .cpp/.cc/.cxx/.c file under src/, or the
+// files matching [build] include, minus those matching [build] exclude.
+// The directories that were scanned are added to scannedDirectories if given.
+std::vector<std::string> findSourceFiles(const TomlConfig& config, const std::string& indexPath,
+                                         std::vector<std::string>* scannedDirectories = nullptr) {
+    std::vector<std::string> patterns = config.sourceInclude;
+    if (patterns.empty()) {
+        patterns.push_back("src/**");
     }
     
-    // Output file
-    std::string outputFilename = getOutputFilename(config.name, config.type, config.platform);
+    FileIndex index;
+    loadFileIndex(index, indexPath);
     
-    // For static libraries, output object files to build directory
-    if (config.type == "lib") {
-        cmd += " -o build/" + profileName + "/";
-        // We'll handle ar separately
-    } else {
-        cmd += " -o build/" + profileName + "/" + outputFilename;
+    std::vector<std::string> candidates;
+    for (const auto& pattern : patterns) {
+        walkDirectory(index, globBaseDirectory(normalizePath(pattern)), candidates);
     }
     
-    // Platform-specific linking flags (not for libraries being created)
-    if (config.platform == "win" && config.type == "bin") {
-        cmd += " -static -lshlwapi";
+    std::vector<std::string> sources;
+    for (const auto& file : candidates) {
+        if (!isSourceFile(file)) continue;
+        
+        bool included = false;
+        for (const auto& pattern : patterns) {
+            if (globMatch(normalizePath(pattern).c_str(), file.c_str())) included = true;
+        }
+        for (const auto& pattern : config.sourceExclude) {
+            if (globMatch(normalizePath(pattern).c_str(), file.c_str())) included = false;
+        }
+        if (included) {
+            sources.push_back(file);
+        }
     }
     
-    return cmd;
-}
-
-bool extractEmbeddedIcon(const std::string& outputPath) {
-    HMODULE hModule = GetModuleHandle(NULL);
-    HRSRC hResource = FindResource(hModule, MAKEINTRESOURCE(IDR_ICON), RT_RCDATA);
-    
-    if (!hResource) {
-        std::cerr << "Error: Could not find embedded icon resource" << std::endl;
-        return false;
+    if (index.changed && createDirectory("build")) {
+        saveFileIndex(index, indexPath);
     }
     
-    HGLOBAL hLoadedResource = LoadResource(hModule, hResource);
-    if (!hLoadedResource) {
-        std::cerr << "Error: Could not load icon resource" << std::endl;
-        return false;
+    if (scannedDirectories) {
+        for (const auto& entry : index.directories) {
+            if (entry.second.visited) scannedDirectories->push_back(entry.first);
+        }
     }
     
-    void* pResourceData = LockResource(hLoadedResource);
-    DWORD dwResourceSize = SizeofResource(hModule, hResource);
-    
-    std::ofstream outFile(outputPath, std::ios::binary);
+    std::sort(sources.begin(), sources.end());
+    sources.erase(std::unique(sources.begin(), sources.end()), sources.end());
+    return sources;
+}
+
+// Build timings (cclank build --timings)
+//
+// Every child process, and every scheduler job wrapping them, is recorded
+// with its start, duration, command, exit code and peak memory, then written
+// out as a Chrome trace-event file and a summary of the slowest files.
+
+struct TimingEvent {
+    std::string name;
+    std::string category;   // job, compile, preprocess, pch, link, archive, resource, phase, ...
+    double start = 0;       // microseconds since the build started
+    double duration = 0;
+    int lane = 0;           // 0 = main thread, 1..N = scheduler workers
+    int exitCode = 0;
+    long long peakRss = 0;  // bytes, child processes only
+    double userTime = 0;    // CPU microseconds, child processes only
+    double systemTime = 0;
+    std::string command;
+    std::string detail;
+};
+
+struct BuildTimings {
+    bool enabled = false;
+    bool timeTrace = false;  // also collect the compiler's own per-TU timings
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER origin;
+    std::mutex mutex;
+    std::vector<TimingEvent> events;
+};
+
+BuildTimings buildTimings;
+
+// Set by the job scheduler so processes are attributed to the job running them
+thread_local int currentLane = 0;
+thread_local std::string currentJobLabel;
+
+void startTimings(bool timeTrace) {
+    buildTimings.enabled = true;
+    buildTimings.timeTrace = timeTrace;
+    buildTimings.events.clear();
+    QueryPerformanceFrequency(&buildTimings.frequency);
+    QueryPerformanceCounter(&buildTimings.origin);
+}
+
+// Microseconds since startTimings()
+double timingNow() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return static_cast<double>(now.QuadPart - buildTimings.origin.QuadPart) * 1000000.0 / buildTimings.frequency.QuadPart;
+}
+
+void recordTiming(const TimingEvent& event) {
+    std::lock_guard<std::mutex> lock(buildTimings.mutex);
+    buildTimings.events.push_back(event);
+}
+
+// Names the kind of build step a command performs
+std::string classifyCommand(const std::vector<std::string>& args) {
+    std::string tool = getFileName(args[0]);
+    if (tool.length() > 4 && tool.substr(tool.length() - 4) == ".exe") {
+        tool = tool.substr(0, tool.length() - 4);
+    }
+    auto hasArgument = [&](const char* arg) {
+        return std::find(args.begin() + 1, args.end(), arg) != args.end();
+    };
+    
+    if (tool == "windres") return "resource";
+    if (tool == "ar" || (tool.length() > 3 && tool.compare(tool.length() - 3, 3, "-ar") == 0)) return "archive";
+    // Compiler drivers, also when prefixed or versioned: x86_64-w64-mingw32-g++, clang++-17
+    size_t version = tool.find_last_not_of("0123456789.");
+    if (version != std::string::npos && version + 1 < tool.length() && tool[version] == '-') {
+        tool = tool.substr(0, version);
+    }
+    auto endsWith = [&](const char* suffix) {
+        std::string end = suffix;
+        return tool.length() >= end.length() && tool.compare(tool.length() - end.length(), end.length(), end) == 0;
+    };
+    if (endsWith("g++") || endsWith("gcc") || endsWith("clang") || endsWith("clang++") || tool == "c++" || tool == "cc") {
+        if (hasArgument("--version")) return "probe";
+        if (hasArgument("-E")) return "preprocess";
+        if (hasArgument("c++-header")) return "pch";
+        if (hasArgument("-c")) return "compile";
+        return "link";
+    }
+    return tool;
+}
+
+// Removes GCC's -ftime-report table from a compiler's output and returns its
+// "phase" rows as events laid end to end from start (the table only has totals)
+std::vector<TimingEvent> extractTimeReport(std::string& output, double start, int lane) {
+    std::vector<TimingEvent> phases;
+    size_t begin = output.find("Time variable");
+    if (begin == std::string::npos) return phases;
+    begin = output.rfind('\n', begin);
+    begin = (begin == std::string::npos) ? 0 : begin;
+    
+    size_t end = output.find(" TOTAL", begin);
+    end = (end == std::string::npos) ? output.length() : output.find('\n', end);
+    end = (end == std::string::npos) ? output.length() : end + 1;
+    
+    std::istringstream report(output.substr(begin, end - begin));
+    std::string line;
+    double offset = start;
+    while (std::getline(report, line)) {
+        std::string text = trim(line);
+        size_t colon = text.find(':');
+        if (text.compare(0, 6, "phase ") != 0 || colon == std::string::npos) continue;
+        
+        // usr ( %)  sys ( %)  wall ( %) ...: the wall time is the third number
+        double values[3] = {0, 0, 0};
+        int found = 0;
+        std::istringstream numbers(text.substr(colon + 1));
+        std::string token;
+        while (found < 3 && numbers >> token) {
+            if (token[0] == '(' || token.back() == ')' || token.back() == '%') continue;
+            values[found++] = atof(token.c_str());
+        }
+        
+        TimingEvent phase;
+        phase.name = trim(text.substr(0, colon));
+        phase.category = "phase";
+        phase.start = offset;
+        phase.duration = values[2] * 1000000.0;
+        phase.lane = lane;
+        phase.detail = "gcc -ftime-report total";
+        offset += phase.duration;
+        phases.push_back(phase);
+    }
+    
+    output.erase(begin, end - begin);
+    return phases;
+}
+
+int getDefaultJobCount() {
+    unsigned int cpus = std::thread::hardware_concurrency();
+    return cpus > 0 ? static_cast<int>(cpus) : 1;
+}
+
+// Serializes pipe creation and CreateProcess so a child never inherits
+// another job's pipe (which would keep that pipe open until it exits)
+std::mutex processSpawnMutex;
+
+// In watch mode every child process is put in this job object, so a build can
+// be cancelled by terminating the job (which also kills cc1plus, as, ld...)
+HANDLE buildJobObject = NULL;
+std::atomic<bool> buildCancelled(false);
+
+// Stops the running build: no new processes start, running ones are killed
+void cancelBuild() {
+    std::lock_guard<std::mutex> lock(processSpawnMutex);
+    buildCancelled = true;
+    if (buildJobObject) {
+        TerminateJobObject(buildJobObject, 1);
+    }
+}
+
+void printBuildFailed() {
+    std::cerr << (buildCancelled ? "Build cancelled" : "Build failed!") << std::endl;
+}
+
+// Command lines
+//
+// Commands are built as argument vectors and only turned into a command line
+// when a process is started, using the quoting rules the MSVC and MinGW
+// runtimes use to split it back into argv. Arguments without spaces or quotes
+// are left as they are, so the joined form also serves as the command recorded
+// in .cmd files and the build manifest.
+
+// Quotes an argument so CommandLineToArgvW (and the C runtime) parse it back unchanged
+std::string quoteArgument(const std::string& arg) {
+    if (!arg.empty() && arg.find_first_of(" \t\n\v\"") == std::string::npos) {
+        return arg;
+    }
+    
+    std::string quoted = "\"";
+    size_t backslashes = 0;
+    for (char c : arg) {
+        if (c == '\\') {
+            backslashes++;
+            continue;
+        }
+        // Backslashes are only special in front of a quote
+        quoted.append(c == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+        quoted += c;
+        backslashes = 0;
+    }
+    quoted.append(backslashes * 2, '\\');
+    quoted += '"';
+    return quoted;
+}
+
+std::string joinCommandLine(const std::vector<std::string>& args) {
+    std::string line;
+    for (const auto& arg : args) {
+        if (!line.empty()) line += ' ';
+        line += quoteArgument(arg);
+    }
+    return line;
+}
+
+// Appends a flag string (" -O2 -g -I\"C:/My Libs\"") to an argument vector,
+// undoing quoteArgument for flags that needed quoting
+void appendFlags(std::vector<std::string>& args, const std::string& flags) {
+    std::string arg;
+    bool inArg = false;
+    bool inQuotes = false;
+    size_t backslashes = 0;
+    for (char c : flags) {
+        if (c == '\\') {
+            backslashes++;
+            inArg = true;
+            continue;
+        }
+        if (c == '"') {
+            arg.append(backslashes / 2, '\\');
+            if (backslashes % 2) arg += '"';
+            else inQuotes = !inQuotes;
+            backslashes = 0;
+            inArg = true;
+            continue;
+        }
+        arg.append(backslashes, '\\');
+        backslashes = 0;
+        if ((c == ' ' || c == '\t') && !inQuotes) {
+            if (inArg) args.push_back(arg);
+            arg.clear();
+            inArg = false;
+            continue;
+        }
+        arg += c;
+        inArg = true;
+    }
+    arg.append(backslashes, '\\');
+    if (inArg) args.push_back(arg);
+}
+
+// CreateProcess rejects command lines over 32767 characters; longer ones
+// (links of thousands of objects) pass their arguments in a response file
+const size_t maxCommandLine = 32000;
+
+// Writes everything after the program name to a GCC-style response file,
+// where a backslash escapes the next character inside quotes
+std::string writeResponseFile(const std::vector<std::string>& args) {
+    static std::atomic<unsigned> counter(0);
+    char tempDir[MAX_PATH];
+    DWORD length = GetTempPathA(MAX_PATH, tempDir);
+    std::string path = (length > 0 && length < MAX_PATH) ? std::string(tempDir) : std::string(".\\");
+    path += "cclank-" + std::to_string(GetCurrentProcessId()) + "-" + std::to_string(counter++) + ".rsp";
+    
+    std::string content;
+    for (size_t i = 1; i < args.size(); i++) {
+        content += '"';
+        for (char c : args[i]) {
+            if (c == '\\' || c == '"') content += '\\';
+            content += c;
+        }
+        content += "\"\n";
+    }
+    return writeFile(path, content) ? path : "";
+}
+
+// CPU time in a FILETIME (100ns units) as microseconds
+double fileTimeMicroseconds(const FILETIME& time) {
+    return static_cast<double>((static_cast<ULONGLONG>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 10.0;
+}
+
+// Runs a command directly (no shell) and captures its stdout and stderr
+int runProcess(const std::vector<std::string>& args, std::string& output) {
+    std::string command = joinCommandLine(args);
+    std::string responseFile;
+    if (command.length() > maxCommandLine) {
+        responseFile = writeResponseFile(args);
+        if (responseFile.empty()) {
+            output += "Error: Could not write a response file for '" + args[0] + "'\n";
+            return -1;
+        }
+        command = quoteArgument(args[0]) + " " + quoteArgument("@" + responseFile);
+    }
+    
+    SECURITY_ATTRIBUTES sa = {};
+    sa.nLength = sizeof(sa);
+    sa.bInheritHandle = TRUE;
+    
+    HANDLE readPipe = NULL;
+    HANDLE writePipe = NULL;
+    PROCESS_INFORMATION pi = {};
+    double start = buildTimings.enabled ? timingNow() : 0;
+    
+    {
+        std::lock_guard<std::mutex> lock(processSpawnMutex);
+        
+        if (buildCancelled || !CreatePipe(&readPipe, &writePipe, &sa, 0)) {
+            if (!buildCancelled) output += "Error: Could not create pipe\n";
+            if (!responseFile.empty()) DeleteFileA(responseFile.c_str());
+            return -1;
+        }
+        SetHandleInformation(readPipe, HANDLE_FLAG_INHERIT, 0);
+        
+        STARTUPINFOA si = {};
+        si.cb = sizeof(si);
+        si.dwFlags = STARTF_USESTDHANDLES;
+        si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+        si.hStdOutput = writePipe;
+        si.hStdError = writePipe;
+        
+        std::vector<char> cmdLine(command.begin(), command.end());
+        cmdLine.push_back('\0');
+        
+        // Started suspended so it can't spawn anything before joining the job
+        DWORD creationFlags = buildJobObject ? CREATE_SUSPENDED : 0;
+        BOOL created = CreateProcessA(NULL, cmdLine.data(), NULL, NULL, TRUE, creationFlags, NULL, NULL, &si, &pi);
+        CloseHandle(writePipe);
+        
+        if (!created) {
+            CloseHandle(readPipe);
+            if (!responseFile.empty()) DeleteFileA(responseFile.c_str());
+            output += "Error: Could not start '" + args[0] + "'\n";
+            return -1;
+        }
+        if (buildJobObject) {
+            AssignProcessToJobObject(buildJobObject, pi.hProcess);
+            ResumeThread(pi.hThread);
+        }
+    }
+    
+    // Drain the pipe until the child (and anything it spawned) closes it
+    char buffer[4096];
+    DWORD bytesRead = 0;
+    while (ReadFile(readPipe, buffer, sizeof(buffer), &bytesRead, NULL) && bytesRead > 0) {
+        output.append(buffer, bytesRead);
+    }
+    CloseHandle(readPipe);
+    
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    DWORD exitCode = 1;
+    GetExitCodeProcess(pi.hProcess, &exitCode);
+    if (!responseFile.empty()) {
+        DeleteFileA(responseFile.c_str());
+    }
+    
+    if (buildTimings.enabled) {
+        TimingEvent event;
+        event.category = classifyCommand(args);
+        event.name = currentJobLabel.empty() ? event.category : currentJobLabel;
+        event.start = start;
+        event.duration = timingNow() - start;
+        event.lane = currentLane;
+        event.exitCode = static_cast<int>(exitCode);
+        event.command = joinCommandLine(args);
+        
+        PROCESS_MEMORY_COUNTERS memory = {};
+        if (GetProcessMemoryInfo(pi.hProcess, &memory, sizeof(memory))) {
+            event.peakRss = static_cast<long long>(memory.PeakWorkingSetSize);
+        }
+        FILETIME created, exited, kernelTime, userTime;
+        if (GetProcessTimes(pi.hProcess, &created, &exited, &kernelTime, &userTime)) {
+            event.userTime = fileTimeMicroseconds(userTime);
+            event.systemTime = fileTimeMicroseconds(kernelTime);
+        }
+        recordTiming(event);
+        
+        if (buildTimings.timeTrace && event.category == "compile") {
+            for (const auto& phase : extractTimeReport(output, start, currentLane)) {
+                recordTiming(phase);
+            }
+        }
+    }
+    
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    
+    return static_cast<int>(exitCode);
+}
+
+// A unit of work for the job scheduler; run() returns an exit code and
+// fills output with anything that should be shown to the user
+struct Job {
+    std::string label;
+    std::function<int(std::string& output)> run;
+    std::vector<size_t> dependencies;  // jobs that must succeed before this one starts
+    std::string action = "Compiling";
+};
+
+// Runs jobs on up to jobCount worker threads, each job once all of its
+// dependencies have finished. Each job's output is printed in one piece when
+// it finishes. After the first failure no new jobs are started, but jobs
+// already running are allowed to finish. Returns false on failure.
+bool runJobs(std::vector<Job>& jobs, int jobCount) {
+    enum JobState { Waiting, Running, Done };
+    std::mutex queueMutex;
+    std::condition_variable jobFinished;
+    std::mutex outputMutex;
+    std::vector<JobState> states(jobs.size(), Waiting);
+    size_t firstWaiting = 0;
+    std::atomic<bool> failed(false);
+    
+    auto worker = [&](int lane) {
+        currentLane = lane;
+        while (true) {
+            size_t index = jobs.size();
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                while (true) {
+                    if (failed || buildCancelled) return;
+                    
+                    // The first waiting job whose dependencies are all done
+                    while (firstWaiting < jobs.size() && states[firstWaiting] != Waiting) firstWaiting++;
+                    if (firstWaiting >= jobs.size()) return;
+                    for (size_t i = firstWaiting; i < jobs.size() && index == jobs.size(); i++) {
+                        if (states[i] != Waiting) continue;
+                        bool ready = true;
+                        for (size_t dep : jobs[i].dependencies) {
+                            if (states[dep] != Done) ready = false;
+                        }
+                        if (ready) index = i;
+                    }
+                    if (index < jobs.size()) break;
+                    jobFinished.wait(lock);
+                }
+                states[index] = Running;
+            }
+            
+            Job& job = jobs[index];
+            {
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cout << "  " << job.action << " " << job.label << "..." << std::endl;
+            }
+            
+            std::string output;
+            currentJobLabel = job.label;
+            double start = buildTimings.enabled ? timingNow() : 0;
+            int result = job.run(output);
+            currentJobLabel.clear();
+            
+            if (buildTimings.enabled) {
+                TimingEvent event;
+                event.name = job.label;
+                event.category = "job";
+                event.start = start;
+                event.duration = timingNow() - start;
+                event.lane = lane;
+                event.exitCode = result;
+                recordTiming(event);
+            }
+            
+            {
+                std::lock_guard<std::mutex> lock(outputMutex);
+                if (buildCancelled) {
+                    failed = true;
+                } else {
+                    if (!output.empty()) {
+                        std::cout << output;
+                        if (output.back() != '\n') std::cout << std::endl;
+                    }
+                    if (result != 0) {
+                        std::cerr << "Error: " << job.action << " " << job.label << " failed" << std::endl;
+                        failed = true;
+                    }
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                states[index] = Done;
+            }
+            jobFinished.notify_all();
+        }
+    };
+    
+    int workerCount = std::max(1, std::min(jobCount, static_cast<int>(jobs.size())));
+    std::vector<std::thread> workers;
+    for (int i = 0; i < workerCount; i++) {
+        workers.emplace_back(worker, i + 1);
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+    
+    return !failed;
+}
+
+// Toolchain
+//
+// The compilers come from CC and CXX (default gcc and g++; setting only one
+// picks the matching other). Whether they accept a flag is found out by
+// compiling and linking an empty program with it, the first time the flag is
+// needed. The results, the --version banner and the native CPU name are kept
+// in build/.cclank-toolchain/<hash>.txt, keyed by a hash of both compiler
+// binaries, so later runs don't start the compiler at all. identity.txt maps
+// the binaries' path, write time and size to that hash to skip rehashing them.
+
+std::string toolIdentity(const std::string& tool);
+
+struct Toolchain {
+    std::string cc = "gcc";
+    std::string cxx = "g++";
+    std::string version;  // --version banner of the C++ compiler
+    bool clang = false;
+    int major = 0;        // version number, e.g. 13 for GCC 13.2
+    std::string pchFormat = "gch";
+    
+    // Probed lazily and saved in cacheFile
+    std::string cacheFile;  // empty outside a project: nothing is saved
+    std::mutex mutex;
+    std::map<std::string, bool> flags;
+    bool nativeCpuProbed = false;
+    std::string nativeCpu;
+};
+
+// Full path of a program found on PATH, or "" if there is none
+std::string findProgram(const std::string& name) {
+    char path[MAX_PATH];
+    if (SearchPathA(nullptr, name.c_str(), ".exe", MAX_PATH, path, nullptr) == 0) return "";
+    return path;
+}
+
+// The C compiler that belongs to a C++ compiler, or the other way around:
+// clang++ <-> clang, g++ <-> gcc, x86_64-w64-mingw32-g++ <-> x86_64-w64-mingw32-gcc
+std::string matchingCompiler(const std::string& compiler, bool wantCxx) {
+    std::string name = compiler;
+    std::string suffix;
+    if (name.length() > 4 && name.substr(name.length() - 4) == ".exe") {
+        suffix = ".exe";
+        name = name.substr(0, name.length() - 4);
+    }
+    const std::pair<std::string, std::string> pairs[] = {{"clang", "clang++"}, {"gcc", "g++"}, {"cc", "c++"}};
+    for (const auto& pair : pairs) {
+        const std::string& from = wantCxx ? pair.first : pair.second;
+        const std::string& to = wantCxx ? pair.second : pair.first;
+        size_t pos = name.rfind(from);
+        if (pos != std::string::npos && (pos + from.length() == name.length() || name[pos + from.length()] == '-')) {
+            return name.substr(0, pos) + to + name.substr(pos + from.length()) + suffix;
+        }
+    }
+    return wantCxx ? "g++" : "gcc";
+}
+
+void saveToolchain(const Toolchain& toolchain) {
+    if (toolchain.cacheFile.empty()) return;
+    std::string content = "cclank-toolchain 1\n";
+    for (const auto& flag : toolchain.flags) {
+        content += "flag " + std::string(flag.second ? "1 " : "0 ") + flag.first + "\n";
+    }
+    if (toolchain.nativeCpuProbed) content += "native-cpu " + toolchain.nativeCpu + "\n";
+    content += "version\n" + toolchain.version;
+    writeFile(toolchain.cacheFile, content);
+}
+
+bool loadToolchain(Toolchain& toolchain) {
+    std::string content = readFile(toolchain.cacheFile);
+    if (content.compare(0, 19, "cclank-toolchain 1\n") != 0) return false;
+    std::istringstream lines(content.substr(19));
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.compare(0, 5, "flag ") == 0 && line.length() > 7) {
+            toolchain.flags[line.substr(7)] = line[5] == '1';
+        } else if (line.compare(0, 11, "native-cpu ") == 0) {
+            toolchain.nativeCpuProbed = true;
+            toolchain.nativeCpu = line.substr(11);
+        } else if (line == "version") {
+            size_t start = static_cast<size_t>(lines.tellg());
+            toolchain.version = start < content.length() - 19 ? content.substr(19 + start) : "";
+            return !toolchain.version.empty();
+        }
+    }
+    return false;
+}
+
+// Detected once per run
+Toolchain& toolchain() {
+    static Toolchain* detected = []() {
+        Toolchain* tc = new Toolchain();
+        std::string cc = getEnvironmentVariable("CC");
+        std::string cxx = getEnvironmentVariable("CXX");
+        if (!cxx.empty()) tc->cxx = cxx;
+        else if (!cc.empty()) tc->cxx = matchingCompiler(cc, true);
+        if (!cc.empty()) tc->cc = cc;
+        else if (!cxx.empty()) tc->cc = matchingCompiler(cxx, false);
+        
+        // Cached results are only kept inside a project (not for cclank worker in any directory)
+        if (fileExists("cclank.toml") && createDirectories("build/.cclank-toolchain/")) {
+            std::string identity = tc->cc + "|" + tc->cxx + "|" + toolIdentity(tc->cc) + "|" + toolIdentity(tc->cxx);
+            std::string identityPath = "build/.cclank-toolchain/identity.txt";
+            std::string hash;
+            std::string recorded = readFile(identityPath);
+            if (recorded.compare(0, identity.length() + 1, identity + "\t") == 0) {
+                hash = trim(recorded.substr(identity.length() + 1));
+            } else {
+                std::string binaries = tc->cc + '\0' + tc->cxx + '\0';
+                std::string ccPath = findProgram(tc->cc);
+                std::string cxxPath = findProgram(tc->cxx);
+                binaries += (ccPath.empty() ? "" : readFile(ccPath)) + '\0' + (cxxPath.empty() ? "" : readFile(cxxPath));
+                hash = sha256Hex(binaries);
+                writeFile(identityPath, identity + "\t" + hash + "\n");
+            }
+            tc->cacheFile = "build/.cclank-toolchain/" + hash + ".txt";
+        }
+        
+        if (tc->cacheFile.empty() || !loadToolchain(*tc)) {
+            tc->flags.clear();
+            tc->nativeCpuProbed = false;
+            runProcess({tc->cxx, "--version"}, tc->version);
+            saveToolchain(*tc);
+        }
+        
+        tc->clang = tc->version.find("clang") != std::string::npos;
+        tc->pchFormat = tc->clang ? "pch" : "gch";
+        
+        // The first number with a dot on the banner's first line: "g++ (GCC) 13.2.0", "clang version 17.0.6"
+        std::istringstream words(tc->version.substr(0, tc->version.find('\n')));
+        std::string word;
+        while (words >> word) {
+            if (isdigit(static_cast<unsigned char>(word[0])) && word.find('.') != std::string::npos) {
+                tc->major = atoi(word.c_str());
+                break;
+            }
+        }
+        return tc;
+    }();
+    return *detected;
+}
+
+// The compiler's --version banner
+const std::string& getCompilerVersion() {
+    return toolchain().version;
+}
+
+bool compilerIsClang() {
+    return toolchain().clang;
+}
+
+// A binutils program (nm, ar, ...) that matches the compiler: the one with the
+// same target prefix for cross compilers (x86_64-w64-mingw32-g++ ->
+// x86_64-w64-mingw32-nm), LLVM's for clang when installed, else the plain one
+std::string binutilsProgram(const std::string& name) {
+    std::string cxx = getFileName(toolchain().cxx);
+    for (const char* driver : {"g++", "clang++", "c++"}) {
+        size_t pos = cxx.rfind(std::string("-") + driver);
+        if (pos != std::string::npos && pos > 0) {
+            std::string prefixed = cxx.substr(0, pos + 1) + name;
+            if (!findProgram(prefixed).empty()) return prefixed;
+        }
+    }
+    if (compilerIsClang() && !findProgram("llvm-" + name).empty()) {
+        return "llvm-" + name;
+    }
+    return name;
+}
+
+// Scratch files for probing the compiler
+std::string probeDirectory() {
+    char tempDir[MAX_PATH];
+    DWORD length = GetTempPathA(MAX_PATH, tempDir);
+    std::string dir = (length > 0 && length < MAX_PATH) ? std::string(tempDir) : std::string(".\\");
+    dir += "cclank-probe-" + std::to_string(GetCurrentProcessId());
+    createDirectory(dir);
+    return dir;
+}
+
+// True if the C++ compiler accepts flags (one, or a few that only work together)
+// when compiling and linking a program. Flags that the compiler only warns
+// about (unused, ignored) count as unsupported.
+bool toolchainSupports(const std::string& flag) {
+    Toolchain& tc = toolchain();
+    std::lock_guard<std::mutex> lock(tc.mutex);
+    auto known = tc.flags.find(flag);
+    if (known != tc.flags.end()) return known->second;
+    
+    std::string dir = probeDirectory();
+    std::string source = dir + "\\probe.cpp";
+    std::string program = dir + "\\probe.exe";
+    writeFile(source, "int main() { return 0; }\n");
+    std::string output;
+    std::vector<std::string> args = {tc.cxx};
+    appendFlags(args, flag);
+    args.insert(args.end(), {source, "-o", program});
+    int exitCode = runProcess(args, output);
+    removeDirectoryTree(dir);
+    
+    std::string lower = output;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    bool supported = exitCode == 0 && lower.find("unused") == std::string::npos &&
+                     lower.find("ignor") == std::string::npos && lower.find("unrecognized") == std::string::npos &&
+                     lower.find("unknown") == std::string::npos && lower.find("unsupported") == std::string::npos;
+    tc.flags[flag] = supported;
+    saveToolchain(tc);
+    return supported;
+}
+
+// The name of this machine's CPU as the compiler's -march=native sees it,
+// e.g. "skylake", or "" if the compiler doesn't say
+std::string toolchainNativeCpu() {
+    Toolchain& tc = toolchain();
+    std::lock_guard<std::mutex> lock(tc.mutex);
+    if (tc.nativeCpuProbed) return tc.nativeCpu;
+    
+    std::string output;
+    if (tc.clang) {
+        // The driver passes the resolved CPU to cc1 as: "-target-cpu" "skylake"
+        std::string dir = probeDirectory();
+        std::string source = dir + "\\probe.cpp";
+        writeFile(source, "");
+        runProcess({tc.cxx, "-march=native", "-###", "-c", source, "-o", dir + "\\probe.o"}, output);
+        removeDirectoryTree(dir);
+        size_t pos = output.find("\"-target-cpu\" \"");
+        if (pos != std::string::npos) {
+            pos += 15;
+            tc.nativeCpu = output.substr(pos, output.find('"', pos) - pos);
+        }
+    } else {
+        // GCC lists the resolved value of every target option: "  -march=    skylake"
+        runProcess({tc.cxx, "-march=native", "-Q", "--help=target"}, output);
+        std::istringstream lines(output);
+        std::string line;
+        while (std::getline(lines, line)) {
+            line = trim(line);
+            if (line.compare(0, 7, "-march=") == 0) {
+                tc.nativeCpu = trim(line.substr(7));
+                break;
+            }
+        }
+    }
+    if (tc.nativeCpu.find_first_of(" \t\"") != std::string::npos) tc.nativeCpu.clear();
+    tc.nativeCpuProbed = true;
+    saveToolchain(tc);
+    return tc.nativeCpu;
+}
+
+// Prints a warning only the first time it comes up in a run
+void warnOnce(const std::string& message) {
+    static std::mutex mutex;
+    static std::vector<std::string> shown;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (std::find(shown.begin(), shown.end(), message) != shown.end()) return;
+    shown.push_back(message);
+    std::cerr << "Warning: " << message << std::endl;
+}
+
+// target-cpu as a -march flag. "native" is replaced by the CPU's name, so
+// the object cache and remote workers tell code for different CPUs apart.
+std::string targetCpuFlags(const TomlConfig::Profile& profile) {
+    if (profile.targetCpu.empty()) return "";
+    std::string cpu = profile.targetCpu;
+    if (cpu == "native") {
+        cpu = toolchainNativeCpu();
+        if (cpu.empty()) cpu = "native";
+    }
+    if (!toolchainSupports("-march=" + cpu)) {
+        warnOnce(toolchain().cxx + " doesn't support target-cpu \"" + profile.targetCpu + "\", building for the default CPU");
+        return "";
+    }
+    return " -march=" + cpu;
+}
+
+// Maps lto and codegen-units to the LTO flags the compiler supports.
+// codegen-units sets how many LTO jobs run in parallel at link time, so it is
+// left out of compile commands where it would only invalidate objects.
+std::string ltoFlags(const TomlConfig::Profile& profile, bool forLink) {
+    if (profile.lto != "fat" && profile.lto != "thin") {
+        return "";
+    }
+    if (!toolchainSupports("-flto")) {
+        warnOnce(toolchain().cxx + " doesn't support LTO, building without it");
+        return "";
+    }
+    
+    if (compilerIsClang()) {
+        if (profile.lto == "thin") {
+            if (!toolchainSupports("-flto=thin")) {
+                warnOnce(toolchain().cxx + " doesn't support ThinLTO, using full LTO");
+                return " -flto";
+            }
+            // ThinLTO backends run in parallel at link time; clang defaults to one job per CPU
+            std::string flags = " -flto=thin";
+            if (forLink && profile.codegenUnits > 0 && toolchainSupports("-flto=thin -flto-jobs=1")) {
+                flags += " -flto-jobs=" + std::to_string(profile.codegenUnits);
+            }
+            return flags;
+        }
+        return toolchainSupports("-flto=full") ? " -flto=full" : " -flto";
+    }
+    
+    // GCC has no ThinLTO; its default (WHOPR) mode already splits the program
+    // into partitions, so both modes map to running those partitions in parallel
+    if (!forLink) {
+        return " -flto";
+    }
+    if (profile.codegenUnits == 0 || (profile.lto == "thin" && profile.codegenUnits == 1)) {
+        return toolchainSupports("-flto=auto") ? " -flto=auto" : " -flto";
+    }
+    if (profile.codegenUnits == 1) {
+        return " -flto";
+    }
+    return " -flto=" + std::to_string(profile.codegenUnits);
+}
+
+// Flags shared by the compile and link steps of a profile
+std::string profileFlags(const TomlConfig& config, bool isRelease, bool forLink) {
+    const TomlConfig::Profile& profile = isRelease ? config.release : config.dev;
+    std::string flags;
+
+    // Optimization level
+    if (profile.optLevel == 0) flags += " -O0";
+    else if (profile.optLevel == 1) flags += " -O1";
+    else if (profile.optLevel == 2) flags += " -O2";
+    else if (profile.optLevel == 3) flags += " -O3";
+
+    // Debug info
+    if (profile.debug) {
+        flags += " -g";
+    }
+    
+    // Frame pointers, including in leaf functions, so every sampled stack can be walked
+    if (profile.forceFramePointers) {
+        flags += " -fno-omit-frame-pointer";
+        if (toolchainSupports("-mno-omit-leaf-frame-pointer")) flags += " -mno-omit-leaf-frame-pointer";
+    }
+
+    // Instruction set
+    flags += targetCpuFlags(profile);
+
+    // LTO
+    flags += ltoFlags(profile, forLink);
+
+    return flags;
+}
+
+// Object file for a source, mirroring its path within its package so equal
+// names in different directories (or foo.c next to foo.cpp) don't collide:
+// src/net/http.cpp -> build/<profile>/obj/src/net/http.cpp.o
+// Files generated inside the build directory map to obj/<path inside it>.
+std::string objectPathFor(const std::string& buildPath, const std::string& srcFile, const std::string& packageRoot = "") {
+    std::string path = normalizePath(srcFile);
+    if (path.compare(0, buildPath.length() + 1, buildPath + "/") == 0) {
+        path = path.substr(buildPath.length() + 1);
+    }
+    else if (!packageRoot.empty() && path.compare(0, packageRoot.length(), packageRoot) == 0) {
+        path = path.substr(packageRoot.length());
+    }
+    
+    // Keep sources outside the project (../lib/x.cpp) inside obj/
+    size_t parent;
+    while ((parent = path.find("../")) != std::string::npos) {
+        path.replace(parent, 3, "__/");
+    }
+    if (path.length() > 1 && path[1] == ':') {
+        path.erase(1, 1);
+    }
+    
+    return buildPath + "/obj/" + path + ".o";
+}
+
+// C sources are compiled as C; everything else as C++
+std::string compilerFor(const std::string& srcFile) {
+    return isCSource(srcFile) ? toolchain().cc : toolchain().cxx;
+}
+
+std::string depfilePathFor(const std::string& objPath) {
+    return objPath.substr(0, objPath.find_last_of('.')) + ".d";
+}
+
+// Split debug info goes to a .dwo next to the object: build/debug/obj/src/a.cpp.o -> a.cpp.dwo
+std::string dwoPathFor(const std::string& objPath) {
+    return objPath.substr(0, objPath.find_last_of('.')) + ".dwo";
+}
+
+// Whether a build links a bin package as shared library partitions (see Split dev linking)
+bool splitLinkEnabled(const TomlConfig& config, bool isRelease) {
+    if (isRelease) {
+        if (config.release.splitLink) warnOnce("dev-link only applies to [profile.dev], release builds link statically");
+        return false;
+    }
+    if (!config.dev.splitLink || config.type != "bin") return false;
+    if (config.dev.unity || config.dev.lto != "off") {
+        warnOnce("dev-link = \"split\" can't be combined with unity builds or LTO, linking statically");
+        return false;
+    }
+    return true;
+}
+
+// Every flag that affects the object code of a translation unit
+std::string compileFlags(const TomlConfig& config, bool isRelease) {
+    std::string flags = profileFlags(config, isRelease, false);
+
+    // Shared objects need position independent code on non-Windows platforms
+    bool split = splitLinkEnabled(config, isRelease);
+    if ((config.type == "dylib" || config.type == "dll" || config.type == "so" || split) && config.platform != "win") {
+        flags += " -fPIC";
+    }
+    
+    // Split linking is about fast relinks, so keep DWARF out of the objects the linker has to copy
+    if (split && config.dev.debug && config.platform != "win" && toolchainSupports("-gsplit-dwarf")) {
+        flags += " -gsplit-dwarf";
+    }
+
+    return flags;
+}
+
+// Compiles one translation unit to an object file, with a g++ depfile next to it
+std::vector<std::string> compileCommand(const std::string& flags, const std::string& srcFile, const std::string& objPath) {
+    std::vector<std::string> args = {compilerFor(srcFile)};
+    appendFlags(args, flags);
+    args.insert(args.end(), {"-MMD", "-MP", "-MF", depfilePathFor(objPath)});
+    
+    // Neither compiler knows every module interface extension (.cppm, .ixx)
+    if (isModuleInterfaceFile(srcFile)) {
+        args.insert(args.end(), {"-x", compilerIsClang() ? "c++-module" : "c++"});
+    }
+    args.insert(args.end(), {"-c", srcFile, "-o", objPath});
+    return args;
+}
+
+// Links object files, and the libraries of dependencies, into the final binary or dynamic library
+std::vector<std::string> linkCommand(const TomlConfig& config, bool isRelease, const std::vector<std::string>& objectFiles,
+                                     const std::string& resourceObj, const std::vector<std::string>& libraries, const std::string& outputPath) {
+    const TomlConfig::Profile& profile = isRelease ? config.release : config.dev;
+    std::vector<std::string> args = {toolchain().cxx};
+    appendFlags(args, profileFlags(config, isRelease, true));
+    
+    if (!profile.linker.empty() && !toolchainSupports("-fuse-ld=" + profile.linker)) {
+        warnOnce(toolchain().cxx + " can't link with " + profile.linker + ", using its default linker");
+    }
+    else if (!profile.linker.empty()) {
+        args.push_back("-fuse-ld=" + profile.linker);
+        
+        // Full LTO in lld is split into codegen partitions that run on separate threads
+        if (profile.linker == "lld" && profile.lto == "fat" && profile.codegenUnits > 1 && compilerIsClang()) {
+            args.push_back("-Wl,--lto-partitions=" + std::to_string(profile.codegenUnits));
+        }
+    }
+
+    if (config.type == "dylib" || config.type == "dll" || config.type == "so") {
+        args.push_back("-shared");
+        if (config.platform != "win") {
+            args.push_back("-fPIC");
+        }
+    }
+
+    args.insert(args.end(), objectFiles.begin(), objectFiles.end());
+
+    if (!resourceObj.empty()) {
+        args.push_back(resourceObj);
+    }
+
+    args.insert(args.end(), libraries.begin(), libraries.end());
+
+    args.push_back("-o");
+    args.push_back(outputPath);
+
+    // Platform-specific linking flags
+    if (config.platform == "win" && config.type == "bin") {
+        args.push_back("-static");
+        args.push_back("-lshlwapi");
+    }
+
+    return args;
+}
+
+// ar command (the one matching the compiler) that bundles objects into a static library. P names members by
+// their path, so objects with the same file name in different directories
+// don't replace each other; T (thin-archive) stores only those paths.
+std::vector<std::string> archiveCommand(const TomlConfig& config, bool isRelease, const std::vector<std::string>& objectFiles,
+                                        const std::string& outputPath) {
+    const TomlConfig::Profile& profile = isRelease ? config.release : config.dev;
+    std::vector<std::string> args = {binutilsProgram("ar"), profile.thinArchive ? "rcsPT" : "rcsP", outputPath};
+    args.insert(args.end(), objectFiles.begin(), objectFiles.end());
+    return args;
+}
+
+// Runs an archiveCommand. If the archive was last written with the same
+// modifiers, only the objects that are new or newer than it are replaced and
+// the ones no longer built are deleted; otherwise it is written from scratch.
+// The members are listed in <archive>.members for the next update.
+int updateArchive(const std::vector<std::string>& archiveCmd, std::string& output) {
+    const std::string& ar = archiveCmd[0];
+    const std::string& modifiers = archiveCmd[1];
+    const std::string& archivePath = archiveCmd[2];
+    std::vector<std::string> objects(archiveCmd.begin() + 3, archiveCmd.end());
+    std::string membersPath = archivePath + ".members";
+    
+    std::vector<std::string> previous;
+    std::istringstream stream(readFile(membersPath));
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (!line.empty()) previous.push_back(line);
+    }
+    ULONGLONG archiveTime = getFileTime(archivePath);
+    bool incremental = archiveTime != 0 && !previous.empty() && previous[0] == modifiers;
+    
+    // Forgotten until ar succeeds, so an interrupted update starts over
+    DeleteFileA(membersPath.c_str());
+    
+    std::vector<std::vector<std::string>> commands;
+    if (incremental) {
+        std::set<std::string> archived(previous.begin() + 1, previous.end());
+        std::set<std::string> current(objects.begin(), objects.end());
+        
+        std::vector<std::string> removeCmd = {ar, "dP", archivePath};
+        for (const auto& member : archived) {
+            if (!current.count(member)) removeCmd.push_back(member);
+        }
+        std::vector<std::string> replaceCmd = {ar, modifiers, archivePath};
+        for (const auto& object : objects) {
+            if (!archived.count(object) || getFileTime(object) > archiveTime) replaceCmd.push_back(object);
+        }
+        
+        if (removeCmd.size() > 3) commands.push_back(removeCmd);
+        if (replaceCmd.size() > 3) commands.push_back(replaceCmd);
+        if (commands.empty()) commands.push_back({ar, "s", archivePath});  // refreshes the index and the write time
+    } else {
+        DeleteFileA(archivePath.c_str());
+        commands.push_back(archiveCmd);
+    }
+    
+    for (const auto& command : commands) {
+        output += "Running: " + joinCommandLine(command) + "\n";
+        int result = runProcess(command, output);
+        if (result != 0) return result;
+    }
+    
+    std::string members = modifiers + "\n";
+    for (const auto& object : objects) {
+        members += object + "\n";
+    }
+    writeFile(membersPath, members);
+    return 0;
+}
+
+// Reads the prerequisites out of a make-style depfile written by g++ -MMD -MP.
+// With -fmodules-ts GCC adds rules for modules, named as "<module>.c++m"
+// pseudo-files, and for the BMIs it writes; none of those are inputs.
+std::vector<std::string> parseDepfile(const std::string& path) {
+    std::vector<std::string> deps;
+    std::string content = readFile(path);
+    std::string word;
+    bool inTargets = true;  // words before the ':' of a rule are its targets
+    bool skipRule = false;
+
+    auto isModuleName = [](const std::string& name) {
+        return name.length() > 5 && name.compare(name.length() - 5, 5, ".c++m") == 0;
+    };
+    auto flush = [&]() {
+        if (word.empty()) return;
+        if (inTargets) {
+            // Targets end with ':' (the main object and the -MP phony header rules), or ':|' for order-only rules
+            bool orderOnly = word.length() > 1 && word.compare(word.length() - 2, 2, ":|") == 0;
+            if (orderOnly || word.back() == ':') {
+                std::string target = word.substr(0, word.find_last_of(':'));
+                if (orderOnly || target == ".PHONY" || isModuleName(target)) skipRule = true;
+                inTargets = false;
+            }
+        }
+        else if (!skipRule && !isModuleName(word)) {
+            deps.push_back(word);
+        }
+        word.clear();
+    };
+
+    for (size_t i = 0; i < content.length(); i++) {
+        char c = content[i];
+        if (c == '\\' && i + 1 < content.length()) {
+            char next = content[i + 1];
+            if (next == '\n' || next == '\r') {
+                // Line continuation, ending in "\n" or "\r\n"
+                flush();
+                i++;
+                if (next == '\r' && i + 1 < content.length() && content[i + 1] == '\n') i++;
+                continue;
+            }
+            if (next == ' ' || next == '#') {
+                // Escaped character inside a path
+                word += next;
+                i++;
+                continue;
+            }
+            word += c;
+        }
+        else if (c == '\n' || c == '\r') {
+            // A new rule, or a variable assignment like "CXX_IMPORTS += net.c++m" that has no targets
+            if (c == '\r' && i + 1 < content.length() && content[i + 1] == '\n') i++;
+            flush();
+            inTargets = true;
+            skipRule = false;
+        }
+        else if (c == ' ' || c == '\t') {
+            flush();
+        }
+        else {
+            word += c;
+        }
+    }
+    flush();
+
+    return deps;
+}
+
+// An object is stale when it is missing, when its compile command changed,
+// or when its source or any header recorded in its depfile is newer than it
+bool needsRecompile(const std::string& srcFile, const std::string& objPath, const std::string& command) {
+    ULONGLONG objTime = getFileTime(objPath);
+    if (objTime == 0) return true;
+
+    if (readFile(objPath + ".cmd") != command) return true;
+
+    if (getFileTime(srcFile) > objTime) return true;
+
+    std::string depPath = depfilePathFor(objPath);
+    if (!fileExists(depPath)) return true;
+
+    for (const auto& dep : parseDepfile(depPath)) {
+        ULONGLONG depTime = getFileTime(dep);
+        if (depTime == 0 || depTime > objTime) return true;
+    }
+
+    return false;
+}
+
+// Precompiled headers
+
+// Returns the header name from a line like '#include <vector>', or ""
+std::string parseSystemInclude(const std::string& line) {
+    std::string text = trim(line);
+    if (text.empty() || text[0] != '#') return "";
+    
+    text = trim(text.substr(1));
+    if (text.compare(0, 7, "include") != 0) return "";
+    
+    text = trim(text.substr(7));
+    size_t close = text.find('>');
+    if (text.empty() || text[0] != '<' || close == std::string::npos) return "";
+    return text.substr(1, close - 1);
+}
+
+// Finds the <...> headers included by at least half of the sources, most common first.
+// Quoted project headers are left out since they may depend on what precedes them.
+std::vector<std::string> findCommonHeaders(const std::vector<std::string>& sourceFiles) {
+    std::map<std::string, int> counts;
+    std::vector<std::string> firstSeen;
+    
+    for (const auto& srcFile : sourceFiles) {
+        std::ifstream file(srcFile);
+        std::map<std::string, bool> seenInFile;
+        std::string line;
+        
+        while (std::getline(file, line)) {
+            std::string header = parseSystemInclude(line);
+            if (header.empty() || seenInFile[header]) continue;
+            seenInFile[header] = true;
+            
+            if (counts[header]++ == 0) {
+                firstSeen.push_back(header);
+            }
+        }
+    }
+    
+    int threshold = std::max(2, static_cast<int>(sourceFiles.size() + 1) / 2);
+    std::vector<std::string> headers;
+    for (const auto& header : firstSeen) {
+        if (counts[header] >= threshold) {
+            headers.push_back(header);
+        }
+    }
+    
+    std::stable_sort(headers.begin(), headers.end(), [&](const std::string& a, const std::string& b) {
+        return counts[a] > counts[b];
+    });
+    return headers;
+}
+
+// "../" once for every component of dir, to reach the project root from it
+std::string relativePathToRoot(const std::string& dir) {
+    std::string prefix = "../";
+    for (char c : dir) {
+        if (c == '/' || c == '\\') prefix += "../";
+    }
+    return prefix;
+}
+
+// Writes build/<profile>/pch/cclank_pch.hpp, the header that gets precompiled.
+// It wraps [build] pch, or lists the most common includes when pch = "auto".
+// Returns its path, or "" when there is nothing to precompile.
+std::string preparePchHeader(const TomlConfig& config, const std::string& buildPath, const std::vector<std::string>& sourceFiles) {
+    if (config.pch.empty()) return "";
+    
+    std::string pchDir = buildPath + "/pch";
+    std::string content = "// Generated by cclank\n";
+    
+    if (config.pch == "auto") {
+        std::vector<std::string> headers = findCommonHeaders(sourceFiles);
+        if (headers.empty()) return "";
+        for (const auto& header : headers) {
+            content += "#include <" + header + ">\n";
+        }
+    } else {
+        if (!fileExists(config.pch)) {
+            std::cerr << "Warning: Precompiled header '" << config.pch << "' not found, building without it" << std::endl;
+            return "";
+        }
+        content += "#include \"" + relativePathToRoot(pchDir) + config.pch + "\"\n";
+    }
+    
+    if (!createDirectories(pchDir)) {
+        std::cerr << "Warning: Could not create " << pchDir << " directory, building without a precompiled header" << std::endl;
+        return "";
+    }
+    
+    // Keep the timestamp stable unless the list of headers changed
+    std::string headerPath = pchDir + "/cclank_pch.hpp";
+    if (readFile(headerPath) != content) {
+        writeFile(headerPath, content);
+    }
+    return headerPath;
+}
+
+// GCC picks up header.gch automatically for -include header. Clang's PCH gets a
+// name it won't auto-detect, so preprocessing for the object cache stays textual.
+std::string pchOutputPath(const std::string& headerPath) {
+    if (toolchain().pchFormat == "pch") {
+        return headerPath.substr(0, headerPath.find_last_of('.')) + ".pch";
+    }
+    return headerPath + ".gch";
+}
+
+std::string pchIncludeFlags(const std::string& headerPath) {
+    if (toolchain().pchFormat == "pch") {
+        return " -include-pch " + quoteArgument(pchOutputPath(headerPath));
+    }
+    return " -include " + quoteArgument(headerPath);
+}
+
+std::vector<std::string> pchCommand(const std::string& flags, const std::string& headerPath) {
+    std::string pchPath = pchOutputPath(headerPath);
+    std::vector<std::string> args = {toolchain().cxx};
+    appendFlags(args, flags);
+    args.insert(args.end(), {"-MMD", "-MP", "-MF", depfilePathFor(pchPath), "-x", "c++-header", headerPath, "-o", pchPath});
+    return args;
+}
+
+// Unity builds
+
+// unity-exclude entries may be a path like "src/a.cpp" or just a file name
+bool isUnityExcluded(const TomlConfig::Profile& profile, const std::string& srcFile) {
+    std::string path = normalizePath(srcFile);
+    for (const auto& pattern : profile.unityExclude) {
+        std::string excluded = normalizePath(pattern);
+        if (excluded == path || excluded == getFileName(path)) return true;
+    }
+    return false;
+}
+
+// Groups the sources into generated build/<profile>/unity/cclank_unity_<n>.cpp files
+// that #include unity-batch sources each. Returns the files to compile: the
+// batches plus any sources listed in unity-exclude, which are compiled on their own.
+std::vector<std::string> prepareUnityBatches(const TomlConfig::Profile& profile, const std::string& buildPath,
+                                             const std::vector<std::string>& sourceFiles) {
+    std::string unityDir = buildPath + "/unity";
+    if (!createDirectories(unityDir)) {
+        std::cerr << "Warning: Could not create " << unityDir << " directory, building without unity batches" << std::endl;
+        return sourceFiles;
+    }
+    
+    std::vector<std::string> compileUnits;
+    std::vector<std::string> batched;
+    for (const auto& srcFile : sourceFiles) {
+        // C sources can't be #included into a C++ batch
+        if (isUnityExcluded(profile, srcFile) || isCSource(srcFile)) {
+            compileUnits.push_back(srcFile);
+        } else {
+            batched.push_back(srcFile);
+        }
+    }
+    
+    // Sorted so every source lands in the same batch from one build to the next
+    std::sort(batched.begin(), batched.end());
+    
+    size_t batchSize = profile.unityBatch > 0 ? static_cast<size_t>(profile.unityBatch) : batched.size();
+    size_t batchCount = batchSize > 0 ? (batched.size() + batchSize - 1) / batchSize : 0;
+    std::string rootPrefix = relativePathToRoot(unityDir);
+    
+    for (size_t batch = 0; batch < batchCount; batch++) {
+        std::string content = "// Generated by cclank: unity batch " + std::to_string(batch + 1) +
+                              " of " + std::to_string(batchCount) + "\n";
+        for (size_t i = batch * batchSize; i < std::min(batched.size(), (batch + 1) * batchSize); i++) {
+            content += "#include \"" + rootPrefix + normalizePath(batched[i]) + "\"\n";
+        }
+        
+        // Only rewrite batches whose contents changed so their objects stay up to date
+        std::string unityFile = unityDir + "/cclank_unity_" + std::to_string(batch) + ".cpp";
+        if (readFile(unityFile) != content) {
+            writeFile(unityFile, content);
+        }
+        compileUnits.push_back(unityFile);
+    }
+    
+    return compileUnits;
+}
+
+// Local object cache
+//
+// Objects are stored in a user-level directory under a SHA-256 of the
+// preprocessed source, the compile flags and the compiler version, so a
+// clean, a branch switch or a second checkout can reuse them. Entries are
+// evicted least recently used first once the cache grows past its size cap.
+
+struct ObjectCache {
+    std::string directory;
+    std::string keyPrefix;    // compiler version, mixed into every key
+    std::string checkoutKey;  // project directory, mixed into keys of objects with debug info
+    std::atomic<int> hits{0};
+    std::atomic<int> misses{0};
+    std::atomic<long long> storedBytes{0};
+};
+
+struct CacheStats {
+    long long hits = 0;
+    long long misses = 0;
+    long long size = 0;
+};
+
+long long getFileSize(const std::string& path) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) {
+        return 0;
+    }
+    return (static_cast<long long>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+}
+
+// Sets a file's last write time to now
+void touchFile(const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return;
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    SetFileTime(file, NULL, NULL, &now);
+    CloseHandle(file);
+}
+
+std::string formatSize(long long bytes) {
+    const char* units[] = { "B", "KB", "MB", "GB", "TB" };
+    double size = static_cast<double>(bytes);
+    int unit = 0;
+    while (size >= 1024 && unit < 4) {
+        size /= 1024;
+        unit++;
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), unit == 0 ? "%.0f %s" : "%.1f %s", size, units[unit]);
+    return buffer;
+}
+
+// Parses sizes like "500M", "5G" or a plain number of bytes
+long long parseSize(const std::string& text) {
+    std::string value = trim(text);
+    if (value.empty()) return 0;
+    
+    long long multiplier = 1;
+    char suffix = static_cast<char>(toupper(value.back()));
+    if (suffix == 'K') multiplier = 1024LL;
+    else if (suffix == 'M') multiplier = 1024LL * 1024;
+    else if (suffix == 'G') multiplier = 1024LL * 1024 * 1024;
+    else if (suffix == 'T') multiplier = 1024LL * 1024 * 1024 * 1024;
+    if (multiplier != 1) value.pop_back();
+    
+    return static_cast<long long>(atof(value.c_str()) * multiplier);
+}
+
+std::string getCacheDirectory() {
+    std::string dir = getEnvironmentVariable("CCLANK_CACHE_DIR");
+    if (!dir.empty()) return dir;
+    
+    std::string localAppData = getEnvironmentVariable("LOCALAPPDATA");
+    if (!localAppData.empty()) return localAppData + "\\cclank\\cache";
+    
+    return getEnvironmentVariable("USERPROFILE") + "\\.cclank\\cache";
+}
+
+long long getCacheMaxSize() {
+    long long size = parseSize(getEnvironmentVariable("CCLANK_CACHE_SIZE"));
+    return size > 0 ? size : 5LL * 1024 * 1024 * 1024;
+}
+
+CacheStats readCacheStats(const std::string& cacheDir) {
+    CacheStats stats;
+    std::ifstream file(cacheDir + "\\stats");
+    std::string key;
+    long long value;
+    while (file >> key >> value) {
+        if (key == "hits") stats.hits = value;
+        else if (key == "misses") stats.misses = value;
+        else if (key == "size") stats.size = value;
+    }
+    return stats;
+}
+
+void writeCacheStats(const std::string& cacheDir, const CacheStats& stats) {
+    writeFile(cacheDir + "\\stats",
+              "hits " + std::to_string(stats.hits) + "\n" +
+              "misses " + std::to_string(stats.misses) + "\n" +
+              "size " + std::to_string(stats.size) + "\n");
+}
+
+struct CacheEntry {
+    std::string path;
+    ULONGLONG lastUsed;
+    long long size;
+};
+
+// Lists every file in the two-character shard directories of the cache
+std::vector<CacheEntry> listCacheEntries(const std::string& cacheDir) {
+    std::vector<CacheEntry> entries;
+    WIN32_FIND_DATAA shardData;
+    HANDLE hShard = FindFirstFileA((cacheDir + "\\*").c_str(), &shardData);
+    if (hShard == INVALID_HANDLE_VALUE) return entries;
+    
+    do {
+        std::string shard = shardData.cFileName;
+        if (!(shardData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || shard.length() != 2 || shard == "..") continue;
+        
+        WIN32_FIND_DATAA fileData;
+        std::string shardPath = cacheDir + "\\" + shard;
+        HANDLE hFile = FindFirstFileA((shardPath + "\\*").c_str(), &fileData);
+        if (hFile == INVALID_HANDLE_VALUE) continue;
+        
+        do {
+            if (fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+            CacheEntry entry;
+            entry.path = shardPath + "\\" + fileData.cFileName;
+            entry.lastUsed = (static_cast<ULONGLONG>(fileData.ftLastWriteTime.dwHighDateTime) << 32) | fileData.ftLastWriteTime.dwLowDateTime;
+            entry.size = (static_cast<long long>(fileData.nFileSizeHigh) << 32) | fileData.nFileSizeLow;
+            entries.push_back(entry);
+        } while (FindNextFileA(hFile, &fileData) != 0);
+        FindClose(hFile);
+    } while (FindNextFileA(hShard, &shardData) != 0);
+    FindClose(hShard);
+    
+    return entries;
+}
+
+// Deletes least recently used entries until the cache is below 90% of maxSize
+void evictObjectCache(const std::string& cacheDir, long long maxSize, CacheStats& stats) {
+    std::vector<CacheEntry> entries = listCacheEntries(cacheDir);
+    std::sort(entries.begin(), entries.end(), [](const CacheEntry& a, const CacheEntry& b) {
+        return a.lastUsed < b.lastUsed;
+    });
+    
+    long long total = 0;
+    for (const auto& entry : entries) total += entry.size;
+    
+    long long target = maxSize / 10 * 9;
+    for (const auto& entry : entries) {
+        if (total <= target) break;
+        if (DeleteFileA(entry.path.c_str())) {
+            total -= entry.size;
+        }
+    }
+    stats.size = total;
+}
+
+// Points dest at the same data as source: a hard link when possible, a copy otherwise
+bool linkOrCopyFile(const std::string& source, const std::string& dest) {
+    DeleteFileA(dest.c_str());
+    if (CreateHardLinkA(dest.c_str(), source.c_str(), NULL)) return true;
+    return CopyFileA(source.c_str(), dest.c_str(), FALSE) != 0;
+}
+
+void openObjectCache(ObjectCache& cache) {
+    cache.directory = getCacheDirectory();
+    createDirectories(cache.directory);
+    cache.keyPrefix = getCompilerVersion() + '\0';
+    
+    char cwd[MAX_PATH];
+    if (GetCurrentDirectoryA(MAX_PATH, cwd)) {
+        cache.checkoutKey = std::string(cwd) + '\0';
+    }
+}
+
+// Adds this build's counters to the on-disk stats and enforces the size cap
+// Serializes updates of the stats file, and eviction, between builds sharing
+// the cache directory. Returns the held mutex for unlockCacheStats.
+HANDLE lockCacheStats(const std::string& cacheDir) {
+    std::string name = "Local\\cclank-cache-" + sha256Hex(normalizePath(cacheDir)).substr(0, 16);
+    HANDLE mutex = CreateMutexA(NULL, FALSE, name.c_str());
+    if (mutex) {
+        WaitForSingleObject(mutex, INFINITE);  // WAIT_ABANDONED, after a build crashed holding it, grants ownership too
+    }
+    return mutex;
+}
+
+void unlockCacheStats(HANDLE mutex) {
+    if (!mutex) return;
+    ReleaseMutex(mutex);
+    CloseHandle(mutex);
+}
+
+void closeObjectCache(ObjectCache& cache) {
+    HANDLE lock = lockCacheStats(cache.directory);
+    CacheStats stats = readCacheStats(cache.directory);
+    stats.hits += cache.hits;
+    stats.misses += cache.misses;
+    stats.size += cache.storedBytes;
+    
+    long long maxSize = getCacheMaxSize();
+    if (stats.size > maxSize) {
+        evictObjectCache(cache.directory, maxSize, stats);
+    }
+    writeCacheStats(cache.directory, stats);
+    unlockCacheStats(lock);
+    
+    std::cout << "Cache: " << cache.hits << " hit(s), " << cache.misses << " miss(es)" << std::endl;
+    cache.hits = 0;
+    cache.misses = 0;
+    cache.storedBytes = 0;
+}
+
+// Compile executors
+//
+// The compile step of a translation unit runs through an executor: either
+// locally, or on a build farm host running `cclank worker` (see Remote
+// compilation below). Executors that compile elsewhere work from the
+// preprocessed source, so headers never have to exist on the other side.
+
+struct CompileTask {
+    std::string srcFile;
+    std::string objFile;
+    std::vector<std::string> command;  // compiles srcFile to objFile on this machine
+    std::string preprocessedPath;      // srcFile preprocessed with the same flags, if wantsPreprocessed()
+};
+
+struct CompileExecutor {
+    virtual ~CompileExecutor() {}
+    virtual bool wantsPreprocessed() const { return false; }
+    virtual int compile(const CompileTask& task, std::string& output) = 0;
+};
+
+struct LocalExecutor : CompileExecutor {
+    int compile(const CompileTask& task, std::string& output) override {
+        return runProcess(task.command, output);
+    }
+};
+
+// Compiles a translation unit through the executor, and the object cache when
+// one is given. For either of them that needs it the source is preprocessed
+// first (which also writes the depfile); on a cache hit the cached object is
+// linked into place instead of running the compiler.
+int compileUnit(CompileExecutor& executor, ObjectCache* cache, const std::string& srcFile, const std::string& objFile,
+                const std::string& flags, const std::vector<std::string>& compileCmd, bool debugInfo, std::string& output) {
+    CompileTask task = {srcFile, objFile, compileCmd, ""};
+    
+    // A .dwo from an earlier build may be a hard link into the cache, which the compiler would overwrite in place
+    bool splitDwarf = flags.find(" -gsplit-dwarf") != std::string::npos;
+    std::string dwoFile = dwoPathFor(objFile);
+    if (splitDwarf) DeleteFileA(dwoFile.c_str());
+    
+    if (!cache && !executor.wantsPreprocessed()) {
+        return executor.compile(task, output);
+    }
+    
+    std::string preprocessedPath = objFile + ".ii";
+    std::vector<std::string> preprocessCmd = {compilerFor(srcFile)};
+    appendFlags(preprocessCmd, flags);
+    preprocessCmd.insert(preprocessCmd.end(), {"-MMD", "-MP", "-MF", depfilePathFor(objFile), "-MT", objFile,
+                                               "-E", srcFile, "-o", preprocessedPath});
+    
+    std::string preprocessOutput;
+    if (runProcess(preprocessCmd, preprocessOutput) != 0) {
+        // Let the real compile report the error
+        DeleteFileA(preprocessedPath.c_str());
+        if (cache) cache->misses++;
+        return runProcess(compileCmd, output);
+    }
+    
+    if (executor.wantsPreprocessed()) {
+        task.preprocessedPath = preprocessedPath;
+    }
+    if (!cache) {
+        int result = executor.compile(task, output);
+        DeleteFileA(preprocessedPath.c_str());
+        return result;
+    }
+    
+    // Debug info records the build directory, so debug objects are only shared within one checkout
+    std::string key = sha256Hex(cache->keyPrefix + (debugInfo ? cache->checkoutKey : "") + compilerFor(srcFile) + '\0' + flags + '\0' + readFile(preprocessedPath));
+    
+    std::string entryDir = cache->directory + "\\" + key.substr(0, 2);
+    std::string entryPath = entryDir + "\\" + key.substr(2) + ".o";
+    std::string logPath = entryDir + "\\" + key.substr(2) + ".log";
+    std::string dwoEntryPath = entryDir + "\\" + key.substr(2) + ".dwo";
+    
+    if (fileExists(entryPath) && (!splitDwarf || linkOrCopyFile(dwoEntryPath, dwoFile)) && linkOrCopyFile(entryPath, objFile)) {
+        // Bump the entry for LRU eviction; copies would otherwise keep the old timestamp
+        DeleteFileA(preprocessedPath.c_str());
+        touchFile(entryPath);
+        touchFile(objFile);
+        if (splitDwarf) touchFile(dwoEntryPath);
+        output += readFile(logPath);
+        cache->hits++;
+        return 0;
+    }
+    
+    cache->misses++;
+    int result = executor.compile(task, output);
+    DeleteFileA(preprocessedPath.c_str());
+    if (result != 0) return result;
+    
+    // Copy under a temporary name and rename so other builds never see a partial entry
+    createDirectory(entryDir);
+    std::string tempPath = entryPath + "." + std::to_string(GetCurrentProcessId()) + "." +
+                           std::to_string(GetCurrentThreadId()) + ".tmp";
+    if (CopyFileA(objFile.c_str(), tempPath.c_str(), FALSE)) {
+        if (!output.empty()) {
+            writeFile(logPath, output);
+        }
+        // The object entry is published last, so a hit always finds its .dwo
+        if (splitDwarf && CopyFileA(dwoFile.c_str(), (tempPath + ".dwo").c_str(), FALSE)) {
+            if (MoveFileExA((tempPath + ".dwo").c_str(), dwoEntryPath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+                cache->storedBytes += getFileSize(dwoEntryPath);
+            } else {
+                DeleteFileA((tempPath + ".dwo").c_str());
+            }
+        }
+        if (MoveFileExA(tempPath.c_str(), entryPath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            cache->storedBytes += getFileSize(entryPath) + static_cast<long long>(output.size());
+        } else {
+            DeleteFileA(tempPath.c_str());
+        }
+    }
+    
+    return result;
+}
+
+void cacheCommand(const std::string& action) {
+    std::string cacheDir = getCacheDirectory();
+    
+    if (action == "stats") {
+        CacheStats stats = readCacheStats(cacheDir);
+        long long lookups = stats.hits + stats.misses;
+        double hitRate = lookups > 0 ? 100.0 * stats.hits / lookups : 0.0;
+        char rate[16];
+        snprintf(rate, sizeof(rate), "%.1f%%", hitRate);
+        
+        std::cout << "Cache directory: " << cacheDir << std::endl;
+        std::cout << "Hits:            " << stats.hits << std::endl;
+        std::cout << "Misses:          " << stats.misses << std::endl;
+        std::cout << "Hit rate:        " << rate << std::endl;
+        std::cout << "Size:            " << formatSize(stats.size) << " / " << formatSize(getCacheMaxSize()) << std::endl;
+        std::cout << "Prebuilt:        " << listDirectory(cacheDir + "\\prebuilt").size() << " package build(s)" << std::endl;
+    }
+    else if (action == "clear") {
+        HANDLE lock = lockCacheStats(cacheDir);
+        std::vector<CacheEntry> entries = listCacheEntries(cacheDir);
+        for (const auto& entry : entries) {
+            DeleteFileA(entry.path.c_str());
+        }
+        
+        CacheStats stats = readCacheStats(cacheDir);
+        stats.size = 0;
+        writeCacheStats(cacheDir, stats);
+        unlockCacheStats(lock);
+        std::cout << "Removed " << entries.size() << " cache file(s) from " << cacheDir << std::endl;
+        
+        // Prebuilt dependencies and unpacked tarballs are rebuilt on the next build that uses them
+        size_t prebuilt = listDirectory(cacheDir + "\\prebuilt").size();
+        removeDirectoryTree(cacheDir + "\\prebuilt");
+        removeDirectoryTree(cacheDir + "\\sources");
+        if (prebuilt > 0) {
+            std::cout << "Removed " << prebuilt << " prebuilt package build(s)" << std::endl;
+        }
+    }
+    else {
+        std::cerr << "Error: Unknown cache command '" << action << "'" << std::endl;
+        std::cout << "Usage: cclank cache <stats|clear>" << std::endl;
+    }
+}
+
+// Reads clang's -ftime-trace file for an object and adds its events to the
+// build trace, shifted to when that compile started
+void mergeClangTimeTrace(const TimingEvent& compile) {
+    size_t outputFlag = compile.command.find(" -o ");
+    if (outputFlag == std::string::npos) return;
+    std::string objPath = compile.command.substr(outputFlag + 4);
+    objPath = objPath.substr(0, objPath.find(' '));
+    std::string tracePath = objPath.substr(0, objPath.find_last_of('.')) + ".json";
+    
+    JsonValue trace;
+    if (!parseJson(readFile(tracePath), trace)) return;
+    const JsonValue* events = trace.get("traceEvents");
+    if (!events || events->type != JsonValue::Array) return;
+    
+    for (const auto& event : events->array) {
+        if (event.getString("ph") != "X") continue;
+        
+        TimingEvent merged;
+        merged.name = event.getString("name");
+        merged.category = "clang";
+        merged.start = compile.start + event.getNumber("ts");
+        merged.duration = event.getNumber("dur");
+        merged.lane = compile.lane;
+        if (const JsonValue* args = event.get("args")) {
+            merged.detail = args->getString("detail");
+        }
+        buildTimings.events.push_back(merged);
+    }
+}
+
+std::string formatSeconds(double micros) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.2fs", micros / 1000000.0);
+    return buffer;
+}
+
+// Writes timings.json (Chrome trace) and timings.html, and prints a summary
+void writeTimings(const std::string& buildPath) {
+    double wallTime = timingNow();
+    
+    if (buildTimings.timeTrace && compilerIsClang()) {
+        std::vector<TimingEvent> compiles;
+        for (const auto& event : buildTimings.events) {
+            if (event.category == "compile") compiles.push_back(event);
+        }
+        for (const auto& compile : compiles) {
+            mergeClangTimeTrace(compile);
+        }
+    }
+    
+    const std::vector<TimingEvent>& events = buildTimings.events;
+    if (!createDirectories(buildPath)) {
+        std::cerr << "Warning: Could not create " << buildPath << ", timings not written" << std::endl;
+        return;
+    }
+    
+    // Chrome trace-event format, viewable in chrome://tracing or ui.perfetto.dev
+    std::string trace = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    int maxLane = 0;
+    for (const auto& event : events) maxLane = std::max(maxLane, event.lane);
+    for (int lane = 0; lane <= maxLane; lane++) {
+        trace += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(lane) +
+                 ",\"args\":{\"name\":\"" + (lane == 0 ? std::string("cclank") : "job " + std::to_string(lane)) + "\"}},\n";
+    }
+    for (size_t i = 0; i < events.size(); i++) {
+        const TimingEvent& event = events[i];
+        char times[64];
+        snprintf(times, sizeof(times), "\"ts\":%.0f,\"dur\":%.0f", event.start, event.duration);
+        trace += "{\"name\":\"" + jsonEscape(event.name) + "\",\"cat\":\"" + event.category + "\",\"ph\":\"X\"," +
+                 times + ",\"pid\":1,\"tid\":" + std::to_string(event.lane) + ",\"args\":{";
+        std::string args;
+        if (!event.command.empty()) {
+            args += "\"command\":\"" + jsonEscape(event.command) + "\",\"exitCode\":" + std::to_string(event.exitCode);
+        }
+        if (event.peakRss > 0) {
+            args += std::string(args.empty() ? "" : ",") + "\"peakRssBytes\":" + std::to_string(event.peakRss);
+        }
+        if (!event.command.empty()) {
+            char cpu[96];
+            snprintf(cpu, sizeof(cpu), ",\"userUs\":%.0f,\"sysUs\":%.0f", event.userTime, event.systemTime);
+            args += cpu;
+        }
+        if (!event.detail.empty()) {
+            args += std::string(args.empty() ? "" : ",") + "\"detail\":\"" + jsonEscape(event.detail) + "\"";
+        }
+        trace += args + "}}" + (i + 1 < events.size() ? ",\n" : "\n");
+    }
+    trace += "]}\n";
+    writeFile(buildPath + "/timings.json", trace);
+    
+    // Totals per kind of step
+    std::map<std::string, std::pair<int, double>> totals;
+    for (const auto& event : events) {
+        if (event.category == "job" || event.category == "phase" || event.category == "clang") continue;
+        totals[event.category].first++;
+        totals[event.category].second += event.duration;
+    }
+    
+    // Slowest jobs, with the peak memory of the processes they ran
+    std::vector<TimingEvent> slowest;
+    for (const auto& event : events) {
+        if (event.category != "job") continue;
+        TimingEvent job = event;
+        for (const auto& process : events) {
+            if (process.lane == job.lane && !process.command.empty() &&
+                process.start >= job.start && process.start < job.start + job.duration) {
+                job.peakRss = std::max(job.peakRss, process.peakRss);
+            }
+        }
+        slowest.push_back(job);
+    }
+    std::sort(slowest.begin(), slowest.end(), [](const TimingEvent& a, const TimingEvent& b) {
+        return a.duration > b.duration;
+    });
+    if (slowest.size() > 20) slowest.resize(20);
+    
+    std::string html = "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>cclank build timings</title>\n"
+                       "<style>body{font-family:sans-serif}table{border-collapse:collapse}"
+                       "td,th{padding:2px 12px;text-align:left}td.n{text-align:right}</style></head><body>\n";
+    html += "<h1>Build timings</h1>\n<p>Wall time: " + formatSeconds(wallTime) + "</p>\n";
+    html += "<h2>Steps</h2>\n<table><tr><th>Step</th><th>Processes</th><th>Total time</th></tr>\n";
+    
+    std::cout << "\nBuild timings (wall " << formatSeconds(wallTime) << "):" << std::endl;
+    for (const auto& total : totals) {
+        char line[128];
+        snprintf(line, sizeof(line), "  %-12s %5d process(es) %10s total", total.first.c_str(),
+                 total.second.first, formatSeconds(total.second.second).c_str());
+        std::cout << line << std::endl;
+        html += "<tr><td>" + escapeXml(total.first) + "</td><td class=\"n\">" + std::to_string(total.second.first) +
+                "</td><td class=\"n\">" + formatSeconds(total.second.second) + "</td></tr>\n";
+    }
+    html += "</table>\n<h2>Slowest translation units</h2>\n"
+            "<table><tr><th>File</th><th>Time</th><th>Peak memory</th></tr>\n";
+    
+    if (!slowest.empty()) {
+        std::cout << "Slowest translation units:" << std::endl;
+    }
+    for (size_t i = 0; i < slowest.size(); i++) {
+        if (i < 10) {
+            char line[256];
+            snprintf(line, sizeof(line), "  %8s %10s  %s", formatSeconds(slowest[i].duration).c_str(),
+                     formatSize(slowest[i].peakRss).c_str(), slowest[i].name.c_str());
+            std::cout << line << std::endl;
+        }
+        html += "<tr><td>" + escapeXml(slowest[i].name) + "</td><td class=\"n\">" + formatSeconds(slowest[i].duration) +
+                "</td><td class=\"n\">" + formatSize(slowest[i].peakRss) + "</td></tr>\n";
+    }
+    html += "</table>\n</body></html>\n";
+    writeFile(buildPath + "/timings.html", html);
+    
+    std::cout << "Trace written to " << buildPath << "/timings.json (open in chrome://tracing or ui.perfetto.dev)" << std::endl;
+    std::cout << "Summary written to " << buildPath << "/timings.html" << std::endl;
+}
+
+// Build manifest
+//
+// A successful build writes build/<profile>/manifest.bin: a hash of the
+// configuration, every file the build read (sources, headers from the
+// depfiles, scanned directories) with its last write time and size, the
+// commands that were run, and the outputs with their hashes. When none of
+// that changed, the next build returns before parsing or compiling anything.
+
+const char manifestMagic[8] = {'C', 'C', 'L', 'K', 'M', 'A', 'N', '1'};
+
+struct ManifestEntry {
+    std::string path;
+    ULONGLONG mtime = 0;
+    unsigned long long size = 0;
+    std::string hash;  // outputs only
+};
+
+struct BuildManifest {
+    std::string configHash;
+    std::vector<ManifestEntry> inputs;
+    std::vector<std::string> commands;
+    std::vector<ManifestEntry> outputs;
+};
+
+ManifestEntry statEntry(const std::string& path) {
+    ManifestEntry entry;
+    entry.path = path;
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) {
+        entry.mtime = (static_cast<ULONGLONG>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+        // A directory's size is meaningless; its write time covers its entries
+        if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            entry.size = (static_cast<unsigned long long>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+        }
+    }
+    return entry;
+}
+
+void appendU64(std::string& out, unsigned long long value) {
+    for (int i = 0; i < 8; i++) {
+        out += static_cast<char>((value >> (i * 8)) & 0xff);
+    }
+}
+
+void appendString(std::string& out, const std::string& value) {
+    appendU64(out, value.size());
+    out += value;
+}
+
+struct ManifestReader {
+    const std::string& data;
+    size_t pos = 0;
+    bool ok = true;
+    
+    explicit ManifestReader(const std::string& d) : data(d) {}
+    
+    unsigned long long u64() {
+        if (pos + 8 > data.size()) { ok = false; return 0; }
+        unsigned long long value = 0;
+        for (int i = 0; i < 8; i++) {
+            value |= static_cast<unsigned long long>(static_cast<unsigned char>(data[pos + i])) << (i * 8);
+        }
+        pos += 8;
+        return value;
+    }
+    
+    std::string str() {
+        unsigned long long length = u64();
+        if (!ok || length > data.size() - pos) { ok = false; return ""; }
+        std::string value = data.substr(pos, length);
+        pos += length;
+        return value;
+    }
+};
+
+void appendEntries(std::string& out, const std::vector<ManifestEntry>& entries, bool withHash) {
+    appendU64(out, entries.size());
+    for (const auto& entry : entries) {
+        appendString(out, entry.path);
+        appendU64(out, entry.mtime);
+        appendU64(out, entry.size);
+        if (withHash) appendString(out, entry.hash);
+    }
+}
+
+std::vector<ManifestEntry> readEntries(ManifestReader& reader, bool withHash) {
+    std::vector<ManifestEntry> entries;
+    unsigned long long count = reader.u64();
+    for (unsigned long long i = 0; i < count && reader.ok; i++) {
+        ManifestEntry entry;
+        entry.path = reader.str();
+        entry.mtime = reader.u64();
+        entry.size = reader.u64();
+        if (withHash) entry.hash = reader.str();
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+bool writeManifest(const std::string& path, const BuildManifest& manifest) {
+    std::string out(manifestMagic, sizeof(manifestMagic));
+    appendString(out, manifest.configHash);
+    appendEntries(out, manifest.inputs, false);
+    appendU64(out, manifest.commands.size());
+    for (const auto& command : manifest.commands) {
+        appendString(out, command);
+    }
+    appendEntries(out, manifest.outputs, true);
+    
+    // Written under a temporary name so a reader never sees half a manifest
+    std::string tempPath = path + ".tmp";
+    if (!writeFile(tempPath, out)) return false;
+    return MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+bool readManifest(const std::string& path, BuildManifest& manifest) {
+    std::string data = readFile(path);
+    if (data.size() < sizeof(manifestMagic) || data.compare(0, sizeof(manifestMagic), manifestMagic, sizeof(manifestMagic)) != 0) {
+        return false;
+    }
+    
+    ManifestReader reader(data);
+    reader.pos = sizeof(manifestMagic);
+    manifest.configHash = reader.str();
+    manifest.inputs = readEntries(reader, false);
+    unsigned long long commandCount = reader.u64();
+    for (unsigned long long i = 0; i < commandCount && reader.ok; i++) {
+        manifest.commands.push_back(reader.str());
+    }
+    manifest.outputs = readEntries(reader, true);
+    return reader.ok && reader.pos == data.size();
+}
+
+std::string manifestPathFor(const std::string& buildPath) {
+    return buildPath + "/manifest.bin";
+}
+
+// Identifies an executable on PATH by its location, write time and size, so
+// upgrading the compiler invalidates the manifest without running it
+std::string toolIdentity(const std::string& tool) {
+    char path[MAX_PATH];
+    if (SearchPathA(nullptr, tool.c_str(), ".exe", MAX_PATH, path, nullptr) == 0) {
+        return tool + "?";
+    }
+    ManifestEntry entry = statEntry(path);
+    return entry.path + ":" + std::to_string(entry.mtime) + ":" + std::to_string(entry.size);
+}
+
+// Everything besides the input files that decides what a build produces
+std::string buildConfigHash(const std::string& tomlPath, const BuildOptions& options) {
+    std::string key = "cclank.toml\n" + readFile(tomlPath);
+    key += std::string("\nprofile ") + (options.isRelease ? "release" : "debug") + " " + options.profile;
+    key += std::string("\ntime-trace ") + (options.timeTrace ? "1" : "0");
+    key += "\npgo " + options.pgoFlags;
+    static const std::string tools = toolIdentity(toolchain().cxx) + "\n" + toolIdentity(toolchain().cc) + "\n" +
+                                     toolIdentity(binutilsProgram("ar")) + "\n" + toolIdentity("windres");
+    key += "\n" + tools;
+    return sha256Hex(key);
+}
+
+// True when the last build of this profile is still current: the config hash
+// matches, and every input and output has the write time and size recorded
+bool isBuildUpToDate(const std::string& buildPath, const std::string& configHash, std::string& outputPath) {
+    BuildManifest manifest;
+    if (!readManifest(manifestPathFor(buildPath), manifest) || manifest.configHash != configHash) {
+        return false;
+    }
+    
+    for (const auto& input : manifest.inputs) {
+        ManifestEntry current = statEntry(input.path);
+        if (current.mtime != input.mtime || current.size != input.size) return false;
+    }
+    for (const auto& output : manifest.outputs) {
+        ManifestEntry current = statEntry(output.path);
+        if (current.mtime == 0 || current.mtime != output.mtime || current.size != output.size) return false;
+    }
+    
+    outputPath = manifest.outputs.empty() ? "" : manifest.outputs.front().path;
+    return true;
+}
+
+// Records a finished build. Skipped when a source was modified after the build
+// started, since the build may have read it before the change. Files under
+// build/ (libraries of dependencies, unity batches, the PCH wrapper) and
+// prebuilt libraries in the cache are written by the build itself and exempt.
+void recordBuild(const std::string& buildPath, BuildManifest& manifest, const std::vector<std::string>& inputPaths,
+                 const std::vector<std::string>& outputPaths, ULONGLONG buildStart) {
+    std::vector<std::string> paths = inputPaths;
+    std::sort(paths.begin(), paths.end());
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+    
+    static const std::string prebuiltDir = normalizePath(getCacheDirectory()) + "/prebuilt/";
+    for (const auto& path : paths) {
+        ManifestEntry entry = statEntry(path);
+        std::string normalized = normalizePath(path);
+        if (entry.mtime >= buildStart && normalized.compare(0, 6, "build/") != 0 &&
+            normalized.compare(0, prebuiltDir.length(), prebuiltDir) != 0) return;
+        manifest.inputs.push_back(entry);
+    }
+    for (const auto& path : outputPaths) {
+        ManifestEntry entry = statEntry(path);
+        entry.hash = sha256Hex(readFile(path));
+        manifest.outputs.push_back(entry);
+    }
+    
+    writeManifest(manifestPathFor(buildPath), manifest);
+}
+
+bool extractEmbeddedIcon(const std::string& outputPath) {
+    HMODULE hModule = GetModuleHandle(NULL);
+    HRSRC hResource = FindResource(hModule, MAKEINTRESOURCE(IDR_ICON), RT_RCDATA);
+    
+    if (!hResource) {
+        std::cerr << "Error: Could not find embedded icon resource" << std::endl;
+        return false;
+    }
+    
+    HGLOBAL hLoadedResource = LoadResource(hModule, hResource);
+    if (!hLoadedResource) {
+        std::cerr << "Error: Could not load icon resource" << std::endl;
+        return false;
+    }
+    
+    void* pResourceData = LockResource(hLoadedResource);
+    DWORD dwResourceSize = SizeofResource(hModule, hResource);
+    
+    std::ofstream outFile(outputPath, std::ios::binary);
     if (!outFile) {
         std::cerr << "Error: Could not create icon file: " << outputPath << std::endl;
         return false;
     }
     
-    outFile.write(static_cast<const char*>(pResourceData), dwResourceSize);
-    outFile.close();
+    outFile.write(static_cast<const char*>(pResourceData), dwResourceSize);
+    outFile.close();
+    
+    return true;
+}
+
+void createDefaultToml(const std::string& projectPath, const std::string& projectName) {
+    std::string tomlPath = projectPath + "/cclank.toml";
+    std::ofstream toml(tomlPath);
+    
+    if (!toml) {
+        std::cerr << "Error: Could not create cclank.toml" << std::endl;
+        return;
+    }
+    
+    toml << "[package]\n";
+    toml << "name = \"" << projectName << "\"\n";
+    toml << "version = \"0.1.0\"\n";
+    toml << "platform = \"win\"\n";
+    toml << "type = \"bin\"\n";
+    toml << "icon = \"icon.ico\"\n";
+    toml << "\n";
+    toml << "[features]\n";
+    toml << "\n";
+    toml << "[profile.dev]\n";
+    toml << "opt-level = 0\n";
+    toml << "debug = true\n";
+    toml << "codegen-units = 4\n";
+    toml << "\n";
+    toml << "[profile.release]\n";
+    toml << "opt-level = 3\n";
+    toml << "debug = false\n";
+    toml << "lto = \"fat\"\n";
+    toml << "codegen-units = 1\n";
+    
+    toml.close();
+    std::cout << "Created cclank.toml" << std::endl;
+}
+
+void createMainCpp(const std::string& srcPath, const std::string& projectName) {
+    std::string mainPath = srcPath + "/main.cpp";
+    std::ofstream main(mainPath);
+    
+    if (!main) {
+        std::cerr << "Error: Could not create main.cpp" << std::endl;
+        return;
+    }
+    
+    main << "#include <iostream>\n";
+    main << "\n";
+    main << "int main() {\n";
+    main << "    std::cout << \"Hello from " << projectName << "!\" << std::endl;\n";
+    main << "    return 0;\n";
+    main << "}\n";
+    
+    main.close();
+    std::cout << "Created src/main.cpp" << std::endl;
+}
+
+void createNewProject(const std::string& projectName) {
+    // Check if directory already exists
+    if (directoryExists(projectName)) {
+        std::cerr << "Error: Directory '" << projectName << "' already exists" << std::endl;
+        return;
+    }
+    
+    // Create project directory
+    if (!createDirectory(projectName)) {
+        std::cerr << "Error: Could not create directory '" << projectName << "'" << std::endl;
+        return;
+    }
+    std::cout << "Created project directory: " << projectName << std::endl;
+    
+    // Create src directory
+    std::string srcPath = projectName + "/src";
+    if (!createDirectory(srcPath)) {
+        std::cerr << "Error: Could not create src/ directory" << std::endl;
+        return;
+    }
+    std::cout << "Created src/ directory" << std::endl;
+    
+    // Extract and save embedded icon
+    std::string iconPath = projectName + "/icon.ico";
+    if (extractEmbeddedIcon(iconPath)) {
+        std::cout << "Created icon.ico" << std::endl;
+    }
+    
+    // Create cclank.toml
+    createDefaultToml(projectName, projectName);
+    
+    // Create main.cpp
+    createMainCpp(srcPath, projectName);
+    
+    std::cout << "\nProject '" << projectName << "' created successfully!" << std::endl;
+    std::cout << "Next steps:" << std::endl;
+    std::cout << "  cd " << projectName << std::endl;
+    std::cout << "  cclank build" << std::endl;
+}
+
+// Remote compilation
+//
+// Build farm hosts run `cclank worker`. For each translation unit the client
+// sends the preprocessed source, its compile flags and its compiler's
+// --version banner over TCP; the worker compiles it with its own compiler and
+// sends back the exit code, the diagnostics and the object file. Hosts are
+// listed as host[:port][/slots] in [build] remote, or in CCLANK_REMOTE. When
+// every remote slot is busy, or a host can't be reached, the unit is compiled
+// locally instead.
+
+const char remoteMagic[8] = {'C', 'C', 'L', 'K', 'R', 'P', 'C', '1'};
+const int defaultWorkerPort = 3633;
+const int defaultRemoteSlots = 4;
+const unsigned long long maxRemoteMessage = 1ull << 30;   // responses, which carry the object file
+const unsigned long long maxRemoteRequest = 64ull << 20;  // a request: one preprocessed translation unit
+const DWORD workerReceiveTimeout = 30000;  // ms a worker waits for the rest of a request
+
+bool sendAll(SOCKET socket, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int chunk = static_cast<int>(std::min<size_t>(data.size() - sent, 1 << 20));
+        int result = send(socket, data.data() + sent, chunk, 0);
+        if (result <= 0) return false;
+        sent += result;
+    }
+    return true;
+}
+
+bool recvAll(SOCKET socket, char* data, size_t length) {
+    size_t received = 0;
+    while (received < length) {
+        int chunk = static_cast<int>(std::min<size_t>(length - received, 1 << 20));
+        int result = recv(socket, data + received, chunk, 0);
+        if (result <= 0) return false;
+        received += result;
+    }
+    return true;
+}
+
+// Messages are a little-endian length followed by the payload
+bool sendMessage(SOCKET socket, const std::string& payload) {
+    std::string message;
+    appendString(message, payload);
+    return sendAll(socket, message);
+}
+
+bool recvMessage(SOCKET socket, std::string& payload, unsigned long long maxLength = maxRemoteMessage) {
+    std::string header(8, '\0');
+    if (!recvAll(socket, &header[0], header.size())) return false;
+    ManifestReader reader(header);
+    unsigned long long length = reader.u64();
+    if (length > maxLength) return false;
+    payload.resize(static_cast<size_t>(length));
+    return length == 0 || recvAll(socket, &payload[0], payload.size());
+}
+
+// Flags a worker accepts, by name: code generation, warnings and language
+// options, nothing that makes the compiler read or write files the client
+// chooses. Values must be plain words, since some options pass theirs on as
+// more arguments (-fcompare-debug=-fplugin=...).
+bool isRemoteSafeFlag(const std::string& flag) {
+    static const std::set<std::string> exact = {
+        "-O", "-O0", "-O1", "-O2", "-O3", "-Os", "-Oz", "-Og", "-Ofast",
+        "-g", "-g0", "-g1", "-g2", "-g3", "-ggdb", "-gdwarf-4", "-gdwarf-5", "-gline-tables-only",
+        "-w", "-pedantic", "-pedantic-errors", "-ansi", "-pthread", "-m32", "-m64"
+    };
+    // -f options, also accepted as -fno-<name>
+    static const std::set<std::string> fOptions = {
+        "PIC", "pic", "PIE", "pie", "omit-frame-pointer", "function-sections", "data-sections", "exceptions",
+        "rtti", "strict-aliasing", "strict-overflow", "visibility-inlines-hidden", "permissive", "plt", "common",
+        "stack-protector", "stack-protector-strong", "stack-protector-all", "stack-clash-protection", "wrapv",
+        "trapv", "fast-math", "math-errno", "unroll-loops", "inline", "inline-functions", "lto", "fat-lto-objects",
+        "semantic-interposition", "threadsafe-statics", "asynchronous-unwind-tables", "unwind-tables",
+        "signed-char", "unsigned-char", "char8_t", "coroutines", "concepts", "openmp", "ms-extensions",
+        "diagnostics-color", "show-column", "builtin", "delete-null-pointer-checks", "tree-vectorize",
+        "vect-cost-model", "sized-deallocation", "aligned-new", "gnu-keywords", "implicit-templates",
+        "elide-constructors", "optimize-sibling-calls", "sanitize-recover", "trivial-auto-var-init"
+    };
+    // Options that take a value, with a word for it
+    static const std::set<std::string> valued = {
+        "-std", "-march", "-mtune", "-mcpu", "-mfpmath", "-mprefer-vector-width", "-mbranch-protection",
+        "-flto", "-fvisibility", "-fsanitize", "-fno-sanitize", "-fdiagnostics-color", "-fmax-errors",
+        "-ftemplate-depth", "-fconstexpr-depth", "-fconstexpr-loop-limit", "-fconstexpr-ops-limit",
+        "-fcf-protection", "-ffp-contract", "-fexcess-precision", "-ftls-model", "-fabi-version",
+        "-flto-partition", "-ftrivial-auto-var-init", "-fvect-cost-model", "-fstack-protector-guard"
+    };
+    auto isWord = [](const std::string& value, const char* punctuation) {
+        return !value.empty() && std::all_of(value.begin(), value.end(), [&](char c) {
+            return isalnum(static_cast<unsigned char>(c)) || strchr(punctuation, c);
+        });
+    };
+    
+    if (exact.count(flag)) return true;
+    
+    // Macros only reach the preprocessed source as a leftover #define; they name no file
+    if (flag.compare(0, 2, "-D") == 0 || flag.compare(0, 2, "-U") == 0) return flag.length() > 2;
+    
+    // Warnings (-Wall, -Wno-unused, -Wformat=2) name no file; -Wa, -Wl, and -Wp, hand the rest to other tools
+    if (flag.compare(0, 2, "-W") == 0) return isWord(flag.substr(2), "-_.+=");
+    
+    size_t equals = flag.find('=');
+    if (equals != std::string::npos) {
+        return valued.count(flag.substr(0, equals)) && isWord(flag.substr(equals + 1), "-_.,+");
+    }
+    if (flag.compare(0, 5, "-fno-") == 0) return fOptions.count(flag.substr(5)) > 0;
+    if (flag.compare(0, 2, "-f") == 0) return fOptions.count(flag.substr(2)) > 0;
+    
+    // Instruction set switches without a value (-mavx2, -mno-red-zone)
+    if (flag.compare(0, 2, "-m") == 0) return isWord(flag.substr(2), "-_.");
+    return false;
+}
+
+// The flags of a local compile command that still apply to its preprocessed
+// source. Returns false if one of them can't be sent to a worker.
+bool remoteCompileFlags(const CompileTask& task, std::vector<std::string>& flags) {
+    const std::vector<std::string>& args = task.command;
+    for (size_t i = 1; i < args.size(); i++) {
+        const std::string& arg = args[i];
+        if (arg == "-c" || arg == "-MMD" || arg == "-MP" || arg == task.srcFile) continue;
+        if (arg == "-o" || arg == "-MF" || arg == "-MT" || arg == "-I" || arg == "-include" || arg == "-include-pch") {
+            i++;
+            continue;
+        }
+        if (arg.compare(0, 2, "-I") == 0) continue;
+        if (!isRemoteSafeFlag(arg)) return false;
+        flags.push_back(arg);
+    }
+    return true;
+}
+
+// Connects with a short timeout, so a host that is down doesn't stall the build
+SOCKET connectToHost(const std::string& address, const std::string& port, std::string& error) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    addrinfo* resolved = nullptr;
+    if (getaddrinfo(address.c_str(), port.c_str(), &hints, &resolved) != 0 || !resolved) {
+        error = "could not resolve " + address;
+        return INVALID_SOCKET;
+    }
+    
+    SOCKET socket = ::socket(resolved->ai_family, resolved->ai_socktype, resolved->ai_protocol);
+    if (socket == INVALID_SOCKET) {
+        freeaddrinfo(resolved);
+        error = "could not create socket";
+        return INVALID_SOCKET;
+    }
+    
+    unsigned long nonBlocking = 1;
+    ioctlsocket(socket, FIONBIO, &nonBlocking);
+    bool connected = connect(socket, resolved->ai_addr, static_cast<int>(resolved->ai_addrlen)) == 0;
+    freeaddrinfo(resolved);
+    
+    if (!connected && WSAGetLastError() == WSAEWOULDBLOCK) {
+        fd_set writable;
+        FD_ZERO(&writable);
+        FD_SET(socket, &writable);
+        timeval timeout = {2, 0};
+        int socketError = 0;
+        socklen_t length = sizeof(socketError);
+        connected = select(static_cast<int>(socket) + 1, NULL, &writable, NULL, &timeout) == 1 &&
+                    getsockopt(socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&socketError), &length) == 0 &&
+                    socketError == 0;
+    }
+    if (!connected) {
+        closesocket(socket);
+        error = "connection refused or timed out";
+        return INVALID_SOCKET;
+    }
+    
+    nonBlocking = 0;
+    ioctlsocket(socket, FIONBIO, &nonBlocking);
+    int noDelay = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+    return socket;
+}
+
+struct RemoteHost {
+    std::string address;
+    std::string port = std::to_string(defaultWorkerPort);
+    int slots = defaultRemoteSlots;
+    int running = 0;
+    bool down = false;  // unreachable or incompatible; not used again in this build
+};
+
+// host[:port][/slots]
+RemoteHost parseRemoteHost(const std::string& spec) {
+    RemoteHost host;
+    std::string address = spec;
+    size_t slash = address.find('/');
+    if (slash != std::string::npos) {
+        host.slots = std::max(1, atoi(address.c_str() + slash + 1));
+        address.erase(slash);
+    }
+    size_t colon = address.find(':');
+    if (colon != std::string::npos) {
+        host.port = address.substr(colon + 1);
+        address.erase(colon);
+    }
+    host.address = address;
+    return host;
+}
+
+struct RemoteExecutor : CompileExecutor {
+    std::vector<RemoteHost> hosts;
+    std::mutex mutex;
+    size_t nextHost = 0;
+    LocalExecutor local;
+    std::atomic<int> remoteCount{0};
+    std::atomic<int> localCount{0};
+    
+    explicit RemoteExecutor(const std::vector<std::string>& specs) {
+        for (const auto& spec : specs) {
+            hosts.push_back(parseRemoteHost(spec));
+        }
+        if (!hosts.empty()) {
+            WSADATA data;
+            WSAStartup(MAKEWORD(2, 2), &data);
+        }
+    }
+    
+    ~RemoteExecutor() {
+        if (!hosts.empty()) WSACleanup();
+    }
+    
+    bool wantsPreprocessed() const override { return !hosts.empty(); }
+    
+    int slotCount() const {
+        int slots = 0;
+        for (const auto& host : hosts) slots += host.slots;
+        return slots;
+    }
+    
+    // Takes a free slot on the next host in turn, or returns SIZE_MAX if there is none
+    size_t acquireHost() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < hosts.size(); i++) {
+            size_t index = (nextHost + i) % hosts.size();
+            if (!hosts[index].down && hosts[index].running < hosts[index].slots) {
+                hosts[index].running++;
+                nextHost = index + 1;
+                return index;
+            }
+        }
+        return SIZE_MAX;
+    }
+    
+    // Sends one unit to a host. Returns false if the host couldn't compile it
+    // at all (as opposed to the compiler reporting errors), with the reason in error.
+    bool compileOn(const RemoteHost& host, const CompileTask& task, const std::vector<std::string>& flags,
+                   int& exitCode, std::string& output, std::string& error) {
+        std::string request(remoteMagic, sizeof(remoteMagic));
+        // "gcc" or "g++" tells the worker to use its own C or C++ compiler
+        appendString(request, isCSource(task.srcFile) ? "gcc" : "g++");
+        appendString(request, getCompilerVersion());
+        appendU64(request, flags.size());
+        for (const auto& flag : flags) {
+            appendString(request, flag);
+        }
+        appendString(request, readFile(task.preprocessedPath));
+        
+        SOCKET socket = connectToHost(host.address, host.port, error);
+        if (socket == INVALID_SOCKET) return false;
+        std::string response;
+        bool exchanged = sendMessage(socket, request) && recvMessage(socket, response);
+        closesocket(socket);
+        if (!exchanged) {
+            error = "connection lost";
+            return false;
+        }
+        
+        ManifestReader reader(response);
+        std::string status = reader.str();
+        exitCode = static_cast<int>(reader.u64());
+        std::string diagnostics = reader.str();
+        std::string object = reader.str();
+        if (!reader.ok) {
+            error = "invalid response";
+            return false;
+        }
+        if (status != "ok") {
+            error = status;
+            return false;
+        }
+        
+        output += diagnostics;
+        if (exitCode == 0 && !writeFile(task.objFile, object)) {
+            output += "Error: Could not write " + task.objFile + "\n";
+            exitCode = 1;
+        }
+        return true;
+    }
+    
+    int compile(const CompileTask& task, std::string& output) override {
+        std::vector<std::string> flags;
+        size_t index = SIZE_MAX;
+        if (!task.preprocessedPath.empty() && remoteCompileFlags(task, flags)) {
+            index = acquireHost();
+        }
+        if (index == SIZE_MAX) {
+            localCount++;
+            return local.compile(task, output);
+        }
+        
+        RemoteHost& host = hosts[index];
+        double start = buildTimings.enabled ? timingNow() : 0;
+        int exitCode = 1;
+        std::string error;
+        bool compiled = compileOn(host, task, flags, exitCode, output, error);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            host.running--;
+            if (!compiled && !host.down) {
+                host.down = true;
+                output += "Warning: Remote host " + host.address + ":" + host.port + " skipped for this build (" + error + ")\n";
+            }
+        }
+        if (!compiled) {
+            localCount++;
+            return local.compile(task, output);
+        }
+        remoteCount++;
+        
+        if (buildTimings.enabled) {
+            TimingEvent event;
+            event.category = "remote";
+            event.name = currentJobLabel.empty() ? task.srcFile : currentJobLabel;
+            event.start = start;
+            event.duration = timingNow() - start;
+            event.lane = currentLane;
+            event.exitCode = exitCode;
+            event.detail = host.address + ":" + host.port;
+            recordTiming(event);
+        }
+        return exitCode;
+    }
+};
+
+// Hosts from CCLANK_REMOTE (separated by spaces or commas), else from the first
+// package that lists any
+std::vector<std::string> remoteHostsFor(const std::vector<TomlConfig>& configs) {
+    char value[4096];
+    DWORD length = GetEnvironmentVariableA("CCLANK_REMOTE", value, sizeof(value));
+    if (length > 0 && length < sizeof(value)) {
+        std::vector<std::string> hosts;
+        std::string spec;
+        std::istringstream list(std::string(value, length));
+        while (std::getline(list, spec, ',')) {
+            std::istringstream words(spec);
+            std::string host;
+            while (words >> host) hosts.push_back(host);
+        }
+        return hosts;
+    }
+    for (const auto& config : configs) {
+        if (!config.remoteHosts.empty()) return config.remoteHosts;
+    }
+    return {};
+}
+
+// Limits how many units a worker compiles at once
+struct WorkerSlots {
+    std::mutex mutex;
+    std::condition_variable freed;
+    int available = 0;
+};
+
+// Gives a connection's job slot back
+void releaseWorkerSlot(WorkerSlots& slots) {
+    {
+        std::lock_guard<std::mutex> lock(slots.mutex);
+        slots.available++;
+    }
+    slots.freed.notify_one();
+}
+
+// Handles one request from a client: checks it, compiles the preprocessed
+// source in the temp directory and sends back the result. The connection
+// holds one of the worker's job slots from the time it was accepted.
+void serveCompile(SOCKET client, std::string peer, WorkerSlots& slots) {
+    static std::atomic<unsigned> counter(0);
+    static std::mutex logMutex;
+    
+    std::string request;
+    if (!recvMessage(client, request, maxRemoteRequest)) {
+        closesocket(client);
+        releaseWorkerSlot(slots);
+        return;
+    }
+    
+    ManifestReader reader(request);
+    bool validMagic = request.compare(0, sizeof(remoteMagic), std::string(remoteMagic, sizeof(remoteMagic))) == 0;
+    reader.pos = sizeof(remoteMagic);
+    std::string compiler = reader.str();
+    std::string version = reader.str();
+    std::vector<std::string> flags;
+    unsigned long long flagCount = reader.u64();
+    for (unsigned long long i = 0; i < flagCount && reader.ok; i++) {
+        flags.push_back(reader.str());
+    }
+    std::string source = reader.str();
+    
+    std::string status = "ok";
+    int exitCode = 1;
+    std::string output;
+    std::string object;
+    if (!validMagic || !reader.ok) {
+        status = "invalid request";
+    } else if (compiler != "gcc" && compiler != "g++") {
+        status = "unsupported compiler " + compiler;
+    } else if (version != getCompilerVersion()) {
+        status = "compiler differs: " + getCompilerVersion().substr(0, getCompilerVersion().find('\n'));
+    } else {
+        for (const auto& flag : flags) {
+            if (!isRemoteSafeFlag(flag)) status = "flag not allowed: " + flag;
+        }
+    }
+    
+    if (status == "ok") {
+        char tempDir[MAX_PATH];
+        DWORD length = GetTempPathA(MAX_PATH, tempDir);
+        std::string base = (length > 0 && length < MAX_PATH) ? std::string(tempDir) : std::string(".\\");
+        base += "cclank-worker-" + std::to_string(GetCurrentProcessId()) + "-" + std::to_string(counter++);
+        std::string sourcePath = base + (compiler == "gcc" ? ".i" : ".ii");
+        std::string objectPath = base + ".o";
+        
+        if (writeFile(sourcePath, source)) {
+            std::vector<std::string> args = {compiler == "gcc" ? toolchain().cc : toolchain().cxx};
+            args.insert(args.end(), flags.begin(), flags.end());
+            args.insert(args.end(), {"-c", sourcePath, "-o", objectPath});
+            exitCode = runProcess(args, output);
+            if (exitCode == 0) object = readFile(objectPath);
+        } else {
+            output = "Error: Worker could not write " + sourcePath + "\n";
+        }
+        DeleteFileA(sourcePath.c_str());
+        DeleteFileA(objectPath.c_str());
+    }
+    
+    std::string response;
+    appendString(response, status);
+    appendU64(response, static_cast<unsigned long long>(exitCode));
+    appendString(response, output);
+    appendString(response, object);
+    sendMessage(client, response);
+    closesocket(client);
+    releaseWorkerSlot(slots);
+    
+    std::lock_guard<std::mutex> lock(logMutex);
+    if (status != "ok") {
+        std::cout << "  " << peer << ": rejected (" << status << ")" << std::endl;
+    } else {
+        std::cout << "  " << peer << ": " << (exitCode == 0 ? "compiled " + formatSize(static_cast<long long>(object.size()))
+                                                            : "failed with exit code " + std::to_string(exitCode)) << std::endl;
+    }
+}
+
+// cclank worker: serves compile requests from other machines' builds. It
+// listens on the loopback address unless --listen names another one.
+void workerCommand(const std::string& listenAddress, int port, int jobs) {
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+        std::cerr << "Error: Could not initialize Winsock" << std::endl;
+        return;
+    }
+    
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<unsigned short>(port));
+    if (!listenAddress.empty() && inet_pton(AF_INET, listenAddress.c_str(), &address.sin_addr) != 1) {
+        std::cerr << "Error: --listen needs an IPv4 address, such as 0.0.0.0 for every interface" << std::endl;
+        WSACleanup();
+        return;
+    }
+    
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Error: Could not listen on port " << port << std::endl;
+        if (listener != INVALID_SOCKET) closesocket(listener);
+        WSACleanup();
+        return;
+    }
+    
+    WorkerSlots slots;
+    slots.available = jobs > 0 ? jobs : getDefaultJobCount();
+    const std::string& version = getCompilerVersion();
+    char listening[INET_ADDRSTRLEN] = "";
+    inet_ntop(AF_INET, &address.sin_addr, listening, sizeof(listening));
+    std::cout << "cclank worker listening on " << listening << ":" << port << " with " << slots.available << " job(s)" << std::endl;
+    std::cout << "Compiler: " << version.substr(0, version.find('\n')) << std::endl;
+    
+    // A connection is only accepted once a job slot is free, so idle or slow
+    // clients can't pile up threads and buffers; the rest wait in the backlog
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(slots.mutex);
+            slots.freed.wait(lock, [&]() { return slots.available > 0; });
+            slots.available--;
+        }
+        
+        sockaddr_in peerAddress = {};
+        socklen_t peerLength = sizeof(peerAddress);
+        SOCKET client = accept(listener, reinterpret_cast<sockaddr*>(&peerAddress), &peerLength);
+        if (client == INVALID_SOCKET) {
+            releaseWorkerSlot(slots);
+            continue;
+        }
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&workerReceiveTimeout), sizeof(workerReceiveTimeout));
+        
+        std::string peer = inet_ntoa(peerAddress.sin_addr);
+        std::thread(serveCompile, client, peer, std::ref(slots)).detach();
+    }
+}
+
+// C++20 modules
+//
+// A package with module interface units (.cppm or .ixx), or that depends on
+// one, has its C++ sources scanned for the modules they export and import:
+// with the compiler's P1689 output when it has it (clang-scan-deps, GCC 14's
+// -fdeps-format=p1689r5), otherwise by reading their module and import lines.
+// Each unit that exports a module writes its BMI (built module interface) to
+// build/<profile>/bmi/ while compiling, and the compile of every unit that
+// imports the module waits for it and reruns whenever the BMI changes. Scan
+// results are kept in build/<profile>/modules.txt and only redone for
+// sources that changed. Module units skip the object cache and remote
+// workers, which can't see the BMIs.
+
+struct ModuleScan {
+    std::string provides;               // module or partition ("net:http") the unit exports; "" if none
+    std::vector<std::string> imports;  // modules it imports
+};
+
+// A module some unit of a package provides
+struct ModuleInfo {
+    std::string srcFile;
+    std::string bmiPath;
+    std::vector<std::string> imports;
+    size_t job = SIZE_MAX;  // compile job that (re)writes the BMI in this run, if any
+};
+
+std::string bmiPathFor(const std::string& buildPath, const std::string& module) {
+    std::string name = module;
+    std::replace(name.begin(), name.end(), ':', '-');
+    return buildPath + "/bmi/" + name + (compilerIsClang() ? ".pcm" : ".gcm");
+}
+
+// Flags every C++ unit of a package that uses modules is compiled with
+std::string moduleFlags(const std::string& buildPath) {
+    if (compilerIsClang()) return " -std=c++20";
+    return " -std=c++20 -fmodules-ts " + quoteArgument("-fmodule-mapper=" + buildPath + "/modules.map");
+}
+
+// Reads the module declarations of a source from its text: lines like
+// "export module net;", "module net:detail;", "import net;" and "import :http;".
+// Declarations switched off by #if aren't recognized as such.
+ModuleScan scanModuleText(const std::string& srcFile) {
+    ModuleScan scan;
+    std::string content = readFile(srcFile);
+    std::string currentModule;
+    bool inComment = false;
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line)) {
+        // Drop comments
+        std::string code;
+        for (size_t i = 0; i < line.length(); i++) {
+            if (inComment) {
+                if (line.compare(i, 2, "*/") == 0) { inComment = false; i++; }
+            } else if (line.compare(i, 2, "/*") == 0) {
+                inComment = true;
+                i++;
+            } else if (line.compare(i, 2, "//") == 0) {
+                break;
+            } else {
+                code += line[i];
+            }
+        }
+        code = trim(code);
+        
+        bool exported = code.compare(0, 7, "export ") == 0;
+        if (exported) code = trim(code.substr(7));
+        bool isImport = code.compare(0, 7, "import ") == 0 || code.compare(0, 7, "import:") == 0;
+        bool isModule = code.compare(0, 7, "module ") == 0 || code.compare(0, 7, "module:") == 0;
+        size_t semicolon = code.find(';');
+        if ((!isImport && !isModule) || semicolon == std::string::npos) continue;
+        
+        // The name, without attributes: "net.http:detail [[deprecated]]"
+        std::string name = trim(code.substr(6, semicolon - 6));
+        name = trim(name.substr(0, name.find('[')));
+        if (name.empty() || name[0] == '<' || name[0] == '"') continue;  // global module fragment, header unit
+        if (name[0] == ':') {
+            if (name == ":private") continue;
+            name = currentModule + name;
+        }
+        
+        if (isModule) {
+            currentModule = name.substr(0, name.find(':'));
+            // "module net;" implements net; everything else declares a unit others can import
+            if (exported || name.find(':') != std::string::npos) scan.provides = name;
+            else scan.imports.push_back(name);
+        } else {
+            scan.imports.push_back(name);
+        }
+    }
+    return scan;
+}
+
+// The scanner that writes P1689 dependency info for the configured compiler:
+// clang-scan-deps next to clang (clang++-17 -> clang-scan-deps-17), or GCC 14+ itself
+std::string p1689Scanner() {
+    const Toolchain& tc = toolchain();
+    if (!tc.clang) return tc.major >= 14 ? tc.cxx : "";
+    
+    std::string name = getFileName(tc.cxx);
+    std::string dir = tc.cxx.substr(0, tc.cxx.length() - name.length());
+    size_t clang = name.find("clang");
+    if (clang == std::string::npos) return "";
+    std::string suffix = name.substr(clang + 5);
+    if (suffix.compare(0, 2, "++") == 0) suffix = suffix.substr(2);
+    std::string scanner = dir + name.substr(0, clang) + "clang-scan-deps" + suffix;
+    return findProgram(scanner).empty() ? "" : scanner;
+}
+
+// Scans one source with the compiler; returns false if that didn't work
+bool scanModuleP1689(const std::string& scanner, const std::string& flags, const std::string& srcFile,
+                     const std::string& objFile, ModuleScan& scan) {
+    std::string output;
+    std::string ddiPath = objFile + ".ddi";
+    std::vector<std::string> args;
+    if (compilerIsClang()) {
+        args = {scanner, "-format=p1689", "--", toolchain().cxx};
+    } else {
+        args = {scanner};
+    }
+    appendFlags(args, flags);
+    if (isModuleInterfaceFile(srcFile)) {
+        args.insert(args.end(), {"-x", compilerIsClang() ? "c++-module" : "c++"});
+    }
+    if (compilerIsClang()) {
+        args.insert(args.end(), {"-c", srcFile, "-o", objFile});
+    } else {
+        args.insert(args.end(), {"-E", srcFile, "-o", objFile + ".scan.ii", "-MT", ddiPath, "-MD", "-MF", ddiPath + ".d",
+                                 "-fdeps-format=p1689r5", "-fdeps-file=" + ddiPath, "-fdeps-target=" + objFile});
+    }
+    
+    bool scanned = runProcess(args, output) == 0;
+    if (!compilerIsClang()) {
+        output = readFile(ddiPath);
+        DeleteFileA(ddiPath.c_str());
+        DeleteFileA((ddiPath + ".d").c_str());
+        DeleteFileA((objFile + ".scan.ii").c_str());
+    }
+    
+    // {"rules": [{"provides": [{"logical-name": "net"}], "requires": [{"logical-name": "core"}]}]}
+    JsonValue json;
+    if (!scanned || !parseJson(output, json)) return false;
+    const JsonValue* rules = json.get("rules");
+    if (!rules || rules->type != JsonValue::Array) return false;
+    for (const auto& rule : rules->array) {
+        const JsonValue* provides = rule.get("provides");
+        if (provides && provides->type == JsonValue::Array) {
+            for (const auto& module : provides->array) scan.provides = module.getString("logical-name");
+        }
+        const JsonValue* required = rule.get("requires");
+        if (required && required->type == JsonValue::Array) {
+            for (const auto& module : required->array) {
+                // Header units ("source-path" only) aren't supported
+                if (!module.getString("logical-name").empty() && module.get("lookup-method") == nullptr) {
+                    scan.imports.push_back(module.getString("logical-name"));
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// modules.txt: <source> \t <write time> \t <size> \t <provides> \t <imports, comma separated>
+std::map<std::string, std::pair<std::string, ModuleScan>> readModuleScans(const std::string& buildPath) {
+    std::map<std::string, std::pair<std::string, ModuleScan>> cached;
+    std::istringstream lines(readFile(buildPath + "/modules.txt"));
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::vector<std::string> fields;
+        size_t start = 0, tab;
+        while ((tab = line.find('\t', start)) != std::string::npos) {
+            fields.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+        fields.push_back(line.substr(start));
+        if (fields.size() != 5) continue;
+        ModuleScan scan;
+        scan.provides = fields[3];
+        std::istringstream imports(fields[4]);
+        std::string module;
+        while (std::getline(imports, module, ',')) {
+            if (!module.empty()) scan.imports.push_back(module);
+        }
+        cached[fields[0]] = {fields[1] + "\t" + fields[2], scan};
+    }
+    return cached;
+}
+
+// Scans the C++ sources of a package, reusing the results in modules.txt for
+// sources that didn't change. Changed sources are scanned in parallel.
+std::map<std::string, ModuleScan> scanModules(const std::string& buildPath, const std::string& flags,
+                                              const std::string& packageRoot, const std::vector<std::string>& sources) {
+    std::map<std::string, std::pair<std::string, ModuleScan>> cached = readModuleScans(buildPath);
+    
+    std::map<std::string, ModuleScan> scans;
+    std::vector<std::string> changed;
+    for (const auto& srcFile : sources) {
+        ManifestEntry entry = statEntry(srcFile);
+        auto found = cached.find(srcFile);
+        if (found != cached.end() && found->second.first == std::to_string(entry.mtime) + "\t" + std::to_string(entry.size)) {
+            scans[srcFile] = found->second.second;
+        } else {
+            changed.push_back(srcFile);
+        }
+    }
+    
+    if (!changed.empty()) {
+        std::string scanner = p1689Scanner();
+        std::vector<ModuleScan> results(changed.size());
+        std::atomic<size_t> next(0);
+        auto worker = [&]() {
+            for (size_t i = next++; i < changed.size(); i = next++) {
+                std::string objFile = objectPathFor(buildPath, changed[i], packageRoot);
+                createDirectories(objFile.substr(0, objFile.find_last_of('/')));
+                if (scanner.empty() || !scanModuleP1689(scanner, flags, changed[i], objFile, results[i])) {
+                    results[i] = scanModuleText(changed[i]);
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        int threadCount = std::min(getDefaultJobCount(), static_cast<int>(changed.size()));
+        for (int i = 0; i < threadCount; i++) threads.emplace_back(worker);
+        for (auto& thread : threads) thread.join();
+        for (size_t i = 0; i < changed.size(); i++) scans[changed[i]] = results[i];
+    }
+    
+    std::string content;
+    for (const auto& scan : scans) {
+        ManifestEntry entry = statEntry(scan.first);
+        content += scan.first + "\t" + std::to_string(entry.mtime) + "\t" + std::to_string(entry.size) + "\t" + scan.second.provides + "\t";
+        for (size_t i = 0; i < scan.second.imports.size(); i++) {
+            content += (i ? "," : "") + scan.second.imports[i];
+        }
+        content += "\n";
+    }
+    std::string cachePath = buildPath + "/modules.txt";
+    if (readFile(cachePath) != content) writeFile(cachePath, content);
+    return scans;
+}
+
+// The modules that the scanned units of a package provide. Returns false, with
+// the reason in error, if two units provide the same module.
+bool providedModules(const std::string& buildPath, const std::map<std::string, ModuleScan>& scans,
+                     std::map<std::string, ModuleInfo>& modules, std::string& error) {
+    for (const auto& scan : scans) {
+        const std::string& name = scan.second.provides;
+        if (name.empty()) continue;
+        if (modules.count(name)) {
+            error = "Module '" + name + "' is provided by both " + normalizePath(modules[name].srcFile) + " and " + normalizePath(scan.first);
+            return false;
+        }
+        modules[name] = {scan.first, bmiPathFor(buildPath, name), scan.second.imports};
+    }
+    return true;
+}
+
+// Every module a unit needs, directly or through the modules it imports
+std::vector<std::string> transitiveImports(const std::vector<std::string>& imports, const std::map<std::string, ModuleInfo>& modules) {
+    std::vector<std::string> result;
+    std::vector<std::string> pending = imports;
+    while (!pending.empty()) {
+        std::string module = pending.back();
+        pending.pop_back();
+        auto found = modules.find(module);
+        if (found == modules.end() || std::find(result.begin(), result.end(), module) != result.end()) continue;
+        result.push_back(module);
+        pending.insert(pending.end(), found->second.imports.begin(), found->second.imports.end());
+    }
+    return result;
+}
+
+// Orders the units of a package so each module comes before its importers.
+// Returns false, with the cycle in error, if modules import each other.
+bool sortByModuleImports(std::vector<std::string>& units, const std::map<std::string, ModuleScan>& scans,
+                         const std::map<std::string, ModuleInfo>& modules, std::string& error) {
+    enum Mark { Unvisited, Visiting, Visited };
+    std::map<std::string, Mark> marks;
+    std::vector<std::string> sorted;
+    std::vector<std::string> path;
+    
+    std::function<bool(const std::string&)> visit = [&](const std::string& unit) {
+        if (marks[unit] == Visited) return true;
+        if (marks[unit] == Visiting) {
+            error = "Module import cycle:";
+            for (auto it = std::find(path.begin(), path.end(), unit); it != path.end(); ++it) {
+                error += " " + normalizePath(*it) + " ->";
+            }
+            error += " " + normalizePath(unit);
+            return false;
+        }
+        marks[unit] = Visiting;
+        path.push_back(unit);
+        auto scan = scans.find(unit);
+        if (scan != scans.end()) {
+            for (const auto& module : scan->second.imports) {
+                auto provider = modules.find(module);
+                if (provider == modules.end() || !marks.count(provider->second.srcFile)) continue;  // another package's
+                if (!visit(provider->second.srcFile)) return false;
+            }
+        }
+        path.pop_back();
+        marks[unit] = Visited;
+        sorted.push_back(unit);
+        return true;
+    };
+    
+    for (const auto& unit : units) marks[unit] = Unvisited;
+    for (const auto& unit : units) {
+        if (!visit(unit)) return false;
+    }
+    units = sorted;
+    return true;
+}
+
+// Split dev linking
+//
+// With dev-link = "split" the debug build of a bin package links each
+// first-level directory of src/ into a shared library of its own, and the
+// remaining sources except main.cpp into a "core" one. The executable is
+// linked from main.cpp and those libraries, with an rpath to its own
+// directory. Editing one file then relinks one small library instead of the
+// whole program: a library's dependents are only relinked when the set of
+// symbols it defines changes. Which partition uses which is read off the
+// objects with nm; partitions that use each other are linked as one library,
+// since a Windows DLL can't be linked before the DLLs it imports from.
+
+// The partition of a source: its directory under src/, "core" for the other
+// sources, or empty for main.cpp/main.c, which stay in the executable
+std::string splitPartitionFor(const std::string& srcFile, const std::string& packageRoot) {
+    std::string path = normalizePath(srcFile);
+    if (!packageRoot.empty() && path.compare(0, packageRoot.length(), packageRoot) == 0) {
+        path = path.substr(packageRoot.length());
+    }
+    if (path.compare(0, 4, "src/") == 0) {
+        path = path.substr(4);
+    }
+    size_t slash = path.find('/');
+    if (slash != std::string::npos && path.compare(0, 3, "../") != 0) {
+        return path.substr(0, slash);
+    }
+    std::string name = getFileName(path);
+    if (name.compare(0, 5, "main.") == 0 && isSourceFile(name)) {
+        return "";
+    }
+    return "core";
+}
+
+struct ObjectSymbols {
+    std::vector<std::string> defined;    // strong definitions
+    std::vector<std::string> weak;       // inline functions, template instances, ...
+    std::vector<std::string> undefined;
+};
+
+// The global symbols of an object file, as listed by `nm -P -g`. The listing
+// is kept next to the object and only redone when the object is newer.
+bool readObjectSymbols(const std::string& objFile, ObjectSymbols& symbols, std::string& output) {
+    std::string listPath = objFile + ".nm";
+    std::string listing;
+    if (getFileTime(listPath) >= getFileTime(objFile)) {
+        listing = readFile(listPath);
+    } else {
+        if (runProcess({binutilsProgram("nm"), "-P", "-g", objFile}, listing) != 0) {
+            output += listing;
+            return false;
+        }
+        writeFile(listPath, listing);
+    }
+    
+    // "<name> <type> [<value> <size>]"; lowercase w, v and U are references, W, V, u and other capitals definitions
+    std::istringstream stream(listing);
+    std::string line;
+    while (std::getline(stream, line)) {
+        size_t space = line.find(' ');
+        if (space == std::string::npos || space + 1 >= line.length()) continue;
+        std::string name = line.substr(0, space);
+        char type = line[space + 1];
+        if (type == 'U') symbols.undefined.push_back(name);
+        else if (type == 'W' || type == 'V' || type == 'u') symbols.weak.push_back(name);
+        else if (type >= 'A' && type <= 'Z') symbols.defined.push_back(name);
+    }
+    return true;
+}
+
+// Partitions that are linked together: a single one, or a cycle of them
+struct SplitGroup {
+    std::string name;  // member names joined by '-'
+    std::vector<std::string> objectFiles;
+    std::set<std::string> exports;
+    std::vector<size_t> dependencies;  // groups it imports from, always earlier in the list
+    std::string libraryPath;
+    std::string exportHash;
+};
+
+// Groups the partitions by the symbols they use from each other. Strongly
+// connected partitions are merged (Tarjan), which yields the groups with
+// every group after the ones it depends on.
+std::vector<SplitGroup> groupPartitions(const std::map<std::string, std::vector<std::string>>& partitions,
+                                        const std::map<std::string, ObjectSymbols>& symbols) {
+    std::vector<std::string> names;
+    std::vector<std::set<std::string>> defined, weak, undefined;
+    for (const auto& partition : partitions) {
+        names.push_back(partition.first);
+        defined.emplace_back();
+        weak.emplace_back();
+        undefined.emplace_back();
+        for (const auto& obj : partition.second) {
+            const ObjectSymbols& objSymbols = symbols.at(obj);
+            defined.back().insert(objSymbols.defined.begin(), objSymbols.defined.end());
+            weak.back().insert(objSymbols.weak.begin(), objSymbols.weak.end());
+            undefined.back().insert(objSymbols.undefined.begin(), objSymbols.undefined.end());
+        }
+    }
+    
+    // Who defines each symbol, preferring a strong definition to a weak one
+    std::map<std::string, size_t> strongDefiner, weakDefiner;
+    for (size_t i = names.size(); i-- > 0;) {
+        for (const auto& name : defined[i]) strongDefiner[name] = i;
+        for (const auto& name : weak[i]) weakDefiner[name] = i;
+    }
+    std::vector<std::set<size_t>> edges(names.size());
+    for (size_t i = 0; i < names.size(); i++) {
+        for (const auto& name : undefined[i]) {
+            if (defined[i].count(name) || weak[i].count(name)) continue;
+            auto definer = strongDefiner.find(name);
+            if (definer == strongDefiner.end()) {
+                definer = weakDefiner.find(name);
+                if (definer == weakDefiner.end()) continue;  // from a library or the executable
+            }
+            if (definer->second != i) edges[i].insert(definer->second);
+        }
+    }
+    
+    std::vector<SplitGroup> groups;
+    std::vector<size_t> groupOf(names.size(), SIZE_MAX);
+    std::vector<size_t> index(names.size(), SIZE_MAX), lowLink(names.size(), 0);
+    std::vector<size_t> stack;
+    std::vector<bool> onStack(names.size(), false);
+    size_t counter = 0;
+    std::function<void(size_t)> visit = [&](size_t v) {
+        index[v] = lowLink[v] = counter++;
+        stack.push_back(v);
+        onStack[v] = true;
+        for (size_t w : edges[v]) {
+            if (index[w] == SIZE_MAX) {
+                visit(w);
+                lowLink[v] = std::min(lowLink[v], lowLink[w]);
+            } else if (onStack[w]) {
+                lowLink[v] = std::min(lowLink[v], index[w]);
+            }
+        }
+        if (lowLink[v] != index[v]) return;
+        
+        // v is the root of a component, which is complete once everything it reaches is
+        std::vector<size_t> members;
+        size_t w;
+        do {
+            w = stack.back();
+            stack.pop_back();
+            onStack[w] = false;
+            members.push_back(w);
+            groupOf[w] = groups.size();
+        } while (w != v);
+        std::sort(members.begin(), members.end());
+        
+        SplitGroup group;
+        for (size_t member : members) {
+            group.name += (group.name.empty() ? "" : "-") + names[member];
+            const std::vector<std::string>& objects = partitions.at(names[member]);
+            group.objectFiles.insert(group.objectFiles.end(), objects.begin(), objects.end());
+            group.exports.insert(defined[member].begin(), defined[member].end());
+            group.exports.insert(weak[member].begin(), weak[member].end());
+        }
+        std::set<size_t> dependencies;
+        for (size_t member : members) {
+            for (size_t target : edges[member]) {
+                if (groupOf[target] != groups.size()) dependencies.insert(groupOf[target]);
+            }
+        }
+        group.dependencies.assign(dependencies.begin(), dependencies.end());
+        
+        std::string exportList;
+        for (const auto& name : group.exports) exportList += name + "\n";
+        group.exportHash = sha256Hex(exportList);
+        groups.push_back(group);
+    };
+    for (size_t i = 0; i < names.size(); i++) {
+        if (index[i] == SIZE_MAX) visit(i);
+    }
+    return groups;
+}
+
+// Links a package's partitions and then its executable, each only when an
+// input, its command, or the exports of a library it uses changed
+int runSplitLink(const TomlConfig& config, const std::string& buildPath, const std::string& outputPath,
+                 const std::map<std::string, std::vector<std::string>>& partitions, const std::vector<std::string>& mainObjects,
+                 const std::string& resourceObj, const std::vector<std::string>& libraries, std::string& output) {
+    std::map<std::string, ObjectSymbols> symbols;
+    for (const auto& partition : partitions) {
+        for (const auto& obj : partition.second) {
+            if (!readObjectSymbols(obj, symbols[obj], output)) {
+                output += "Error: Could not read the symbols of " + obj + "\n";
+                return 1;
+            }
+        }
+    }
+    std::vector<SplitGroup> groups = groupPartitions(partitions, symbols);
+    
+    // Static libraries of dependencies go into the executable only, in full and
+    // exported from it, so every partition binds to the same copy. DLLs can't
+    // import from the executable, so on Windows each partition links them too.
+    bool isWindows = config.platform == "win";
+    std::vector<std::string> staticLibraries, sharedLibraries;
+    for (const auto& library : libraries) {
+        bool isArchive = library.size() > 4 && (library.compare(library.size() - 2, 2, ".a") == 0 ||
+                                                library.compare(library.size() - 4, 4, ".lib") == 0);
+        (isArchive ? staticLibraries : sharedLibraries).push_back(library);
+    }
+    std::string gdbIndex = (config.dev.linker.empty() ? "" : "-fuse-ld=" + config.dev.linker + " ") + "-Wl,--gdb-index";
+    bool useGdbIndex = !isWindows && config.dev.debug && toolchainSupports(gdbIndex);
+    
+    TomlConfig libraryConfig = config;
+    libraryConfig.type = "dylib";
+    std::vector<size_t> level(groups.size(), 0);
+    size_t levels = 0;
+    for (size_t i = 0; i < groups.size(); i++) {
+        groups[i].libraryPath = buildPath + "/" + getOutputFilename(config.name + "-" + groups[i].name, "dylib", config.platform);
+        for (size_t dep : groups[i].dependencies) level[i] = std::max(level[i], level[dep] + 1);
+        levels = std::max(levels, level[i] + 1);
+    }
+    
+    // Groups of one level don't use each other and link in parallel
+    std::vector<std::string> outputs(groups.size());
+    std::vector<bool> relinked(groups.size(), false);
+    std::atomic<bool> failed(false);
+    for (size_t current = 0; current < levels && !failed; current++) {
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < groups.size(); i++) {
+            if (level[i] != current) continue;
+            threads.emplace_back([&, i]() {
+                const SplitGroup& group = groups[i];
+                std::vector<std::string> linked;
+                for (size_t dep : group.dependencies) linked.push_back(groups[dep].libraryPath);
+                linked.insert(linked.end(), sharedLibraries.begin(), sharedLibraries.end());
+                if (isWindows) linked.insert(linked.end(), staticLibraries.begin(), staticLibraries.end());
+                
+                std::vector<std::string> linkCmd = linkCommand(libraryConfig, false, group.objectFiles, "", linked, group.libraryPath);
+                if (!isWindows) linkCmd.push_back("-Wl,-rpath,$ORIGIN");
+                if (useGdbIndex) linkCmd.push_back("-Wl,--gdb-index");
+                
+                // Dependencies are linked by name, so only their exports matter
+                std::string key = joinCommandLine(linkCmd);
+                for (size_t dep : group.dependencies) key += "\n" + groups[dep].exportHash;
+                std::string keyPath = group.libraryPath + ".cmd";
+                ULONGLONG libraryTime = getFileTime(group.libraryPath);
+                bool stale = libraryTime == 0 || readFile(keyPath) != key;
+                for (const auto& obj : group.objectFiles) {
+                    if (getFileTime(obj) > libraryTime) stale = true;
+                }
+                for (const auto& library : libraries) {
+                    if (getFileTime(library) > libraryTime) stale = true;
+                }
+                if (!stale) return;
+                
+                outputs[i] += "Running: " + key.substr(0, key.find('\n')) + "\n";
+                DeleteFileA(keyPath.c_str());
+                if (runProcess(linkCmd, outputs[i]) != 0) {
+                    failed = true;
+                    return;
+                }
+                writeFile(keyPath, key);
+                relinked[i] = true;
+            });
+        }
+        for (auto& thread : threads) thread.join();
+    }
+    for (const auto& groupOutput : outputs) output += groupOutput;
+    if (failed) return 1;
+    
+    // The executable lists dependents before their dependencies
+    std::vector<std::string> linked;
+    for (size_t i = groups.size(); i-- > 0;) linked.push_back(groups[i].libraryPath);
+    if (!isWindows && !staticLibraries.empty()) {
+        linked.push_back("-Wl,--whole-archive");
+        linked.insert(linked.end(), staticLibraries.begin(), staticLibraries.end());
+        linked.push_back("-Wl,--no-whole-archive");
+    } else {
+        linked.insert(linked.end(), staticLibraries.begin(), staticLibraries.end());
+    }
+    linked.insert(linked.end(), sharedLibraries.begin(), sharedLibraries.end());
+    std::vector<std::string> linkCmd = linkCommand(config, false, mainObjects, resourceObj, linked, outputPath);
+    if (!isWindows) {
+        linkCmd.insert(linkCmd.end(), {"-Wl,-rpath,$ORIGIN", "-rdynamic"});
+    }
+    if (useGdbIndex) linkCmd.push_back("-Wl,--gdb-index");
+    
+    std::string key = joinCommandLine(linkCmd);
+    for (const auto& group : groups) key += "\n" + group.exportHash;
+    std::string keyPath = buildPath + "/link.cmd";
+    ULONGLONG outputTime = getFileTime(outputPath);
+    bool stale = outputTime == 0 || readFile(keyPath) != key;
+    for (const auto& obj : mainObjects) {
+        if (getFileTime(obj) > outputTime) stale = true;
+    }
+    for (const auto& library : libraries) {
+        if (getFileTime(library) > outputTime) stale = true;
+    }
+    if (!resourceObj.empty() && getFileTime(resourceObj) > outputTime) stale = true;
+    
+    if (stale) {
+        output += "Running: " + joinCommandLine(linkCmd) + "\n";
+        DeleteFileA(keyPath.c_str());
+        if (runProcess(linkCmd, output) != 0) return 1;
+        writeFile(keyPath, key);
+    }
+    
+    size_t relinkedCount = std::count(relinked.begin(), relinked.end(), true);
+    output += "Relinked " + std::to_string(relinkedCount) + " of " + std::to_string(groups.size()) + " partition(s)" +
+              (stale ? " and the executable" : "") + "\n";
+    return 0;
+}
+
+// Workspaces
+//
+// A cclank.toml can list [workspace] members and [dependencies] on other
+// packages by path. Everything is built from the workspace root in a single
+// job graph, so independent packages compile side by side and each link
+// starts as soon as its own objects and its dependencies' libraries are done.
+// The root package builds into build/<profile>, the others into
+// build/<profile>/pkg/<name>.
+
+struct Package {
+    std::string name;
+    std::string root;  // directory relative to the workspace root: "" or "libs/core/"
+    TomlConfig config;
+    std::vector<size_t> dependencies;  // direct dependencies, as indices into the package list
+    std::string target;  // "bench/<name>" or "test/<name>" for a binary built from the package's [[bench]] or [[test]] entry,
+                         // or the x86-64 level of a target-cpus variant
+    std::string prebuilt;  // for a version or tarball dependency: what it is, e.g. "fmt 10.2.1"; built into the prebuilt cache
+    std::string tarball;   // the tarball its sources were unpacked from
+};
+
+// Appends a relative path to a directory and resolves "." and ".." in it.
+// Returns a directory prefix ending in '/', or "" for the current directory.
+std::string joinPath(const std::string& base, const std::string& path) {
+    std::string combined = normalizePath(path);
+    bool absolute = !combined.empty() && (combined[0] == '/' || (combined.length() > 1 && combined[1] == ':'));
+    if (!absolute) {
+        combined = normalizePath(base) + combined;
+    }
+    
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= combined.length()) {
+        size_t slash = combined.find('/', start);
+        if (slash == std::string::npos) slash = combined.length();
+        std::string part = combined.substr(start, slash - start);
+        start = slash + 1;
+        
+        if (part.empty() || part == ".") continue;
+        if (part == ".." && !parts.empty() && parts.back() != "..") {
+            parts.pop_back();
+        } else {
+            parts.push_back(part);
+        }
+    }
+    
+    std::string result = (!combined.empty() && combined[0] == '/') ? "/" : "";
+    for (const auto& part : parts) {
+        result += part + "/";
+    }
+    return result;
+}
+
+// Makes a member's paths relative to the workspace root instead of its own directory
+void rebaseConfig(TomlConfig& config, const std::string& root) {
+    if (root.empty()) return;
+    
+    if (config.sourceInclude.empty()) {
+        config.sourceInclude.push_back("src/**");
+    }
+    for (auto& pattern : config.sourceInclude) pattern = root + pattern;
+    for (auto& pattern : config.sourceExclude) pattern = root + pattern;
+    
+    if (!config.pch.empty() && config.pch != "auto") {
+        config.pch = root + config.pch;
+    }
+    config.icon = root + config.icon;
+    
+    // Bare file names in unity-exclude match anywhere, so only paths are rebased
+    for (TomlConfig::Profile* profile : {&config.dev, &config.release}) {
+        for (auto& excluded : profile->unityExclude) {
+            if (excluded.find('/') != std::string::npos) excluded = root + excluded;
+        }
+    }
+}
+
+// Prebuilt dependencies
+//
+// A dependency given by version comes from the local registry, a directory
+// holding <name>-<version>/ package directories or <name>-<version>.tar.gz
+// tarballs; one given by tarball is a .tar.gz in the project. Tarballs are
+// unpacked once into the cache. Such packages are built into the cache as
+// well, once per version, compile flags and compiler, so every project using
+// the same build of a library links it without compiling it again.
+
+std::string getRegistryDirectory() {
+    std::string dir = getEnvironmentVariable("CCLANK_REGISTRY");
+    if (!dir.empty()) return dir;
+    
+    std::string localAppData = getEnvironmentVariable("LOCALAPPDATA");
+    if (!localAppData.empty()) return localAppData + "\\cclank\\registry";
+    
+    return getEnvironmentVariable("USERPROFILE") + "\\.cclank\\registry";
+}
+
+// Unpacks a tarball into the cache, unless an earlier build already did.
+// A single top-level directory in the tarball (other than src/) becomes the package root.
+bool extractTarball(const std::string& tarball, const std::string& directory, std::string& error) {
+    if (fileExists(directory + "/.cclank-extracted")) return true;
+    
+    std::string tempDir = directory + ".tmp";
+    removeDirectoryTree(tempDir);
+    if (!createDirectories(tempDir)) {
+        error = "Could not create " + tempDir;
+        return false;
+    }
+    
+    std::cout << "Extracting " << tarball << "..." << std::endl;
+    std::string output;
+    if (runProcess({"tar", "-xf", tarball, "-C", tempDir}, output) != 0) {
+        removeDirectoryTree(tempDir);
+        error = "Could not extract " + tarball + (output.empty() ? "" : ":\n" + output);
+        return false;
+    }
+    
+    std::string root = tempDir;
+    std::vector<std::string> entries = listDirectory(tempDir);
+    if (entries.size() == 1 && entries[0] != "src" && directoryExists(tempDir + "/" + entries[0])) {
+        root = tempDir + "/" + entries[0];
+    }
+    removeDirectoryTree(directory);
+    if (!MoveFileExA(root.c_str(), directory.c_str(), 0)) {
+        removeDirectoryTree(tempDir);
+        error = "Could not move " + tarball + " into " + directory;
+        return false;
+    }
+    removeDirectoryTree(tempDir);
+    writeFile(directory + "/.cclank-extracted", tarball + "\n");
+    return true;
+}
+
+// Finds the sources of a version or tarball dependency of the package in root.
+// identity names what was built, for the prebuilt cache key.
+bool resolvePrebuiltDependency(const TomlConfig::Dependency& dependency, const std::string& root,
+                               std::string& sourceRoot, std::string& identity, std::string& tarball, std::string& error) {
+    if (!dependency.version.empty()) {
+        std::string registry = joinPath("", getRegistryDirectory());
+        std::string entry = registry + dependency.name + "-" + dependency.version;
+        identity = dependency.name + " " + dependency.version;
+        if (directoryExists(entry)) {
+            sourceRoot = entry + "/";
+            return true;
+        }
+        for (const char* extension : {".tar.gz", ".tgz", ".tar.xz", ".tar"}) {
+            if (fileExists(entry + extension)) tarball = entry + extension;
+        }
+        if (tarball.empty()) {
+            error = "Dependency '" + dependency.name + "' " + dependency.version + " is not in the registry (" +
+                    registry + "), expected " + entry + "/ or " + entry + ".tar.gz";
+            return false;
+        }
+    } else {
+        tarball = normalizePath(root + dependency.tarball);
+        if (!fileExists(tarball)) {
+            error = "Dependency '" + dependency.name + "': " + tarball + " not found";
+            return false;
+        }
+        identity = dependency.name + " " + sha256Hex(readFile(tarball));
+    }
+    
+    std::string directory = joinPath("", getCacheDirectory()) + "sources/" + dependency.name + "-" + sha256Hex(identity).substr(0, 16);
+    if (!extractTarball(tarball, directory, error)) return false;
+    sourceRoot = directory + "/";
+    return true;
+}
+
+// A registry package without a cclank.toml is a static library of its sources
+TomlConfig defaultPrebuiltConfig(const std::string& name, const std::string& root) {
+    TomlConfig config = defaultConfig();
+    config.name = name;
+    config.type = "lib";
+    config.platform = getHostPlatform();
+    config.sourceInclude.push_back(directoryExists(root + "src") ? "src/**" : "**");
+    return config;
+}
+
+// Loads the package in root and, first, the packages it depends on, so the list
+// stays in dependency order. Returns the package's index, or -1 on error.
+// prebuilt is the identity of a version or tarball dependency.
+int loadPackage(std::vector<Package>& packages, const std::string& root, std::vector<std::string>& loading,
+                const std::string& prebuilt = "") {
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (packages[i].root == root) return static_cast<int>(i);
+    }
+    
+    if (std::find(loading.begin(), loading.end(), root) != loading.end()) {
+        std::cerr << "Error: Dependency cycle through package in '" << (root.empty() ? "." : root) << "'" << std::endl;
+        return -1;
+    }
+    
+    std::string tomlPath = root + "cclank.toml";
+    if (!fileExists(tomlPath) && prebuilt.empty()) {
+        std::cerr << "Error: " << tomlPath << " not found" << std::endl;
+        return -1;
+    }
+    
+    Package package;
+    package.root = root;
+    package.config = fileExists(tomlPath) ? parseToml(tomlPath) : defaultPrebuiltConfig(prebuilt.substr(0, prebuilt.find(' ')), root);
+    package.name = package.config.name;
+    package.prebuilt = prebuilt;
+    rebaseConfig(package.config, root);
+    
+    loading.push_back(root);
+    for (const auto& dependency : package.config.dependencies) {
+        int index;
+        if (dependency.path.empty()) {
+            std::string sourceRoot, identity, tarball, error;
+            if (!resolvePrebuiltDependency(dependency, root, sourceRoot, identity, tarball, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return -1;
+            }
+            index = loadPackage(packages, sourceRoot, loading, identity);
+            if (index >= 0) packages[index].tarball = tarball;
+        } else {
+            index = loadPackage(packages, joinPath(root, dependency.path), loading, prebuilt.empty() ? "" : dependency.name + " " + prebuilt);
+        }
+        if (index < 0) return -1;
+        
+        // A prebuilt package is built against its dependencies, so it is keyed by them too
+        if (!package.prebuilt.empty()) package.prebuilt += "\n" + packages[index].prebuilt;
+        
+        if (packages[index].name != dependency.name) {
+            std::cerr << "Warning: Dependency '" << dependency.name << "' of " << package.name
+                      << " is a package named '" << packages[index].name << "'" << std::endl;
+        }
+        package.dependencies.push_back(static_cast<size_t>(index));
+    }
+    loading.pop_back();
+    
+    // Names pick the build directory, so they must be unique
+    for (const auto& other : packages) {
+        if (other.name == package.name) {
+            std::cerr << "Error: Two packages are named '" << package.name << "' ("
+                      << (other.root.empty() ? "." : other.root) << " and " << (root.empty() ? "." : root) << ")" << std::endl;
+            return -1;
+        }
+    }
+    
+    packages.push_back(package);
+    return static_cast<int>(packages.size() - 1);
+}
+
+// Loads the package in the current directory, or every member of its workspace
+bool loadWorkspace(std::vector<Package>& packages) {
+    if (!fileExists("cclank.toml")) {
+        std::cerr << "Error: cclank.toml not found. Are you in a cclank project directory?" << std::endl;
+        return false;
+    }
+    
+    TomlConfig rootConfig = parseToml("cclank.toml");
+    std::vector<std::string> loading;
+    
+    for (const auto& member : rootConfig.workspaceMembers) {
+        if (loadPackage(packages, joinPath("", member), loading) < 0) return false;
+    }
+    
+    // A workspace root is a package too if it has a [package] section
+    if (rootConfig.hasPackage || rootConfig.workspaceMembers.empty()) {
+        if (loadPackage(packages, "", loading) < 0) return false;
+    }
+    return true;
+}
+
+// Checks the --build-profile against the workspace root and makes the build
+// follow the profile at the root of its chain. run --profile=perf builds the
+// profiling profile unless another one is chosen.
+bool selectBuildProfile(BuildOptions& options) {
+    if (options.profile.empty() && !options.profiler.empty()) {
+        options.profile = "profiling";
+    }
+    if (options.profile.empty()) return true;
+    
+    TomlConfig::Profile profile;
+    std::string error;
+    if (!resolveProfile(parseToml("cclank.toml"), options.profile, profile, options.isRelease, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    if (options.profile == "dev" || options.profile == "release") {
+        options.profile.clear();
+    }
+    return true;
+}
+
+// Puts the selected custom profile in place of each package's dev or release
+// settings. A member without that profile keeps its own dev or release one.
+void applyBuildProfile(std::vector<Package>& packages, const BuildOptions& options) {
+    for (auto& package : packages) {
+        TomlConfig::Profile& selected = options.isRelease ? package.config.release : package.config.dev;
+        TomlConfig::Profile profile;
+        bool isRelease = false;
+        std::string error;
+        if (!options.profile.empty() && resolveProfile(package.config, options.profile, profile, isRelease, error)) {
+            selected = profile;
+        }
+        if (options.noLto) selected.lto = "off";
+    }
+}
+
+// When started inside a workspace member, moves to the workspace root so every
+// package is always built with the same paths, and selects that member
+bool enterWorkspaceRoot(BuildOptions& options) {
+    if (!fileExists("cclank.toml") || !parseToml("cclank.toml").workspaceMembers.empty()) {
+        return true;
+    }
+    
+    char cwd[MAX_PATH];
+    if (!GetCurrentDirectoryA(MAX_PATH, cwd)) return true;
+    std::string current = joinPath("", cwd);
+    
+    std::string dir = current;
+    while (dir.length() > 1) {
+        // Up one directory: "C:/a/b/" -> "C:/a/"
+        size_t slash = dir.find_last_of('/', dir.length() - 2);
+        if (slash == std::string::npos) break;
+        dir = dir.substr(0, slash + 1);
+        
+        if (!fileExists(dir + "cclank.toml")) continue;
+        
+        for (const auto& member : parseToml(dir + "cclank.toml").workspaceMembers) {
+            if (_stricmp(joinPath(dir, member).c_str(), current.c_str()) != 0) continue;
+            
+            if (options.package.empty()) {
+                options.package = parseToml("cclank.toml").name;
+            }
+            std::cout << "Using workspace at " << dir << std::endl;
+            if (!SetCurrentDirectoryA(dir.c_str())) {
+                std::cerr << "Error: Could not enter " << dir << std::endl;
+                return false;
+            }
+            return true;
+        }
+        return true;  // the nearest cclank.toml above doesn't include this package
+    }
+    return true;
+}
+
+// build/<profile>, or the separate directory of a PGO instrumented build
+std::string profileBuildPath(const BuildOptions& options) {
+    if (!options.profile.empty()) {
+        return "build/" + options.profile + options.buildSuffix;
+    }
+    return std::string("build/") + (options.isRelease ? "release" : "debug") + options.buildSuffix;
+}
+
+// A prebuilt package builds into the cache, in a directory named by everything
+// that decides what the build produces
+std::string prebuiltBuildPath(const Package& package, const BuildOptions& options) {
+    static const std::string tools = toolIdentity(toolchain().cxx) + "\n" + toolIdentity(toolchain().cc) + "\n" + toolIdentity(binutilsProgram("ar"));
+    const TomlConfig& config = package.config;
+    const TomlConfig::Profile& profile = options.isRelease ? config.release : config.dev;
+    std::string key = package.prebuilt + "\n" + readFile(package.root + "cclank.toml") + "\n" + compileFlags(config, options.isRelease) +
+                      "\n" + ltoFlags(profile, true) + "\n" + getCompilerVersion() + "\n" + tools;
+    return joinPath("", getCacheDirectory()) + "prebuilt/" + package.name + "-" + sha256Hex(key).substr(0, 16);
+}
+
+std::string packageBuildPath(const Package& package, const BuildOptions& options) {
+    if (!package.prebuilt.empty()) return prebuiltBuildPath(package, options);
+    std::string buildPath = profileBuildPath(options);
+    if (!package.root.empty()) buildPath += "/pkg/" + package.name;
+    if (!package.target.empty()) buildPath += "/" + package.target;
+    return buildPath;
+}
+
+std::string packageOutputPath(const Package& package, const BuildOptions& options) {
+    const TomlConfig& config = package.config;
+    return packageBuildPath(package, options) + "/" + getOutputFilename(config.name, config.type, config.platform);
+}
+
+std::string packageIndexPath(const Package& package) {
+    if (!package.target.empty()) {
+        std::string target = package.target;
+        std::replace(target.begin(), target.end(), '/', '-');
+        return "build/.cclank-index-" + package.name + "-" + target;
+    }
+    return package.root.empty() ? "build/.cclank-index" : "build/.cclank-index-" + package.name;
+}
+
+bool isDynamicLibrary(const TomlConfig& config) {
+    return config.type == "dylib" || config.type == "dll" || config.type == "so";
+}
+
+// Every package index reachable through dependencies, in dependency order
+std::vector<size_t> transitiveDependencies(const std::vector<Package>& packages, size_t index) {
+    std::vector<bool> reached(packages.size(), false);
+    std::vector<size_t> stack = packages[index].dependencies;
+    while (!stack.empty()) {
+        size_t next = stack.back();
+        stack.pop_back();
+        if (reached[next]) continue;
+        reached[next] = true;
+        stack.insert(stack.end(), packages[next].dependencies.begin(), packages[next].dependencies.end());
+    }
+    
+    // Packages are loaded dependencies first, so index order is dependency order
+    std::vector<size_t> result;
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (reached[i]) result.push_back(i);
+    }
+    return result;
+}
+
+// The packages to build: all of them, or the one named by -p and its dependencies
+bool selectPackages(const std::vector<Package>& packages, const std::string& name, std::vector<bool>& selected) {
+    selected.assign(packages.size(), name.empty());
+    if (name.empty()) return true;
+    
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (packages[i].name != name) continue;
+        selected[i] = true;
+        for (size_t dep : transitiveDependencies(packages, i)) {
+            selected[dep] = true;
+        }
+        return true;
+    }
+    
+    std::cerr << "Error: No package named '" << name << "' in this workspace" << std::endl;
+    return false;
+}
+
+// The binary package that run and watch --run start: the one named by -p, the
+// root package, or the workspace's only binary. Returns -1 if there is none.
+int findRunPackage(const std::vector<Package>& packages, const std::string& name) {
+    std::vector<size_t> binaries;
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (!name.empty() ? packages[i].name == name : packages[i].root.empty()) return static_cast<int>(i);
+        if (packages[i].config.type == "bin") binaries.push_back(i);
+    }
+    
+    if (!name.empty()) {
+        std::cerr << "Error: No package named '" << name << "' in this workspace" << std::endl;
+        return -1;
+    }
+    if (binaries.size() == 1) {
+        return static_cast<int>(binaries[0]);
+    }
+    
+    std::cerr << "Error: The workspace has " << binaries.size() << " binaries, choose one with -p <name>:" << std::endl;
+    for (size_t index : binaries) {
+        std::cerr << "  " << packages[index].name << std::endl;
+    }
+    return -1;
+}
+
+// A package's [[bench]] or [[test]] entries. Every file directly in tests/
+// that no [[test]] names is a test of its own, named after the file.
+std::vector<TomlConfig::Target> packageTargets(const Package& package, const std::string& kind) {
+    if (kind == "bench") return package.config.benches;
+    
+    std::vector<TomlConfig::Target> tests = package.config.tests;
+    for (const auto& name : listDirectory(package.root + "tests")) {
+        std::string path = "tests/" + name;
+        if (!isSourceFile(name) || !fileExists(package.root + path)) continue;
+        
+        bool listed = false;
+        for (const auto& test : package.config.tests) {
+            if (normalizePath(test.path) == path) listed = true;
+        }
+        if (!listed) {
+            TomlConfig::Target test;
+            test.name = name.substr(0, name.find_last_of('.'));
+            test.path = path;
+            tests.push_back(test);
+        }
+    }
+    return tests;
+}
+
+// Adds a binary package for each bench or test with a path in the selected
+// packages, built from the target's sources and linked with the package. For a
+// binary package, its sources except src/main.cpp are compiled once into an
+// internal static library (<kind>-lib) that every bench or test links.
+// Returns false if two of a package's targets have the same name.
+bool addTargetPackages(std::vector<Package>& packages, std::vector<bool>& selected, const std::string& kind) {
+    size_t count = packages.size();
+    for (size_t i = 0; i < count; i++) {
+        if (!selected[i] || !packages[i].target.empty()) continue;
+        
+        std::vector<TomlConfig::Target> entries = packageTargets(packages[i], kind);
+        std::map<std::string, std::string> paths;
+        for (const auto& entry : entries) {
+            if (paths.count(entry.name)) {
+                std::cerr << "Error: " << packages[i].name << " has two " << kind << "s named '" << entry.name << "' ("
+                          << (paths[entry.name].empty() ? "no path" : paths[entry.name]) << ", "
+                          << (entry.path.empty() ? "no path" : entry.path) << "), rename one or list it with [[" << kind << "]]" << std::endl;
+                return false;
+            }
+            paths[entry.name] = entry.path;
+        }
+        
+        // The internal library, unless the package has no sources besides main
+        size_t library = i;
+        if (packages[i].config.type == "bin" && std::any_of(entries.begin(), entries.end(), [](const TomlConfig::Target& entry) { return !entry.path.empty(); })) {
+            Package internal;
+            internal.name = packages[i].name;
+            internal.root = packages[i].root;
+            internal.target = kind + "-lib";
+            internal.dependencies = packages[i].dependencies;
+            internal.config = packages[i].config;
+            
+            TomlConfig& config = internal.config;
+            config.type = "lib";
+            config.benches.clear();
+            config.tests.clear();
+            if (config.sourceInclude.empty()) config.sourceInclude.push_back(internal.root + "src/**");
+            config.sourceExclude.push_back(internal.root + "src/main.cpp");
+            config.sourceExclude.push_back(internal.root + "src/main.c");
+            if (findSourceFiles(config, packageIndexPath(internal)).empty()) {
+                library = SIZE_MAX;
+            } else {
+                library = packages.size();
+                packages.push_back(internal);
+                selected.push_back(true);
+            }
+        }
+        
+        for (const auto& entry : entries) {
+            if (entry.path.empty()) continue;
+            
+            Package target;
+            target.name = packages[i].name;
+            target.root = packages[i].root;
+            target.target = kind + "/" + entry.name;
+            target.dependencies = packages[i].dependencies;
+            target.config = packages[i].config;
+            
+            TomlConfig& config = target.config;
+            config.name = entry.name;
+            config.type = "bin";
+            config.benches.clear();
+            config.tests.clear();
+            config.sourceInclude.clear();
+            config.sourceExclude.clear();
+            if (library != SIZE_MAX) target.dependencies.push_back(library);
+            std::string path = target.root + entry.path;
+            config.sourceInclude.push_back(directoryExists(path) ? path + "/**" : path);
+            
+            packages.push_back(target);
+            selected.push_back(true);
+        }
+    }
+    return true;
+}
+
+// A package's own include/ directory, then the headers of its dependencies:
+// their include/ directory, or src/ if they have none
+std::string packageIncludeFlags(const std::vector<Package>& packages, size_t index) {
+    std::string flags;
+    if (directoryExists(packages[index].root + "include")) {
+        flags += " " + quoteArgument("-I" + packages[index].root + "include");
+    }
+    else if (!packages[index].target.empty()) {
+        // Benches and tests include the headers of the package they belong to
+        flags += " " + quoteArgument("-I" + packages[index].root + "src");
+    }
+    for (size_t dep : transitiveDependencies(packages, index)) {
+        std::string includeDir = packages[dep].root + "include";
+        flags += " " + quoteArgument("-I" + (directoryExists(includeDir) ? includeDir : packages[dep].root + "src"));
+    }
+    return flags;
+}
+
+// What a build does for one package, filled in by planPackage
+struct PackagePlan {
+    bool upToDate = false;
+    std::string buildPath;
+    std::string outputPath;
+    size_t linkJob = SIZE_MAX;  // job that (re)creates outputPath, if any
+    
+    // Kept to write the package's manifest once the build succeeds
+    BuildManifest manifest;
+    std::vector<std::string> scannedInputs;
+    std::vector<std::string> compileUnits;
+    std::string pchFile;
+    
+    std::map<std::string, ModuleInfo> modules;  // modules its units provide, by name
+    
+    // With BuildOptions::planAll, every unit's compile job and the link, run
+    // or not, so watch mode can rerun just the ones a change affects. Units
+    // of modules depend on each other's order, so those packages can't be.
+    struct Unit {
+        std::string source;
+        std::string object;
+        Job compile;
+    };
+    std::vector<Unit> units;
+    Job link;  // no run function if the package has nothing to link
+    bool watchable = true;
+};
+
+// CPU variants (target-cpus)
+//
+// target-cpus = ["x86-64-v2", "x86-64-v3"] builds a binary once per x86-64
+// microarchitecture level, each into build/<profile>/<level>/ together with
+// its own copy of every library it links, so the jobs of all levels share one
+// build. The binary's usual output path gets a small launcher that checks the
+// CPU with cpuid and runs the best level it supports; setting
+// CCLANK_TARGET_CPU picks a level by hand.
+
+// 1 to 4 for x86-64 and x86-64-v2 to v4; 0 for anything else
+int cpuLevel(const std::string& cpu) {
+    if (cpu == "x86-64") return 1;
+    if (cpu == "x86-64-v2") return 2;
+    if (cpu == "x86-64-v3") return 3;
+    if (cpu == "x86-64-v4") return 4;
+    return 0;
+}
+
+// Adds a copy of each selected binary with target-cpus, and of the libraries
+// it links, for every level it lists. Libraries shared by several binaries are
+// copied once per level.
+void addCpuVariantPackages(std::vector<Package>& packages, std::vector<bool>& selected, bool isRelease) {
+    std::map<std::pair<size_t, std::string>, size_t> variants;  // (package, level) -> its copy
+    size_t count = packages.size();
+    for (size_t i = 0; i < count; i++) {
+        const TomlConfig::Profile& profile = isRelease ? packages[i].config.release : packages[i].config.dev;
+        if (!selected[i] || !packages[i].target.empty() || packages[i].config.type != "bin" || profile.targetCpus.empty()) {
+            continue;
+        }
+        std::vector<std::string> cpus = profile.targetCpus;
+        std::vector<size_t> closure = transitiveDependencies(packages, i);
+        closure.push_back(i);
+        
+        for (const auto& cpu : cpus) {
+            for (size_t original : closure) {
+                if (variants.count({original, cpu})) continue;
+                
+                Package variant = packages[original];
+                variant.target = cpu;
+                for (auto& dep : variant.dependencies) {
+                    dep = variants[{dep, cpu}];
+                }
+                TomlConfig::Profile& variantProfile = isRelease ? variant.config.release : variant.config.dev;
+                variantProfile.targetCpu = cpu;
+                variantProfile.targetCpus.clear();
+                
+                variants[{original, cpu}] = packages.size();
+                packages.push_back(variant);
+                selected.push_back(true);
+            }
+        }
+    }
+}
+
+// Once every package is added: makes each launcher depend on its levels rather
+// than the libraries it was declared with, and deselects those libraries when
+// no other selected package links them, since no build would use them
+void linkCpuLaunchers(std::vector<Package>& packages, std::vector<bool>& selected, bool isRelease) {
+    std::set<size_t> originals;
+    for (size_t i = 0; i < packages.size(); i++) {
+        const TomlConfig::Profile& profile = isRelease ? packages[i].config.release : packages[i].config.dev;
+        if (!selected[i] || !packages[i].target.empty() || packages[i].config.type != "bin" || profile.targetCpus.empty()) {
+            continue;
+        }
+        for (size_t dep : transitiveDependencies(packages, i)) {
+            originals.insert(dep);
+        }
+        packages[i].dependencies.clear();
+        for (size_t v = i + 1; v < packages.size(); v++) {
+            if (packages[v].name == packages[i].name && packages[v].root == packages[i].root && cpuLevel(packages[v].target) > 0) {
+                packages[i].dependencies.push_back(v);
+            }
+        }
+    }
+    
+    // Dependents come after their dependencies, so a library freed up by the one after it is seen too
+    for (auto it = originals.rbegin(); it != originals.rend(); ++it) {
+        bool linked = false;
+        for (size_t k = 0; k < packages.size(); k++) {
+            if (selected[k] && std::find(packages[k].dependencies.begin(), packages[k].dependencies.end(), *it) != packages[k].dependencies.end()) {
+                linked = true;
+            }
+        }
+        if (!linked) selected[*it] = false;
+    }
+}
+
+// C source of the launcher, trying the levels from the highest down
+std::string cpuLauncherSource(const TomlConfig& config, std::vector<std::string> cpus) {
+    std::sort(cpus.begin(), cpus.end(), [](const std::string& a, const std::string& b) {
+        return cpuLevel(a) > cpuLevel(b);
+    });
+    std::string filename = getOutputFilename(config.name, config.type, config.platform);
+    std::string variants;
+    for (const auto& cpu : cpus) {
+        variants += "    {" + std::to_string(cpuLevel(cpu)) + ", \"" + cpu + "\", \"" + cpu + "/" + filename + "\"},\n";
+    }
+    
+    return std::string(R"(/* Generated by cclank: runs the build of this program for the best
+   x86-64 level this CPU supports. */
+#include <cpuid.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+static const struct { int level; const char* cpu; const char* path; } variants[] = {
+)") + variants + R"(};
+static const int variantCount = sizeof(variants) / sizeof(variants[0]);
+
+/* 1 for baseline x86-64, 2 to 4 for x86-64-v2 to v4 */
+static int supportedLevel(void) {
+    unsigned a, b, c, d, ecx1, ebx7 = 0, extEcx = 0;
+    unsigned long long xcr0 = 0;
+    if (!__get_cpuid(1, &a, &b, &ecx1, &d)) return 1;
+    if (__get_cpuid(0x80000001, &a, &b, &c, &d)) extEcx = c;
+    if (__get_cpuid_max(0, 0) >= 7) __cpuid_count(7, 0, a, ebx7, c, d);
+    if (ecx1 & (1u << 27)) {  /* OSXSAVE: the OS saves the registers xgetbv reports */
+        unsigned lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = ((unsigned long long)hi << 32) | lo;
+    }
+
+    /* SSE3, SSSE3, SSE4.1, SSE4.2, POPCNT, CMPXCHG16B, LAHF */
+    unsigned v2 = (1u << 0) | (1u << 9) | (1u << 19) | (1u << 20) | (1u << 23) | (1u << 13);
+    if ((ecx1 & v2) != v2 || !(extEcx & 1u)) return 1;
+
+    /* AVX, FMA, F16C, MOVBE with YMM state; AVX2, BMI1, BMI2; LZCNT */
+    unsigned v3 = (1u << 28) | (1u << 12) | (1u << 29) | (1u << 22);
+    unsigned v3Leaf7 = (1u << 5) | (1u << 3) | (1u << 8);
+    if ((ecx1 & v3) != v3 || (xcr0 & 0x6) != 0x6 || (ebx7 & v3Leaf7) != v3Leaf7 || !(extEcx & (1u << 5))) return 2;
+
+    /* AVX512F, DQ, CD, BW, VL with ZMM state */
+    unsigned v4Leaf7 = (1u << 16) | (1u << 17) | (1u << 28) | (1u << 30) | (1u << 31);
+    if ((xcr0 & 0xe6) != 0xe6 || (ebx7 & v4Leaf7) != v4Leaf7) return 3;
+    return 4;
+}
+
+/* Directory of this executable, with a trailing separator */
+static int launcherDirectory(char* dir, size_t size) {
+#if defined(_WIN32)
+    DWORD length = GetModuleFileNameA(NULL, dir, (DWORD)size);
+    if (length == 0 || length >= size) return 0;
+#elif defined(__APPLE__)
+    uint32_t length = (uint32_t)size;
+    if (_NSGetExecutablePath(dir, &length) != 0) return 0;
+#else
+    ssize_t length = readlink("/proc/self/exe", dir, size - 1);
+    if (length <= 0) return 0;
+    dir[length] = '\0';
+#endif
+    char* slash = strrchr(dir, '/');
+#ifdef _WIN32
+    char* backslash = strrchr(dir, '\\');
+    if (!slash || (backslash && backslash > slash)) slash = backslash;
+#endif
+    if (!slash) return 0;
+    slash[1] = '\0';
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    int chosen = variantCount - 1;
+    const char* forced = getenv("CCLANK_TARGET_CPU");
+    int level = supportedLevel();
+    for (int i = 0; i < variantCount; i++) {
+        if (forced && *forced ? strcmp(variants[i].cpu, forced) == 0 : variants[i].level <= level) {
+            chosen = i;
+            break;
+        }
+    }
+
+    char path[4096];
+    if (!launcherDirectory(path, sizeof(path)) || strlen(path) + strlen(variants[chosen].path) >= sizeof(path)) {
+        fprintf(stderr, "Error: Could not find the directory of %s\n", argv[0]);
+        return 127;
+    }
+    strcat(path, variants[chosen].path);
+
+#ifdef _WIN32
+    /* The program's arguments are the rest of this command line */
+    const char* args = GetCommandLineA();
+    if (*args == '"') {
+        args++;
+        while (*args && *args != '"') args++;
+        if (*args) args++;
+    } else {
+        while (*args && *args != ' ' && *args != '\t') args++;
+    }
+    char* commandLine = (char*)malloc(strlen(path) + strlen(args) + 3);
+    sprintf(commandLine, "\"%s\"%s", path, args);
+
+    STARTUPINFOA startup;
+    PROCESS_INFORMATION process;
+    memset(&startup, 0, sizeof(startup));
+    startup.cb = sizeof(startup);
+    if (!CreateProcessA(path, commandLine, NULL, NULL, TRUE, 0, NULL, NULL, &startup, &process)) {
+        fprintf(stderr, "Error: Could not start %s\n", path);
+        return 127;
+    }
+    SetConsoleCtrlHandler(NULL, TRUE);  /* Ctrl+C is the program's to handle */
+    WaitForSingleObject(process.hProcess, INFINITE);
+    DWORD exitCode = 1;
+    GetExitCodeProcess(process.hProcess, &exitCode);
+    return (int)exitCode;
+#else
+    execv(path, argv);
+    fprintf(stderr, "Error: Could not start %s\n", path);
+    return 127;
+#endif
+}
+)";
+}
+
+// Plans the launcher that takes a target-cpus binary's place. It is built with
+// the compiler's defaults, so it runs on any x86-64 CPU.
+bool planCpuLauncher(const Package& package, const TomlConfig::Profile& profile, PackagePlan& plan, std::vector<Job>& jobs) {
+    const TomlConfig& config = package.config;
+    for (const auto& cpu : profile.targetCpus) {
+        if (cpuLevel(cpu) == 0) {
+            std::cerr << "Error: target-cpus only takes x86-64 levels (x86-64, x86-64-v2, x86-64-v3, x86-64-v4), not \""
+                      << cpu << "\"" << std::endl;
+            return false;
+        }
+    }
+    
+    std::string buildPath = plan.buildPath;
+    if (!createDirectories(buildPath)) {
+        std::cerr << "Error: Could not create " << buildPath << " directory" << std::endl;
+        return false;
+    }
+    std::cout << "Building " << config.name << " launcher for";
+    for (const auto& cpu : profile.targetCpus) {
+        std::cout << " " << cpu;
+    }
+    std::cout << std::endl;
+    
+    // Rewrite the source only when the levels changed so its timestamp stays stable
+    std::string sourcePath = buildPath + "/cpu-launcher.c";
+    std::string source = cpuLauncherSource(config, profile.targetCpus);
+    if (readFile(sourcePath) != source) {
+        writeFile(sourcePath, source);
+    }
+    
+    std::string outputPath = plan.outputPath;
+    std::string linkCmdPath = buildPath + "/link.cmd";
+    std::vector<std::string> linkCmd = {toolchain().cc, "-O2", sourcePath, "-o", outputPath};
+    std::string linkCmdLine = joinCommandLine(linkCmd);
+    plan.manifest.commands.push_back(linkCmdLine);
+    
+    ULONGLONG outputTime = getFileTime(outputPath);
+    if (outputTime != 0 && getFileTime(sourcePath) <= outputTime && readFile(linkCmdPath) == linkCmdLine) {
+        return true;
+    }
+    Job link = {outputPath, [outputPath, linkCmdPath, linkCmd, linkCmdLine](std::string& output) {
+        output += "Running: " + linkCmdLine + "\n";
+        DeleteFileA(linkCmdPath.c_str());
+        int result = runProcess(linkCmd, output);
+        if (result != 0) return result;
+        writeFile(linkCmdPath, linkCmdLine);
+        return 0;
+    }};
+    link.action = "Linking";
+    plan.link = link;
+    plan.linkJob = jobs.size();
+    jobs.push_back(link);
+    return true;
+}
+
+// Adds the jobs that bring one package up to date. Dependencies must have
+// been planned already, since its link waits for theirs.
+bool planPackage(const BuildOptions& options, const std::vector<Package>& packages, size_t index,
+                 std::vector<PackagePlan>& plans, std::vector<Job>& jobs, ObjectCache& cache, CompileExecutor& executor) {
+    const Package& package = packages[index];
+    const TomlConfig& config = package.config;
+    PackagePlan& plan = plans[index];
+    bool isRelease = options.isRelease;
+    std::string profileName = !options.profile.empty() ? options.profile : isRelease ? "release" : "debug";
+    
+    plan.buildPath = packageBuildPath(package, options);
+    plan.outputPath = packageOutputPath(package, options);
+    std::string buildPath = plan.buildPath;
+    
+    // Nothing to do if no input changed since the last successful build
+    std::vector<size_t> dependencies = transitiveDependencies(packages, index);
+    plan.manifest.configHash = buildConfigHash(package.root + "cclank.toml", options);
+    if (!package.prebuilt.empty()) {
+        // The build directory is already named by its configuration, which the profile and PGO don't touch
+        plan.manifest.configHash = sha256Hex("prebuilt\n" + buildPath);
+    }
+    bool dependenciesUpToDate = true;
+    for (size_t dep : dependencies) {
+        if (!plans[dep].upToDate) dependenciesUpToDate = false;
+    }
+    std::string upToDateOutput;
+    if (!options.planAll && dependenciesUpToDate && isBuildUpToDate(buildPath, plan.manifest.configHash, upToDateOutput)) {
+        // Dependents still need to know where its BMIs are
+        std::map<std::string, ModuleScan> scans;
+        for (const auto& scan : readModuleScans(buildPath)) {
+            scans[scan.first] = scan.second.second;
+        }
+        std::string error;
+        providedModules(buildPath, scans, plan.modules, error);
+        plan.upToDate = true;
+        return true;
+    }
+    DeleteFileA(manifestPathFor(buildPath).c_str());
+    
+    // With target-cpus the levels are packages of their own and this one is their launcher
+    const TomlConfig::Profile& launchedProfile = isRelease ? config.release : config.dev;
+    if (!launchedProfile.targetCpus.empty() && package.target.empty() && config.type == "bin") {
+        return planCpuLauncher(package, launchedProfile, plan, jobs);
+    }
+    
+    std::string hostPlatform = getHostPlatform();
+    
+    std::cout << "Building " << config.name << " (" << profileName << " profile, " 
+              << config.type << " for " << config.platform << ")..." << std::endl;
+    
+    // Cross-compilation warning for binaries and dynamic libraries
+    if (config.platform != hostPlatform) {
+        if (config.type == "bin") {
+            std::cerr << "\nWarning: Cross-compilation is not available for binaries!" << std::endl;
+            std::cerr << "Project platform: " << config.platform << std::endl;
+            std::cerr << "Host platform: " << hostPlatform << std::endl;
+            std::cerr << "The resulting binary will only run on " << hostPlatform << ", not " << config.platform << std::endl;
+            std::cerr << "To build for " << config.platform << ", use a " << config.platform << " system.\n" << std::endl;
+        }
+        else if (config.type == "dylib" || config.type == "dll" || config.type == "so") {
+            std::cerr << "\nWarning: Cross-compilation is not available for dynamic libraries!" << std::endl;
+            std::cerr << "Project platform: " << config.platform << std::endl;
+            std::cerr << "Host platform: " << hostPlatform << std::endl;
+            std::cerr << "The resulting library will only work on " << hostPlatform << ", not " << config.platform << std::endl;
+            std::cerr << "To build for " << config.platform << ", use a " << config.platform << " system.\n" << std::endl;
+        }
+        else if (config.type == "lib") {
+            std::cout << "\nNote: Building static library with platform set to " << config.platform << std::endl;
+            std::cout << "Static libraries (.a, .lib) may be platform-specific depending on code." << std::endl;
+            std::cout << "For true cross-platform compatibility, build on the target platform.\n" << std::endl;
+        }
+    }
+    
+    // Find all source files in src/ (or matching [build] include)
+    std::string indexPath = packageIndexPath(package);
+    std::vector<std::string> sourceFiles = findSourceFiles(config, indexPath, &plan.scannedInputs);
+    if (sourceFiles.empty()) {
+        std::cerr << "Error: No source files found in " << package.root << "src/ directory" << std::endl;
+        return false;
+    }
+    
+    std::cout << "Found " << sourceFiles.size() << " source file(s)" << std::endl;
+    
+    // Create build directories
+    if (!createDirectories(buildPath)) {
+        std::cerr << "Error: Could not create " << buildPath << " directory" << std::endl;
+        return false;
+    }
+    
+    // Generate resource file if icon exists and type is bin
+    std::string resourceObj;
+    if (config.type == "bin" && config.platform == "win") {
+        plan.scannedInputs.push_back(config.icon);  // recorded even when missing, so adding it triggers a build
+    }
+    if (config.type == "bin" && config.platform == "win" && fileExists(config.icon)) {
+        std::string rcPath = buildPath + "/resource.rc";
+        resourceObj = buildPath + "/resource.o";
+        
+        // Rewrite resource.rc only when the icon setting changed so its timestamp stays stable
+        std::string rcContent = "#include <windows.h>\nIDI_ICON1 ICON \"" + config.icon + "\"\n";
+        if (readFile(rcPath) != rcContent) {
+            writeFile(rcPath, rcContent);
+        }
+        
+        ULONGLONG resTime = getFileTime(resourceObj);
+        if (resTime == 0 || getFileTime(rcPath) > resTime || getFileTime(config.icon) > resTime) {
+            std::cout << "Compiling icon resource..." << std::endl;
+            std::vector<std::string> rcCmd = {"windres", rcPath, "-O", "coff", "-o", resourceObj};
+            std::string rcOutput;
+            int rcResult = runProcess(rcCmd, rcOutput);
+            std::cout << rcOutput;
+            if (rcResult != 0) {
+                std::cerr << "Warning: Icon resource compilation failed" << std::endl;
+                resourceObj.clear();
+            }
+        }
+    }
+    
+    // Compile every stale translation unit in parallel
+    std::string objDir = buildPath + "/obj";
+    if (!createDirectories(objDir)) {
+        std::cerr << "Error: Could not create " << objDir << " directory" << std::endl;
+        return false;
+    }
+    
+    const TomlConfig::Profile& profile = isRelease ? config.release : config.dev;
+    std::vector<std::string> objectFiles;
+    std::vector<size_t> compileJobs;
+    std::string pgoFlags = package.prebuilt.empty() ? options.pgoFlags : "";
+    std::string flags = compileFlags(config, isRelease) + pgoFlags;
+    
+    flags += packageIncludeFlags(packages, index);
+    
+    // Modules: find which units export and import which modules, if the
+    // package or one of its dependencies has module interface units
+    std::map<std::string, ModuleInfo> knownModules;
+    for (size_t dep : dependencies) {
+        knownModules.insert(plans[dep].modules.begin(), plans[dep].modules.end());
+    }
+    bool usesModules = !knownModules.empty();
+    for (const auto& srcFile : sourceFiles) {
+        if (isModuleInterfaceFile(srcFile)) usesModules = true;
+    }
+    
+    std::map<std::string, ModuleScan> moduleScans;
+    std::vector<std::string> moduleUnits;
+    std::vector<std::string> otherUnits = sourceFiles;
+    plan.watchable = !usesModules;
+    if (usesModules) {
+        std::string moduleFlag = moduleFlags(buildPath);
+        std::vector<std::string> cppFiles;
+        for (const auto& srcFile : sourceFiles) {
+            if (!isCSource(srcFile)) cppFiles.push_back(srcFile);
+        }
+        moduleScans = scanModules(buildPath, flags + moduleFlag, package.root, cppFiles);
+        
+        std::string error;
+        if (!providedModules(buildPath, moduleScans, plan.modules, error) ||
+            !createDirectories(buildPath + "/bmi/")) {
+            std::cerr << "Error: " << (error.empty() ? "Could not create " + buildPath + "/bmi" : error) << std::endl;
+            return false;
+        }
+        knownModules.insert(plan.modules.begin(), plan.modules.end());
+        
+        // Units that export or import one of the modules compile on their own, in import order
+        otherUnits.clear();
+        for (const auto& srcFile : sourceFiles) {
+            bool isModuleUnit = false;
+            auto scan = moduleScans.find(srcFile);
+            if (scan != moduleScans.end()) {
+                isModuleUnit = !scan->second.provides.empty();
+                for (const auto& module : scan->second.imports) {
+                    if (knownModules.count(module)) isModuleUnit = true;
+                }
+            }
+            (isModuleUnit ? moduleUnits : otherUnits).push_back(srcFile);
+        }
+        if (!sortByModuleImports(moduleUnits, moduleScans, plan.modules, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
+        
+        // GCC finds BMIs through a module mapper file: "<module> <BMI path>" per line
+        if (!compilerIsClang()) {
+            std::string mapper;
+            std::string cwd = currentDirectory();
+            for (const auto& module : knownModules) {
+                mapper += module.first + " " + cwd + "/" + module.second.bmiPath + "\n";
+            }
+            std::string mapperPath = buildPath + "/modules.map";
+            if (readFile(mapperPath) != mapper) writeFile(mapperPath, mapper);
+        }
+        flags += moduleFlag;
+        std::cout << "Modules: " << plan.modules.size() << " module(s), " << moduleUnits.size() << " module unit(s)" << std::endl;
+    }
+    
+    // Unity builds compile generated files that each #include a batch of sources
+    std::vector<std::string> compileUnits = otherUnits;
+    if (profile.unity) {
+        compileUnits = prepareUnityBatches(profile, buildPath, otherUnits);
+        std::cout << "Unity build: " << compileUnits.size() << " translation unit(s)" << std::endl;
+    }
+    compileUnits.insert(compileUnits.end(), moduleUnits.begin(), moduleUnits.end());
+    plan.compileUnits = compileUnits;
+    
+    std::string moduleUnitFlags = flags;  // module units can't take a forced -include of the precompiled header
+    std::string preprocessFlags = flags;
+    std::string cFlags = flags;  // C sources don't use the C++ precompiled header
+    std::string cPreprocessFlags = flags;
+    bool debugInfo = profile.debug;
+    
+    // Build the precompiled header first, if its header or flags changed
+    std::vector<std::string> cppSources;
+    for (const auto& srcFile : sourceFiles) {
+        if (!isCSource(srcFile)) cppSources.push_back(srcFile);
+    }
+    std::string pchHeader = preparePchHeader(config, buildPath, cppSources);
+    size_t pchJob = SIZE_MAX;
+    if (!pchHeader.empty()) {
+        plan.pchFile = pchOutputPath(pchHeader);
+        std::string pchFile = plan.pchFile;
+        std::vector<std::string> pchCmd = pchCommand(flags, pchHeader);
+        std::string pchCmdLine = joinCommandLine(pchCmd);
+        plan.manifest.commands.push_back(pchCmdLine);
+        
+        if (needsRecompile(pchHeader, pchFile, pchCmdLine)) {
+            pchJob = jobs.size();
+            jobs.push_back({package.root + "precompiled header", [pchFile, pchCmd, pchCmdLine](std::string& output) {
+                DeleteFileA((pchFile + ".cmd").c_str());
+                int result = runProcess(pchCmd, output);
+                if (result == 0) {
+                    writeFile(pchFile + ".cmd", pchCmdLine);
+                }
+                return result;
+            }});
+        }
+        
+        flags += pchIncludeFlags(pchHeader);
+        preprocessFlags += " -include " + quoteArgument(pchHeader);
+    }
+    
+    // Per-TU compiler timings for the --timings report
+    if (options.timeTrace && package.prebuilt.empty()) {
+        std::string timeTraceFlag = toolchainSupports("-ftime-trace") ? " -ftime-trace" : " -ftime-report";
+        flags += timeTraceFlag;
+        cFlags += timeTraceFlag;
+        moduleUnitFlags += timeTraceFlag;
+    }
+    
+    ULONGLONG pchTime = plan.pchFile.empty() ? 0 : getFileTime(plan.pchFile);
+    
+    for (const auto& srcFile : compileUnits) {
+        bool isC = isCSource(srcFile);
+        std::string objFile = objectPathFor(buildPath, srcFile, package.root);
+        
+        if (std::find(moduleUnits.begin(), moduleUnits.end(), srcFile) != moduleUnits.end()) {
+            const ModuleScan& scan = moduleScans[srcFile];
+            std::vector<std::string> imported = transitiveImports(scan.imports, knownModules);
+            std::string unitFlags = moduleUnitFlags;
+            if (compilerIsClang()) {
+                if (!scan.provides.empty()) {
+                    unitFlags += " " + quoteArgument("-fmodule-output=" + knownModules[scan.provides].bmiPath);
+                }
+                for (const auto& module : imported) {
+                    unitFlags += " " + quoteArgument("-fmodule-file=" + module + "=" + knownModules[module].bmiPath);
+                }
+            }
+            std::vector<std::string> compileCmd = compileCommand(unitFlags, srcFile, objFile);
+            std::string compileCmdLine = joinCommandLine(compileCmd);
+            objectFiles.push_back(objFile);
+            plan.manifest.commands.push_back(compileCmdLine);
+            
+            // Stale when an imported module is rebuilt in this run or its BMI is newer than the object
+            std::vector<size_t> moduleJobs;
+            bool stale = needsRecompile(srcFile, objFile, compileCmdLine) ||
+                         (!scan.provides.empty() && !fileExists(knownModules[scan.provides].bmiPath));
+            ULONGLONG objTime = getFileTime(objFile);
+            for (const auto& module : imported) {
+                const ModuleInfo& info = knownModules[module];
+                if (info.job != SIZE_MAX) moduleJobs.push_back(info.job);
+                if (info.job != SIZE_MAX || getFileTime(info.bmiPath) > objTime) stale = true;
+            }
+            if (!stale) continue;
+            
+            Job job = {normalizePath(srcFile), [objFile, compileCmd, compileCmdLine](std::string& output) {
+                DeleteFileA((objFile + ".cmd").c_str());
+                DeleteFileA(objFile.c_str());
+                createDirectories(objFile.substr(0, objFile.find_last_of('/')));
+                
+                int result = runProcess(compileCmd, output);
+                if (result == 0) {
+                    writeFile(objFile + ".cmd", compileCmdLine);
+                }
+                return result;
+            }};
+            job.dependencies = moduleJobs;
+            if (!scan.provides.empty()) {
+                knownModules[scan.provides].job = jobs.size();
+                plan.modules[scan.provides].job = jobs.size();
+            }
+            compileJobs.push_back(jobs.size());
+            jobs.push_back(job);
+            continue;
+        }
+        std::vector<std::string> compileCmd = compileCommand(isC ? cFlags : flags, srcFile, objFile);
+        std::string compileCmdLine = joinCommandLine(compileCmd);
+        objectFiles.push_back(objFile);
+        plan.manifest.commands.push_back(compileCmdLine);
+        
+        // Everything compiled against the precompiled header is stale once it is rebuilt
+        bool pchChanged = !isC && (pchJob != SIZE_MAX || pchTime > getFileTime(objFile));
+        bool stale = needsRecompile(srcFile, objFile, compileCmdLine) || pchChanged;
+        if (!stale && !options.planAll) {
+            continue;
+        }
+        
+        std::string unitPreprocessFlags = isC ? cPreprocessFlags : preprocessFlags;
+        bool useCache = config.cache;
+        Job job = {normalizePath(srcFile), [&cache, &executor, srcFile, objFile, compileCmd, compileCmdLine, unitPreprocessFlags, useCache, debugInfo](std::string& output) {
+            // Forget the old command first so an interrupted compile is retried next time.
+            // The old object is removed too, as it may be a hard link into the object cache.
+            DeleteFileA((objFile + ".cmd").c_str());
+            DeleteFileA(objFile.c_str());
+            createDirectories(objFile.substr(0, objFile.find_last_of('/')));
+            
+            int result = compileUnit(executor, useCache ? &cache : nullptr, srcFile, objFile, unitPreprocessFlags, compileCmd, debugInfo, output);
+            if (result == 0) {
+                writeFile(objFile + ".cmd", compileCmdLine);
+            }
+            return result;
+        }};
+        if (options.planAll) {
+            plan.units.push_back({srcFile, objFile, job});
+            if (!stale) continue;
+        }
+        if (pchJob != SIZE_MAX && !isC) {
+            job.dependencies.push_back(pchJob);
+        }
+        compileJobs.push_back(jobs.size());
+        jobs.push_back(job);
+    }
+    
+    // Archive or link only when an input is newer than the output, the command
+    // changed, or something it consumes is rebuilt in this run
+    std::string outputPath = plan.outputPath;
+    std::string linkCmdPath = buildPath + "/link.cmd";
+    std::vector<std::string> linkCmd;
+    std::vector<std::string> libraries;
+    std::vector<size_t> linkDependencies = compileJobs;
+    
+    if (config.type == "lib") {
+        // Static library: bundle the object files with ar
+        linkCmd = archiveCommand(config, isRelease, objectFiles, outputPath);
+    } else {
+        // Binary or dynamic library: link the object files and every library below it,
+        // dependents before their dependencies so static libraries resolve
+        for (auto dep = dependencies.rbegin(); dep != dependencies.rend(); ++dep) {
+            const TomlConfig& depConfig = packages[*dep].config;
+            if (depConfig.type != "lib" && !isDynamicLibrary(depConfig)) continue;
+            
+            libraries.push_back(plans[*dep].outputPath);
+            if (plans[*dep].linkJob != SIZE_MAX) {
+                linkDependencies.push_back(plans[*dep].linkJob);
+            }
+        }
+        linkCmd = linkCommand(config, isRelease, objectFiles, resourceObj, libraries, outputPath);
+        appendFlags(linkCmd, pgoFlags);
+    }
+    std::string linkCmdLine = joinCommandLine(linkCmd);
+    plan.manifest.commands.push_back(linkCmdLine);
+    plan.scannedInputs.insert(plan.scannedInputs.end(), libraries.begin(), libraries.end());
+    
+    ULONGLONG outputTime = getFileTime(outputPath);
+    bool needsLink = outputTime == 0 || readFile(linkCmdPath) != linkCmdLine || linkDependencies.size() > 0;
+    for (const auto& obj : objectFiles) {
+        if (getFileTime(obj) > outputTime) needsLink = true;
+    }
+    for (const auto& library : libraries) {
+        if (getFileTime(library) > outputTime) needsLink = true;
+    }
+    if (!resourceObj.empty() && getFileTime(resourceObj) > outputTime) {
+        needsLink = true;
+    }
+    
+    // A Windows exe finds the DLLs it uses in its own directory
+    std::vector<std::string> copiedLibraries;
+    if (config.type == "bin" && config.platform == "win") {
+        for (const auto& library : libraries) {
+            if (library.size() > 4 && library.compare(library.size() - 4, 4, ".dll") == 0) {
+                copiedLibraries.push_back(library);
+            }
+        }
+    }
+    
+    // Split linking decides what to relink once the objects exist
+    if (splitLinkEnabled(config, isRelease)) {
+        std::map<std::string, std::vector<std::string>> partitions;
+        std::vector<std::string> mainObjects;
+        for (const auto& srcFile : compileUnits) {
+            std::string partition = splitPartitionFor(srcFile, package.root);
+            std::string objFile = objectPathFor(buildPath, srcFile, package.root);
+            (partition.empty() ? mainObjects : partitions[partition]).push_back(objFile);
+        }
+        TomlConfig linkConfig = config;
+        Job link = {outputPath, [linkConfig, buildPath, outputPath, partitions, mainObjects, resourceObj, libraries, copiedLibraries](std::string& output) {
+            int result = runSplitLink(linkConfig, buildPath, outputPath, partitions, mainObjects, resourceObj, libraries, output);
+            if (result != 0) return result;
+            for (const auto& library : copiedLibraries) {
+                CopyFileA(library.c_str(), (buildPath + "/" + getFileName(library)).c_str(), FALSE);
+            }
+            return 0;
+        }};
+        link.action = "Linking";
+        plan.link = link;
+        link.dependencies = linkDependencies;
+        plan.linkJob = jobs.size();
+        jobs.push_back(link);
+        return true;
+    }
+    
+    
+    bool isLib = config.type == "lib";
+    Job link = {outputPath, [isLib, outputPath, linkCmdPath, linkCmd, linkCmdLine, buildPath, copiedLibraries](std::string& output) {
+        DeleteFileA(linkCmdPath.c_str());
+        int result;
+        if (isLib) {
+            result = updateArchive(linkCmd, output);
+        } else {
+            output += "Running: " + linkCmdLine + "\n";
+            result = runProcess(linkCmd, output);
+        }
+        if (result != 0) return result;
+        writeFile(linkCmdPath, linkCmdLine);
+        
+        for (const auto& library : copiedLibraries) {
+            CopyFileA(library.c_str(), (buildPath + "/" + getFileName(library)).c_str(), FALSE);
+        }
+        return 0;
+    }};
+    link.action = isLib ? "Archiving" : "Linking";
+    plan.link = link;
+    if (!needsLink) {
+        return true;
+    }
+    link.dependencies = linkDependencies;
+    plan.linkJob = jobs.size();
+    jobs.push_back(link);
+    return true;
+}
+
+// Records the manifest of a package built in this run
+void recordPackage(PackagePlan& plan, const std::string& packageRoot, ULONGLONG buildStart) {
+    std::vector<std::string> inputs = plan.scannedInputs;
+    
+    // Every file the compiler read, as listed in the depfiles
+    inputs.push_back(packageRoot + "cclank.toml");
+    for (const auto& srcFile : plan.compileUnits) {
+        inputs.push_back(srcFile);
+        for (const auto& dep : parseDepfile(depfilePathFor(objectPathFor(plan.buildPath, srcFile, packageRoot)))) {
+            inputs.push_back(dep);
+        }
+    }
+    if (!plan.pchFile.empty()) {
+        for (const auto& dep : parseDepfile(depfilePathFor(plan.pchFile))) {
+            inputs.push_back(dep);
+        }
+    }
+    recordBuild(plan.buildPath, plan.manifest, inputs, {plan.outputPath}, buildStart);
+}
+
+// No-op builds
+//
+// After a successful build, build/<profile>/workspace.bin lists the inputs of
+// every selected package, as their manifests recorded them, plus every
+// package's cclank.toml and the tarballs of dependencies. When none of them
+// changed, the next build with the same options returns before the workspace
+// is loaded, so it parses no cclank.toml and hashes no tarball.
+
+std::string workspaceManifestPath(const BuildOptions& options) {
+    return profileBuildPath(options) + "/workspace.bin";
+}
+
+// The options and tools a workspace build depends on; the rest are its inputs
+std::string workspaceConfigHash(const BuildOptions& options) {
+    std::string key = std::string("workspace\nprofile ") + (options.isRelease ? "release" : "debug") + " " + options.profile;
+    key += "\npackage " + options.package + "\ntargets " + options.targets;
+    key += std::string("\ntime-trace ") + (options.timeTrace ? "1" : "0");
+    key += "\npgo " + options.pgoFlags;
+    key += "\n" + getCacheDirectory() + "\n" + getRegistryDirectory();
+    key += "\n" + toolIdentity(toolchain().cxx) + "\n" + toolIdentity(toolchain().cc) + "\n" +
+           toolIdentity(binutilsProgram("ar")) + "\n" + toolIdentity("windres");
+    return sha256Hex(key);
+}
+
+bool isWorkspaceUpToDate(const BuildOptions& options, std::vector<std::string>& outputs) {
+    BuildManifest manifest;
+    if (!readManifest(workspaceManifestPath(options), manifest) || manifest.configHash != workspaceConfigHash(options)) {
+        return false;
+    }
+    
+    for (const auto& input : manifest.inputs) {
+        ManifestEntry current = statEntry(input.path);
+        if (current.mtime != input.mtime || current.size != input.size) return false;
+    }
+    for (const auto& output : manifest.outputs) {
+        ManifestEntry current = statEntry(output.path);
+        if (current.mtime == 0 || current.mtime != output.mtime || current.size != output.size) return false;
+        outputs.push_back(output.path);
+    }
+    return true;
+}
+
+// Writes workspace.bin once every selected package has a current manifest
+void recordWorkspace(const BuildOptions& options, const std::vector<Package>& packages, const std::vector<bool>& selected) {
+    std::string manifestPath = workspaceManifestPath(options);
+    DeleteFileA(manifestPath.c_str());
+    
+    std::set<std::string> inputs = {"cclank.toml"};
+    for (const auto& package : packages) {
+        inputs.insert(package.root + "cclank.toml");
+        if (!package.tarball.empty()) inputs.insert(package.tarball);
+    }
+    
+    BuildManifest manifest;
+    manifest.configHash = workspaceConfigHash(options);
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (!selected[i]) continue;
+        
+        // Not recorded when a source changed during the build
+        BuildManifest built;
+        if (!readManifest(manifestPathFor(packageBuildPath(packages[i], options)), built)) return;
+        for (const auto& input : built.inputs) {
+            inputs.insert(input.path);
+        }
+        for (const auto& output : built.outputs) {
+            manifest.outputs.push_back(statEntry(output.path));
+        }
+    }
+    for (const auto& input : inputs) {
+        manifest.inputs.push_back(statEntry(input));
+    }
+    writeManifest(manifestPath, manifest);
+}
+
+// The workspace a build loaded and how it planned it. watch keeps one between
+// builds, so it parses the cclank.toml files again only when one changes.
+struct BuildSession {
+    std::vector<Package> packages;  // empty until loaded
+    std::vector<bool> selected;
+    std::vector<PackagePlan> plans;
+    std::unique_ptr<RemoteExecutor> executor;
+    ObjectCache cache;
+};
+
+// Runs one build of every selected package; returns true if their outputs are up to date afterwards.
+// With a session, the workspace it loaded before is reused and the plans are kept in it.
+bool runBuild(const BuildOptions& options, BuildSession* session = nullptr) {
+    std::vector<std::string> upToDateOutputs;
+    if (!session && isWorkspaceUpToDate(options, upToDateOutputs)) {
+        std::cout << "Build is up to date" << std::endl;
+        for (const auto& output : upToDateOutputs) {
+            std::cout << "Output: " << output << std::endl;
+        }
+        return true;
+    }
+    
+    BuildSession ownSession;
+    BuildSession& build = session ? *session : ownSession;
+    std::vector<Package>& packages = build.packages;
+    std::vector<bool>& selected = build.selected;
+    if (packages.empty()) {
+        if (!loadWorkspace(packages) || !selectPackages(packages, options.package, selected)) {
+            packages.clear();
+            return false;
+        }
+        applyBuildProfile(packages, options);
+        addCpuVariantPackages(packages, selected, options.isRelease);
+        if (!options.targets.empty() && !addTargetPackages(packages, selected, options.targets)) {
+            packages.clear();
+            return false;
+        }
+        linkCpuLaunchers(packages, selected, options.isRelease);
+    }
+    
+    FILETIME startTime;
+    GetSystemTimeAsFileTime(&startTime);
+    ULONGLONG buildStart = (static_cast<ULONGLONG>(startTime.dwHighDateTime) << 32) | startTime.dwLowDateTime;
+    
+    if (!createDirectory("build")) {
+        std::cerr << "Error: Could not create build directory" << std::endl;
+        return false;
+    }
+    
+    if (!build.executor) {
+        std::vector<TomlConfig> configs;
+        for (const auto& package : packages) {
+            configs.push_back(package.config);
+        }
+        build.executor.reset(new RemoteExecutor(remoteHostsFor(configs)));
+    }
+    RemoteExecutor& executor = *build.executor;
+    
+    std::vector<PackagePlan>& plans = build.plans;
+    plans.assign(packages.size(), PackagePlan());
+    std::vector<Job> jobs;
+    ObjectCache& cache = build.cache;
+    bool upToDate = true;
+    bool useCache = false;
+    int configJobs = 0;
+    
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (!selected[i]) continue;
+        if (!planPackage(options, packages, i, plans, jobs, cache, executor)) {
+            printBuildFailed();
+            return false;
+        }
+        if (!plans[i].upToDate) upToDate = false;
+        if (packages[i].config.cache) useCache = true;
+        configJobs = std::max(configJobs, packages[i].config.jobs);
+    }
+    
+    if (upToDate) {
+        if (!session) recordWorkspace(options, packages, selected);
+        std::cout << "Build is up to date" << std::endl;
+        for (size_t i = 0; i < packages.size(); i++) {
+            if (selected[i]) std::cout << "Output: " << plans[i].outputPath << std::endl;
+        }
+        return true;
+    }
+    
+    size_t compileCount = 0;
+    for (const auto& job : jobs) {
+        if (job.action == "Compiling") compileCount++;
+    }
+    // Remote slots add to the local CPUs; whatever doesn't fit remotely compiles here
+    int jobCount = options.jobs > 0 ? options.jobs : (configJobs > 0 ? configJobs : getDefaultJobCount() + executor.slotCount());
+    
+    if (compileCount == 0) {
+        std::cout << "All object files are up to date" << std::endl;
+    } else {
+        std::cout << "Compiling " << compileCount << " file(s) with " << jobCount << " job(s)..." << std::endl;
+    }
+    
+    if (!jobs.empty()) {
+        if (useCache && compileCount > 0) {
+            openObjectCache(cache);
+        }
+        
+        bool built = runJobs(jobs, jobCount);
+        
+        if (useCache && compileCount > 0) {
+            closeObjectCache(cache);
+        }
+        if (!executor.hosts.empty() && executor.remoteCount + executor.localCount > 0) {
+            std::cout << "Remote: " << executor.remoteCount << " compiled remotely, " << executor.localCount << " locally" << std::endl;
+            executor.remoteCount = 0;
+            executor.localCount = 0;
+        }
+        
+        if (!built) {
+            printBuildFailed();
+            return false;
+        }
+    }
+    
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (selected[i] && !plans[i].upToDate) {
+            recordPackage(plans[i], packages[i].root, buildStart);
+        }
+    }
+    if (!session) recordWorkspace(options, packages, selected);
+    
+    std::cout << "Build successful!" << std::endl;
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (selected[i]) std::cout << "Output: " << plans[i].outputPath << std::endl;
+    }
+    return true;
+}
+
+// Profile-guided optimization (cclank build --pgo)
+//
+// The program is first built with instrumentation into build/<profile>-pgo,
+// then run once for each entry of the profile's pgo train list. The profile
+// those runs write is stored under build/<profile>/pgo/, named by a hash of
+// its content, and the real build compiles with -fprofile-use pointing at it.
+// Later --pgo builds reuse the stored profile until the training commands or
+// the compiler change, or more than a tenth of the sources differ from the
+// ones it was trained on.
+
+const double pgoRetrainFraction = 0.1;
+
+// Starts a program in this console and waits for it. Returns its exit code, or -1 if it couldn't start.
+int runProgram(const std::string& exePath, const std::vector<std::string>& args) {
+    std::vector<std::string> argv = {exePath};
+    argv.insert(argv.end(), args.begin(), args.end());
+    std::string commandLine = joinCommandLine(argv);
+    std::vector<char> cmdLine(commandLine.begin(), commandLine.end());
+    cmdLine.push_back('\0');
+    
+    STARTUPINFOA si = {};
+    si.cb = sizeof(si);
+    PROCESS_INFORMATION program = {};
+    if (!CreateProcessA(NULL, cmdLine.data(), NULL, NULL, FALSE, 0, NULL, NULL, &si, &program)) {
+        return -1;
+    }
+    
+    WaitForSingleObject(program.hProcess, INFINITE);
+    DWORD exitCode = 0;
+    GetExitCodeProcess(program.hProcess, &exitCode);
+    CloseHandle(program.hProcess);
+    CloseHandle(program.hThread);
+    return static_cast<int>(exitCode);
+}
+
+// What build/<profile>/pgo/state.txt records about the stored profile
+struct PgoState {
+    std::string profile;    // file or directory in build/<profile>/pgo
+    std::string trainHash;  // training commands, flags and compiler it was trained with
+    std::map<std::string, std::string> sources;  // path -> SHA-256 of the sources it was trained on
+};
+
+bool readPgoState(const std::string& path, PgoState& state) {
+    std::istringstream file(readFile(path));
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, 8, "profile ") == 0) state.profile = line.substr(8);
+        else if (line.compare(0, 6, "train ") == 0) state.trainHash = line.substr(6);
+        else if (line.compare(0, 7, "source ") == 0 && line.length() > 72) {
+            state.sources[line.substr(72)] = line.substr(7, 64);
+        }
+    }
+    return !state.profile.empty() && !state.trainHash.empty();
+}
+
+void writePgoState(const std::string& path, const PgoState& state) {
+    std::string content = "profile " + state.profile + "\ntrain " + state.trainHash + "\n";
+    for (const auto& source : state.sources) {
+        content += "source " + source.second + " " + source.first + "\n";
+    }
+    writeFile(path, content);
+}
+
+std::map<std::string, std::string> hashSources(const std::vector<Package>& packages, const std::vector<bool>& selected) {
+    std::map<std::string, std::string> sources;
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (!selected[i]) continue;
+        for (const auto& srcFile : findSourceFiles(packages[i].config, packageIndexPath(packages[i]))) {
+            sources[normalizePath(srcFile)] = sha256Hex(readFile(srcFile));
+        }
+    }
+    return sources;
+}
+
+// Sources added, removed or edited since training
+size_t countChangedSources(const std::map<std::string, std::string>& trained, const std::map<std::string, std::string>& current) {
+    size_t changed = 0;
+    for (const auto& source : current) {
+        auto match = trained.find(source.first);
+        if (match == trained.end() || match->second != source.second) changed++;
+    }
+    for (const auto& source : trained) {
+        if (!current.count(source.first)) changed++;
+    }
+    return changed;
+}
+
+// Profile flags for each phase. GCC names a .gcda file after the full path of
+// its object less -fprofile-prefix-path, so giving each build its own root
+// makes the instrumented and the final build agree on the names.
+std::string pgoGenerateFlags(const std::string& profileDir, const std::string& buildRoot) {
+    if (compilerIsClang()) {
+        return " " + quoteArgument("-fprofile-generate=" + profileDir);
+    }
+    return " " + quoteArgument("-fprofile-generate=" + profileDir) + " " + quoteArgument("-fprofile-prefix-path=" + buildRoot) +
+           " -fprofile-update=atomic";
+}
+
+// -fprofile-partial-training keeps code the training runs never reached
+// optimized as usual instead of for size. Sources edited since training only
+// get a warning for their stale profile instead of an error.
+std::string pgoUseFlags(const std::string& profile, const std::string& buildRoot) {
+    if (compilerIsClang()) {
+        return " " + quoteArgument("-fprofile-use=" + profile);
+    }
+    std::string flags = " " + quoteArgument("-fprofile-use=" + profile) + " " + quoteArgument("-fprofile-prefix-path=" + buildRoot);
+    if (toolchainSupports("-fprofile-partial-training")) flags += " -fprofile-partial-training";
+    return flags + " -Wno-error=coverage-mismatch";
+}
+
+// Moves what the training runs wrote to rawDir into pgoDir under a name
+// derived from its content, and returns that name (empty on failure)
+std::string storeProfile(const std::string& rawDir, const std::string& pgoDir) {
+    std::vector<std::string> files;
+    std::string suffix = compilerIsClang() ? ".profraw" : ".gcda";
+    for (const auto& name : listDirectory(rawDir)) {
+        if (name.length() > suffix.length() && name.compare(name.length() - suffix.length(), suffix.length(), suffix) == 0) {
+            files.push_back(name);
+        }
+    }
+    if (files.empty()) {
+        std::cerr << "Error: The training runs wrote no profile data to " << rawDir << std::endl;
+        return "";
+    }
+    createDirectories(pgoDir);
+    
+    // Clang's raw profiles are merged into one .profdata file first
+    if (compilerIsClang()) {
+        std::string merged = pgoDir + "/merged.profdata.tmp";
+        std::vector<std::string> mergeCmd = {"llvm-profdata", "merge", "-o", merged};
+        for (const auto& name : files) mergeCmd.push_back(rawDir + "/" + name);
+        std::string output;
+        int result = runProcess(mergeCmd, output);
+        std::cout << output;
+        if (result != 0) {
+            std::cerr << "Error: llvm-profdata merge failed" << std::endl;
+            return "";
+        }
+        std::string name = sha256Hex(readFile(merged)).substr(0, 16) + ".profdata";
+        MoveFileExA(merged.c_str(), (pgoDir + "/" + name).c_str(), MOVEFILE_REPLACE_EXISTING);
+        return name;
+    }
+    
+    std::string content;
+    for (const auto& name : files) {
+        content += name + '\0' + readFile(rawDir + "/" + name) + '\0';
+    }
+    std::string name = sha256Hex(content).substr(0, 16);
+    std::string profileDir = pgoDir + "/" + name;
+    createDirectories(profileDir);
+    for (const auto& file : files) {
+        CopyFileA((rawDir + "/" + file).c_str(), (profileDir + "/" + file).c_str(), FALSE);
+    }
+    return name;
+}
+
+bool buildWithPgo(const BuildOptions& options) {
+    std::vector<Package> packages;
+    std::vector<bool> selected;
+    if (!loadWorkspace(packages) || !selectPackages(packages, options.package, selected)) {
+        return false;
+    }
+    applyBuildProfile(packages, options);
+    int index = findRunPackage(packages, options.package);
+    if (index < 0) return false;
+    
+    const TomlConfig& config = packages[index].config;
+    std::string profileName = !options.profile.empty() ? options.profile : options.isRelease ? "release" : "dev";
+    const std::vector<std::string>& train = (options.isRelease ? config.release : config.dev).pgoTrain;
+    if (config.type != "bin" || train.empty()) {
+        std::cerr << "Error: --pgo needs a binary package with pgo = { train = [...] } in [profile." << profileName << "]" << std::endl;
+        return false;
+    }
+    if (config.platform != getHostPlatform()) {
+        std::cerr << "Error: --pgo runs the program to train it, so the platform must match the host platform" << std::endl;
+        return false;
+    }
+    
+    std::string cwd = currentDirectory();
+    std::string buildPath = profileBuildPath(options);
+    std::string pgoDir = buildPath + "/pgo";
+    std::string statePath = pgoDir + "/state.txt";
+    
+    std::string trainKey = getCompilerVersion() + '\0' + compileFlags(config, options.isRelease);
+    for (const auto& args : train) {
+        trainKey += '\0' + args;
+    }
+    std::string trainHash = sha256Hex(trainKey);
+    std::map<std::string, std::string> sources = hashSources(packages, selected);
+    
+    PgoState state;
+    bool reuse = readPgoState(statePath, state) && state.trainHash == trainHash &&
+                 (fileExists(pgoDir + "/" + state.profile) || directoryExists(pgoDir + "/" + state.profile));
+    if (reuse) {
+        size_t changed = countChangedSources(state.sources, sources);
+        size_t trained = std::max<size_t>(1, state.sources.size());
+        reuse = changed <= pgoRetrainFraction * trained;
+        std::cout << "PGO: " << changed << " of " << trained << " source(s) changed since training, "
+                  << (reuse ? "reusing the profile" : "training again") << std::endl;
+    }
+    
+    if (!reuse) {
+        BuildOptions generate = options;
+        generate.pgo = false;
+        generate.buildSuffix = "-pgo";
+        std::string generatePath = profileBuildPath(generate);
+        std::string rawDir = generatePath + "/profile";
+        if (directoryExists(rawDir)) removeDirectoryTree(rawDir);
+        createDirectories(rawDir);
+        generate.pgoFlags = pgoGenerateFlags(cwd + "/" + rawDir, cwd + "/" + generatePath);
+        
+        std::cout << "PGO: building instrumented binary in " << generatePath << std::endl;
+        if (!runBuild(generate)) return false;
+        
+        std::string exePath = packageOutputPath(packages[index], generate);
+        std::replace(exePath.begin(), exePath.end(), '/', '\\');
+        for (const auto& args : train) {
+            std::vector<std::string> argv;
+            appendFlags(argv, args);
+            std::cout << "PGO: training run: " << joinCommandLine(argv) << std::endl;
+            int exitCode = runProgram(exePath, argv);
+            if (exitCode != 0) {
+                std::cerr << "Error: Training run '" << args << "' " << (exitCode < 0 ? "could not start" : "exited with code " + std::to_string(exitCode)) << std::endl;
+                return false;
+            }
+        }
+        
+        state.profile = storeProfile(rawDir, pgoDir);
+        if (state.profile.empty()) return false;
+        state.trainHash = trainHash;
+        state.sources = sources;
+        writePgoState(statePath, state);
+        
+        // Keep only the profile in use
+        for (const auto& name : listDirectory(pgoDir)) {
+            if (name == state.profile || name == "state.txt") continue;
+            std::string path = pgoDir + "/" + name;
+            if (directoryExists(path)) removeDirectoryTree(path);
+            else DeleteFileA(path.c_str());
+        }
+    }
+    
+    BuildOptions use = options;
+    use.pgo = false;
+    use.pgoFlags = pgoUseFlags(cwd + "/" + pgoDir + "/" + state.profile, cwd + "/" + buildPath);
+    std::cout << "PGO: building with profile " << pgoDir << "/" << state.profile << std::endl;
+    return runBuild(use);
+}
+
+bool buildProject(const BuildOptions& options) {
+    if (!options.timings) {
+        return options.pgo ? buildWithPgo(options) : runBuild(options);
+    }
+    
+    startTimings(options.timeTrace);
+    bool built = options.pgo ? buildWithPgo(options) : runBuild(options);
+    writeTimings(profileBuildPath(options));
+    return built;
+}
+
+// Profiling (cclank run --profile=perf)
+//
+// Windows has no perf, so cclank samples the program itself: about every
+// millisecond each of its threads is suspended, its instruction pointer read
+// and its frame pointer chain followed (the profiling profile compiles with
+// -fno-omit-frame-pointer), and the thread resumed. addr2line then maps the
+// addresses to functions. The stacks are written next to the executable as
+// folded stacks (perf.folded, one "main;parse;lex 42" line per distinct stack,
+// the format flame graph tools read) and as a flame graph (flamegraph.svg).
+
+const size_t maxStackDepth = 256;
+
+struct ProfiledModule {
+    ULONGLONG base = 0;  // where it was loaded
+    ULONGLONG size = 0;
+    std::string path;
+};
+
+struct ProfileRun {
+    std::map<std::vector<ULONGLONG>, int> stacks;  // innermost frame first -> samples
+    std::vector<ProfiledModule> modules;
+    int samples = 0;
+    double seconds = 0;
+    int exitCode = 0;
+};
+
+// Walks the stack of a suspended thread: each frame holds the caller's frame
+// pointer, with the return address into the caller right above it
+std::vector<ULONGLONG> sampleThread(HANDLE process, HANDLE thread) {
+    std::vector<ULONGLONG> frames;
+    CONTEXT context = {};
+    context.ContextFlags = CONTEXT_CONTROL | CONTEXT_INTEGER;
+    if (!GetThreadContext(thread, &context)) return frames;
+    
+    frames.push_back(context.Rip);
+    ULONGLONG framePointer = context.Rbp;
+    while (frames.size() < maxStackDepth && framePointer % 8 == 0) {
+        ULONGLONG frame[2];
+        SIZE_T read = 0;
+        if (!ReadProcessMemory(process, reinterpret_cast<LPCVOID>(framePointer), frame, sizeof(frame), &read) ||
+            read != sizeof(frame) || frame[1] == 0) {
+            break;
+        }
+        // The call instruction, rather than the one after it, is in the caller's line
+        frames.push_back(frame[1] - 1);
+        
+        // Callers' frames are further up the stack; anything else means code without frame pointers
+        if (frame[0] <= framePointer || frame[0] - framePointer > 0x100000) break;
+        framePointer = frame[0];
+    }
+    return frames;
+}
+
+std::vector<ProfiledModule> listModules(HANDLE process) {
+    std::vector<ProfiledModule> modules;
+    HMODULE handles[1024];
+    DWORD needed = 0;
+    if (!EnumProcessModules(process, handles, sizeof(handles), &needed)) return modules;
+    
+    for (DWORD i = 0; i < std::min<DWORD>(needed / sizeof(HMODULE), 1024); i++) {
+        MODULEINFO info = {};
+        char path[MAX_PATH];
+        if (!GetModuleInformation(process, handles[i], &info, sizeof(info)) ||
+            !GetModuleFileNameExA(process, handles[i], path, MAX_PATH)) {
+            continue;
+        }
+        ProfiledModule module;
+        module.base = reinterpret_cast<ULONGLONG>(info.lpBaseOfDll);
+        module.size = info.SizeOfImage;
+        module.path = path;
+        modules.push_back(module);
+    }
+    return modules;
+}
+
+// Runs the program and samples its threads until it exits
+bool profileProgram(const std::string& exePath, ProfileRun& run) {
+    std::string commandLine = quoteArgument(exePath);
+    std::vector<char> cmdLine(commandLine.begin(), commandLine.end());
+    cmdLine.push_back('\0');
+    
+    STARTUPINFOA si = {};
+    si.cb = sizeof(si);
+    PROCESS_INFORMATION program = {};
+    if (!CreateProcessA(NULL, cmdLine.data(), NULL, NULL, FALSE, CREATE_SUSPENDED, NULL, NULL, &si, &program)) {
+        return false;
+    }
+    
+    // Sleeps are rounded up to the system timer, 15.6 ms unless raised
+    timeBeginPeriod(1);
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    ResumeThread(program.hThread);
+    
+    // Threads and DLLs are looked up again every 10 samples, to find ones started or loaded since
+    std::map<DWORD, HANDLE> threads;
+    for (int tick = 0; WaitForSingleObject(program.hProcess, 1) == WAIT_TIMEOUT; tick++) {
+        if (tick % 10 == 0) {
+            std::vector<ProfiledModule> modules = listModules(program.hProcess);
+            if (!modules.empty()) run.modules = modules;
+            
+            HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+            THREADENTRY32 entry = {};
+            entry.dwSize = sizeof(entry);
+            for (BOOL more = Thread32First(snapshot, &entry); more; more = Thread32Next(snapshot, &entry)) {
+                if (entry.th32OwnerProcessID != program.dwProcessId || threads.count(entry.th32ThreadID)) continue;
+                HANDLE thread = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT, FALSE, entry.th32ThreadID);
+                if (thread) threads[entry.th32ThreadID] = thread;
+            }
+            CloseHandle(snapshot);
+        }
+        
+        for (const auto& thread : threads) {
+            if (SuspendThread(thread.second) == static_cast<DWORD>(-1)) continue;  // exited
+            std::vector<ULONGLONG> frames = sampleThread(program.hProcess, thread.second);
+            ResumeThread(thread.second);
+            if (frames.empty()) continue;
+            run.stacks[frames]++;
+            run.samples++;
+        }
+    }
+    
+    QueryPerformanceCounter(&end);
+    timeEndPeriod(1);
+    run.seconds = static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+    
+    DWORD exitCode = 0;
+    GetExitCodeProcess(program.hProcess, &exitCode);
+    run.exitCode = static_cast<int>(exitCode);
+    for (const auto& thread : threads) {
+        CloseHandle(thread.second);
+    }
+    CloseHandle(program.hProcess);
+    CloseHandle(program.hThread);
+    return true;
+}
+
+// The address a module prefers to be loaded at, which its debug info is
+// relative to: ImageBase of a PE file, the first loaded segment of an ELF one
+ULONGLONG preferredImageBase(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> header(4096);
+    file.read(header.data(), header.size());
+    size_t length = static_cast<size_t>(file.gcount());
+    auto read = [&](size_t offset, size_t size) {
+        ULONGLONG value = 0;
+        if (offset + size > length) return value;
+        for (size_t i = 0; i < size; i++) {
+            value |= static_cast<ULONGLONG>(static_cast<unsigned char>(header[offset + i])) << (8 * i);
+        }
+        return value;
+    };
+    
+    if (length > 0x40 && header[0] == 'M' && header[1] == 'Z') {
+        size_t optional = static_cast<size_t>(read(0x3c, 4)) + 24;  // "PE\0\0" and the COFF header
+        return read(optional, 2) == 0x20b ? read(optional + 24, 8) : read(optional + 28, 4);
+    }
+    if (length > 0x40 && std::string(header.data(), 4) == "\x7f" "ELF" && header[4] == 2) {
+        size_t programHeaders = static_cast<size_t>(read(0x20, 8));
+        size_t entrySize = static_cast<size_t>(read(0x36, 2));
+        for (size_t i = 0; i < read(0x38, 2); i++) {
+            size_t entry = programHeaders + i * entrySize;
+            if (read(entry, 4) == 1) return read(entry + 16, 8) & ~0xfffULL;  // PT_LOAD p_vaddr
+        }
+    }
+    return 0;
+}
+
+// Function names of the sampled addresses, from one addr2line run per module
+std::map<ULONGLONG, std::string> symbolizeAddresses(const std::set<ULONGLONG>& addresses, const std::vector<ProfiledModule>& modules) {
+    std::map<ULONGLONG, std::string> names;
+    for (const auto& module : modules) {
+        std::vector<ULONGLONG> inModule;
+        for (auto address = addresses.lower_bound(module.base); address != addresses.end() && *address < module.base + module.size; ++address) {
+            inModule.push_back(*address);
+        }
+        if (inModule.empty()) continue;
+        
+        ULONGLONG imageBase = preferredImageBase(module.path);
+        std::vector<std::string> args = {binutilsProgram("addr2line"), "-f", "-C", "-e", module.path};
+        for (ULONGLONG address : inModule) {
+            char hex[32];
+            snprintf(hex, sizeof(hex), "0x%llx", address - module.base + imageBase);
+            args.push_back(hex);
+        }
+        
+        // Two lines per address: the function, then file:line
+        std::string output;
+        std::vector<std::string> lines;
+        if (runProcess(args, output) == 0) {
+            std::istringstream stream(output);
+            std::string line;
+            while (std::getline(stream, line)) lines.push_back(trim(line));
+        }
+        for (size_t i = 0; i < inModule.size(); i++) {
+            std::string name = lines.size() == 2 * inModule.size() ? lines[2 * i] : "??";
+            if (name == "??" || name.empty()) {
+                char offset[32];
+                snprintf(offset, sizeof(offset), "+0x%llx", inModule[i] - module.base);
+                name = getFileName(module.path) + offset;
+            }
+            names[inModule[i]] = name;
+        }
+    }
+    return names;
+}
+
+// Folded stacks: "outermost;...;innermost" -> samples
+std::map<std::string, int> foldStacks(const ProfileRun& run) {
+    std::set<ULONGLONG> addresses;
+    for (const auto& stack : run.stacks) {
+        addresses.insert(stack.first.begin(), stack.first.end());
+    }
+    std::map<ULONGLONG, std::string> names = symbolizeAddresses(addresses, run.modules);
+    
+    std::map<std::string, int> folded;
+    for (const auto& stack : run.stacks) {
+        std::string line;
+        for (auto frame = stack.first.rbegin(); frame != stack.first.rend(); ++frame) {
+            auto name = names.find(*frame);
+            std::string function = name != names.end() ? name->second : "[unknown]";
+            std::replace(function.begin(), function.end(), ';', ':');
+            line += (line.empty() ? "" : ";") + function;
+        }
+        folded[line] += stack.second;
+    }
+    return folded;
+}
+
+struct FlameNode {
+    std::string name;
+    int samples = 0;
+    std::vector<FlameNode> children;  // in name order
+};
+
+// A flame graph: one box per function on a stack, as wide as its share of the
+// samples and stacked on top of its caller. Hovering shows the full name.
+std::string flameGraphSvg(const std::map<std::string, int>& folded, const std::string& title) {
+    FlameNode root;
+    root.name = "all";
+    size_t depth = 0;
+    for (const auto& stack : folded) {
+        root.samples += stack.second;
+        FlameNode* node = &root;
+        size_t level = 0;
+        std::istringstream frames(stack.first);
+        std::string frame;
+        while (std::getline(frames, frame, ';')) {
+            auto child = std::find_if(node->children.begin(), node->children.end(),
+                                      [&](const FlameNode& candidate) { return candidate.name == frame; });
+            if (child == node->children.end()) {
+                node->children.push_back(FlameNode());
+                child = node->children.end() - 1;
+                child->name = frame;
+            }
+            child->samples += stack.second;
+            node = &*child;
+            depth = std::max(depth, ++level);
+        }
+    }
+    
+    const double width = 1200, margin = 10, frameHeight = 16;
+    double height = (depth + 1) * frameHeight + 3 * margin + 20;
+    std::ostringstream svg;
+    svg << "<?xml version=\"1.0\" standalone=\"no\"?>\n"
+        << "<svg version=\"1.1\" width=\"" << width << "\" height=\"" << height << "\" xmlns=\"http://www.w3.org/2000/svg\" "
+        << "font-family=\"Verdana, sans-serif\" font-size=\"12\">\n"
+        << "<rect width=\"100%\" height=\"100%\" fill=\"#f8f8f8\"/>\n"
+        << "<text x=\"" << width / 2 << "\" y=\"24\" text-anchor=\"middle\" font-size=\"17\">" << escapeXml(title) << "</text>\n";
+    
+    double scale = root.samples > 0 ? (width - 2 * margin) / root.samples : 0;
+    std::function<void(const FlameNode&, double, size_t)> draw = [&](const FlameNode& node, double x, size_t level) {
+        double boxWidth = node.samples * scale;
+        if (boxWidth < 0.3) return;
+        double y = height - margin - (level + 1) * frameHeight;
+        
+        // Warm colors, stable per function name
+        uint32_t hash = static_cast<uint32_t>(std::hash<std::string>()(node.name));
+        int red = 205 + hash % 50, green = (hash >> 8) % 230, blue = (hash >> 16) % 55;
+        char percent[16];
+        snprintf(percent, sizeof(percent), "%.2f%%", 100.0 * node.samples / root.samples);
+        svg << "<g><title>" << escapeXml(node.name) << " (" << node.samples << " samples, " << percent << ")</title>"
+            << "<rect x=\"" << x << "\" y=\"" << y << "\" width=\"" << boxWidth << "\" height=\"" << frameHeight - 1
+            << "\" fill=\"rgb(" << red << "," << green << "," << blue << ")\" rx=\"2\"/>";
+        size_t fits = static_cast<size_t>(boxWidth / 7);
+        if (fits >= 3) {
+            std::string label = node.name.length() <= fits ? node.name : node.name.substr(0, fits - 2) + "..";
+            svg << "<text x=\"" << x + 3 << "\" y=\"" << y + frameHeight - 4 << "\">" << escapeXml(label) << "</text>";
+        }
+        svg << "</g>\n";
+        
+        for (const auto& child : node.children) {
+            draw(child, x, level + 1);
+            x += child.samples * scale;
+        }
+    };
+    draw(root, margin, 0);
+    svg << "</svg>\n";
+    return svg.str();
+}
+
+// Runs a built program under the sampler and writes its profile next to it
+bool profileCommand(const std::string& exePath) {
+    std::string outputDir = exePath.substr(0, exePath.find_last_of("\\/") + 1);
+    std::cout << "Profiling " << exePath << "...\n" << std::endl;
+    
+    ProfileRun run;
+    if (!profileProgram(exePath, run)) {
+        std::cerr << "Error: Could not start " << exePath << std::endl;
+        return false;
+    }
+    if (run.exitCode != 0) {
+        std::cerr << "\n" << exePath << " exited with code " << run.exitCode << std::endl;
+    }
+    if (run.samples == 0) {
+        std::cerr << "Error: No samples were taken; the program ran for " << formatSeconds(run.seconds * 1000000) << std::endl;
+        return false;
+    }
+    
+    std::map<std::string, int> folded = foldStacks(run);
+    std::string foldedText;
+    std::map<std::string, int> self;  // innermost function -> samples
+    for (const auto& stack : folded) {
+        foldedText += stack.first + " " + std::to_string(stack.second) + "\n";
+        self[stack.first.substr(stack.first.find_last_of(';') + 1)] += stack.second;
+    }
+    std::string foldedPath = outputDir + "perf.folded";
+    std::string svgPath = outputDir + "flamegraph.svg";
+    std::string title = getFileName(exePath) + ": " + std::to_string(run.samples) + " samples in " + formatSeconds(run.seconds * 1000000);
+    if (!writeFile(foldedPath, foldedText) || !writeFile(svgPath, flameGraphSvg(folded, title))) {
+        std::cerr << "Error: Could not write the profile to " << outputDir << std::endl;
+        return false;
+    }
+    
+    std::vector<std::pair<int, std::string>> hottest;
+    for (const auto& function : self) {
+        hottest.push_back({function.second, function.first});
+    }
+    std::sort(hottest.rbegin(), hottest.rend());
+    std::cout << "\n" << run.samples << " sample(s) in " << formatSeconds(run.seconds * 1000000) << ", hottest functions:" << std::endl;
+    for (size_t i = 0; i < std::min<size_t>(hottest.size(), 10); i++) {
+        char percent[16];
+        snprintf(percent, sizeof(percent), "%6.2f%%", 100.0 * hottest[i].first / run.samples);
+        std::cout << "  " << percent << "  " << hottest[i].second << std::endl;
+    }
+    std::cout << "Folded stacks: " << foldedPath << std::endl;
+    std::cout << "Flame graph:   " << svgPath << std::endl;
+    return true;
+}
+
+void runProject(const BuildOptions& options) {
+    std::vector<Package> packages;
+    if (!loadWorkspace(packages)) return;
+    
+    int index = findRunPackage(packages, options.package);
+    if (index < 0) return;
+    const TomlConfig& config = packages[index].config;
+    
+    // Only binaries can be run
+    if (config.type != "bin") {
+        std::cerr << "Error: Cannot run non-binary project (type = " << config.type << ")" << std::endl;
+        std::cerr << "Only projects with type = \"bin\" can be executed" << std::endl;
+        return;
+    }
+    
+    // Check if platform matches host
+    std::string hostPlatform = getHostPlatform();
+    if (config.platform != hostPlatform) {
+        std::cerr << "Error: Cannot use 'run' when the platform doesn't match the host platform" << std::endl;
+        std::cerr << "Project platform: " << config.platform << std::endl;
+        std::cerr << "Host platform: " << hostPlatform << std::endl;
+        std::cerr << "Change platform to \"" << hostPlatform << "\" in cclank.toml to run on this system" << std::endl;
+        return;
+    }
+    
+    std::string exePath = packageOutputPath(packages[index], options);
+    std::replace(exePath.begin(), exePath.end(), '/', '\\');
+    
+    // Build first; the build manifest makes this a quick check when nothing changed
+    BuildOptions buildOptions = options;
+    buildOptions.package = packages[index].name;
+    if (!buildProject(buildOptions) || !fileExists(exePath)) {
+        std::cerr << "Error: Build failed, not running " << exePath << std::endl;
+        return;
+    }
+    
+    if (options.profiler == "perf") {
+        profileCommand(exePath);
+        return;
+    }
+    
+    // Run the executable in this console and wait for it
+    std::cout << "Running " << exePath << "...\n" << std::endl;
+    int exitCode = runProgram(exePath, {});
+    if (exitCode < 0) {
+        std::cerr << "Error: Could not start " << exePath << std::endl;
+    } else if (exitCode != 0) {
+        std::cerr << "\n" << exePath << " exited with code " << exitCode << std::endl;
+    }
+}
+
+// Benchmarks (cclank bench)
+//
+// Each [[bench]] entry is built in release mode and run a number of times
+// after some warmup runs, pinned to one CPU, with its output discarded. Wall
+// time, user and system CPU time and peak memory of every run are written to
+// build/bench/<package>/<name>/ together with the git revision, and the wall times are
+// compared with the saved baseline using a Mann-Whitney U test.
+
+const double benchSignificance = 0.05;  // p-value below which a difference counts
+const double benchNoiseThreshold = 0.01;  // smaller changes of the median are reported as noise
+
+struct BenchSample {
+    double wall = 0;    // seconds
+    double user = 0;
+    double system = 0;
+    long long maxRss = 0;  // bytes
+};
+
+// Pins a suspended process to one logical processor, numbered across all
+// processor groups; an affinity mask only reaches the 64 of one group
+void pinToProcessor(const PROCESS_INFORMATION& pi, int cpu) {
+    WORD groups = GetActiveProcessorGroupCount();
+    for (WORD group = 0; group < groups; group++) {
+        int count = static_cast<int>(GetActiveProcessorCount(group));
+        if (cpu >= count) {
+            cpu -= count;
+            continue;
+        }
+        GROUP_AFFINITY affinity = {};
+        affinity.Mask = static_cast<DWORD_PTR>(1) << cpu;
+        affinity.Group = group;
+        SetThreadGroupAffinity(pi.hThread, &affinity, NULL);
+        
+        // Threads it starts later follow the process mask, which only applies within its primary group
+        if (group == 0) SetProcessAffinityMask(pi.hProcess, affinity.Mask);
+        return;
+    }
+}
+
+// Runs the program once with stdout and stderr discarded. Returns its exit code, or -1 if it couldn't start.
+int runBenchProcess(const std::string& exePath, const std::vector<std::string>& args, int cpu, BenchSample& sample) {
+    SECURITY_ATTRIBUTES sa = {};
+    sa.nLength = sizeof(sa);
+    sa.bInheritHandle = TRUE;
+    HANDLE nul = CreateFileA("NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+    
+    STARTUPINFOA si = {};
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    si.hStdOutput = nul;
+    si.hStdError = nul;
+    
+    std::vector<std::string> argv = {exePath};
+    argv.insert(argv.end(), args.begin(), args.end());
+    std::string commandLine = joinCommandLine(argv);
+    std::vector<char> cmdLine(commandLine.begin(), commandLine.end());
+    cmdLine.push_back('\0');
+    
+    // Started suspended so it is pinned before it runs any code
+    PROCESS_INFORMATION pi = {};
+    BOOL created = CreateProcessA(NULL, cmdLine.data(), NULL, NULL, TRUE, CREATE_SUSPENDED, NULL, NULL, &si, &pi);
+    if (nul != INVALID_HANDLE_VALUE) CloseHandle(nul);
+    if (!created) return -1;
+    if (cpu >= 0) pinToProcessor(pi, cpu);
+    
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    ResumeThread(pi.hThread);
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    QueryPerformanceCounter(&end);
+    
+    sample.wall = static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+    FILETIME creation, exit, kernelTime, userTime;
+    if (GetProcessTimes(pi.hProcess, &creation, &exit, &kernelTime, &userTime)) {
+        sample.user = fileTimeMicroseconds(userTime) / 1000000.0;
+        sample.system = fileTimeMicroseconds(kernelTime) / 1000000.0;
+    }
+    PROCESS_MEMORY_COUNTERS memory = {};
+    if (GetProcessMemoryInfo(pi.hProcess, &memory, sizeof(memory))) {
+        sample.maxRss = static_cast<long long>(memory.PeakWorkingSetSize);
+    }
+    
+    DWORD exitCode = 1;
+    GetExitCodeProcess(pi.hProcess, &exitCode);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    return static_cast<int>(exitCode);
+}
+
+double median(std::vector<double> values) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+// Two-sided Mann-Whitney U test: the probability of samples this different
+// if both came from the same distribution (normal approximation with tie
+// and continuity correction, fine from about 8 samples each)
+double mannWhitneyP(const std::vector<double>& a, const std::vector<double>& b) {
+    std::vector<std::pair<double, int>> all;
+    for (double value : a) all.push_back({value, 0});
+    for (double value : b) all.push_back({value, 1});
+    std::sort(all.begin(), all.end());
+    
+    double n1 = static_cast<double>(a.size());
+    double n2 = static_cast<double>(b.size());
+    double n = n1 + n2;
+    if (n1 == 0 || n2 == 0) return 1;
+    
+    // Tied values share the average of their ranks
+    double rankSumA = 0;
+    double tieTerm = 0;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first) j++;
+        double rank = (i + 1 + j) / 2.0;
+        double ties = static_cast<double>(j - i);
+        tieTerm += ties * ties * ties - ties;
+        for (size_t k = i; k < j; k++) {
+            if (all[k].second == 0) rankSumA += rank;
+        }
+        i = j;
+    }
+    
+    double u = rankSumA - n1 * (n1 + 1) / 2;
+    double mean = n1 * n2 / 2;
+    double variance = n1 * n2 / 12 * ((n + 1) - tieTerm / (n * (n - 1)));
+    if (variance <= 0) return 1;
+    double z = (std::fabs(u - mean) - 0.5) / std::sqrt(variance);
+    return std::erfc(std::max(0.0, z) / std::sqrt(2.0));
+}
+
+// Short hash of HEAD, with "-dirty" when tracked files have changes
+std::string gitRevision() {
+    std::string revision;
+    if (runProcess({"git", "rev-parse", "--short=12", "HEAD"}, revision) != 0) {
+        return "unknown";
+    }
+    revision = trim(revision);
+    std::string status;
+    if (runProcess({"git", "status", "--porcelain", "--untracked-files=no"}, status) == 0 && !trim(status).empty()) {
+        revision += "-dirty";
+    }
+    return revision;
+}
+
+std::string benchResultJson(const std::string& name, const std::string& revision, const std::string& timestamp, int cpu,
+                            const std::vector<BenchSample>& samples) {
+    std::vector<double> walls;
+    for (const auto& sample : samples) walls.push_back(sample.wall);
+    
+    char number[64];
+    std::string json = "{\n  \"bench\": \"" + jsonEscape(name) + "\",\n  \"revision\": \"" + jsonEscape(revision) +
+                       "\",\n  \"timestamp\": \"" + timestamp + "\",\n  \"cpu\": " + std::to_string(cpu) + ",\n";
+    snprintf(number, sizeof(number), "%.9f", median(walls));
+    json += "  \"medianWallSeconds\": " + std::string(number) + ",\n  \"runs\": [\n";
+    for (size_t i = 0; i < samples.size(); i++) {
+        snprintf(number, sizeof(number), "%.9f", samples[i].wall);
+        json += "    {\"wallSeconds\": " + std::string(number);
+        snprintf(number, sizeof(number), "%.6f", samples[i].user);
+        json += ", \"userSeconds\": " + std::string(number);
+        snprintf(number, sizeof(number), "%.6f", samples[i].system);
+        json += ", \"sysSeconds\": " + std::string(number);
+        json += ", \"maxRssBytes\": " + std::to_string(samples[i].maxRss) + "}";
+        json += (i + 1 < samples.size() ? ",\n" : "\n");
+    }
+    json += "  ]\n}\n";
+    return json;
+}
+
+std::string formatDuration(double seconds) {
+    char text[32];
+    if (seconds >= 1) snprintf(text, sizeof(text), "%.3f s", seconds);
+    else if (seconds >= 0.001) snprintf(text, sizeof(text), "%.3f ms", seconds * 1000);
+    else snprintf(text, sizeof(text), "%.1f us", seconds * 1000000);
+    return text;
+}
+
+struct BenchSettings {
+    std::vector<std::string> names;  // benches to run; empty = all
+    int runs = 0;    // 0 = the bench's own setting
+    int warmup = -1;
+    int cpu = -2;    // -2 = the last CPU, -1 = not pinned
+    bool saveBaseline = false;
+};
+
+// Builds and runs the benchmarks; returns false if one failed or got slower than its baseline
+bool benchCommand(BenchSettings settings, BuildOptions options) {
+    options.isRelease = true;
+    options.targets = "bench";
+    if (!buildProject(options)) return false;
+    
+    std::vector<Package> packages;
+    std::vector<bool> selected;
+    if (!loadWorkspace(packages) || !selectPackages(packages, options.package, selected)) {
+        return false;
+    }
+    size_t packageCount = packages.size();
+    if (!addTargetPackages(packages, selected, options.targets)) return false;
+    
+    int cpu = settings.cpu;
+    int processorCount = static_cast<int>(GetActiveProcessorCount(ALL_PROCESSOR_GROUPS));
+    if (cpu == -2) cpu = processorCount - 1;
+    if (cpu >= processorCount) {
+        std::cerr << "Error: --cpu " << cpu << " is out of range, this machine has " << processorCount << " logical processor(s)" << std::endl;
+        return false;
+    }
+    std::string revision = gitRevision();
+    SYSTEMTIME now;
+    GetSystemTime(&now);
+    char timestamp[64];
+    snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02dT%02d:%02d:%02dZ",
+             now.wYear, now.wMonth, now.wDay, now.wHour, now.wMinute, now.wSecond);
+    
+    bool passed = true;
+    int benchCount = 0;
+    for (size_t i = 0; i < packageCount; i++) {
+        if (!selected[i]) continue;
+        for (const auto& bench : packages[i].config.benches) {
+            if (!settings.names.empty() && std::find(settings.names.begin(), settings.names.end(), bench.name) == settings.names.end()) {
+                continue;
+            }
+            benchCount++;
+            
+            // Benches without a path run the package's own binary
+            std::string exePath;
+            if (bench.path.empty()) {
+                if (packages[i].config.type != "bin") {
+                    std::cerr << "Error: Bench '" << bench.name << "' has no path and " << packages[i].name << " is not a binary" << std::endl;
+                    passed = false;
+                    continue;
+                }
+                exePath = packageOutputPath(packages[i], options);
+            } else {
+                for (size_t t = packageCount; t < packages.size(); t++) {
+                    if (packages[t].name == packages[i].name && packages[t].target == "bench/" + bench.name) {
+                        exePath = packageOutputPath(packages[t], options);
+                    }
+                }
+            }
+            std::replace(exePath.begin(), exePath.end(), '/', '\\');
+            
+            int runs = settings.runs > 0 ? settings.runs : bench.runs;
+            int warmup = settings.warmup >= 0 ? settings.warmup : bench.warmup;
+            std::cout << "\nBenchmarking " << bench.name << " (" << runs << " run(s), " << warmup << " warmup";
+            if (cpu >= 0) std::cout << ", pinned to CPU " << cpu;
+            std::cout << ")..." << std::endl;
+            
+            std::vector<BenchSample> samples;
+            int exitCode = 0;
+            for (int run = 0; run < warmup + runs && exitCode == 0; run++) {
+                BenchSample sample;
+                exitCode = runBenchProcess(exePath, bench.args, cpu, sample);
+                if (run >= warmup) samples.push_back(sample);
+            }
+            if (exitCode != 0) {
+                std::cerr << "Error: " << exePath << (exitCode < 0 ? " could not be started" : " exited with code " + std::to_string(exitCode)) << std::endl;
+                passed = false;
+                continue;
+            }
+            
+            std::vector<double> walls, users, systems;
+            long long maxRss = 0;
+            for (const auto& sample : samples) {
+                walls.push_back(sample.wall);
+                users.push_back(sample.user);
+                systems.push_back(sample.system);
+                maxRss = std::max(maxRss, sample.maxRss);
+            }
+            double medianWall = median(walls);
+            std::cout << "  wall    " << formatDuration(medianWall) << " median (min " << formatDuration(*std::min_element(walls.begin(), walls.end()))
+                      << ", max " << formatDuration(*std::max_element(walls.begin(), walls.end())) << ")" << std::endl;
+            std::cout << "  user    " << formatDuration(median(users)) << " median" << std::endl;
+            std::cout << "  sys     " << formatDuration(median(systems)) << " median" << std::endl;
+            std::cout << "  max RSS " << formatSize(maxRss) << std::endl;
+            
+            // Save the results, then compare with the baseline
+            std::string benchDir = "build/bench/" + packages[i].name + "/" + bench.name;
+            createDirectories(benchDir);
+            std::string json = benchResultJson(bench.name, revision, timestamp, cpu, samples);
+            std::string historyName = std::string(timestamp).substr(0, 19);
+            std::replace(historyName.begin(), historyName.end(), ':', '-');
+            writeFile(benchDir + "/latest.json", json);
+            writeFile(benchDir + "/" + historyName + ".json", json);
+            
+            std::string baselinePath = benchDir + "/baseline.json";
+            JsonValue baseline;
+            if (settings.saveBaseline || !parseJson(readFile(baselinePath), baseline)) {
+                writeFile(baselinePath, json);
+                std::cout << "  Saved as the baseline (" << revision << ")" << std::endl;
+                continue;
+            }
+            
+            std::vector<double> baselineWalls;
+            const JsonValue* baselineRuns = baseline.get("runs");
+            if (baselineRuns && baselineRuns->type == JsonValue::Array) {
+                for (const auto& run : baselineRuns->array) {
+                    baselineWalls.push_back(run.getNumber("wallSeconds"));
+                }
+            }
+            double baselineMedian = median(baselineWalls);
+            if (baselineWalls.empty() || baselineMedian <= 0) {
+                std::cerr << "Warning: " << baselinePath << " has no runs, not comparing" << std::endl;
+                continue;
+            }
+            
+            double change = medianWall / baselineMedian - 1;
+            double p = mannWhitneyP(walls, baselineWalls);
+            bool significant = p < benchSignificance && std::fabs(change) >= benchNoiseThreshold;
+            char comparison[160];
+            snprintf(comparison, sizeof(comparison), "  vs baseline %s: %+.1f%% (p = %.3f), ",
+                     baseline.getString("revision").c_str(), change * 100, p);
+            std::cout << comparison << (!significant ? "no significant change" : (change > 0 ? "REGRESSED" : "improved")) << std::endl;
+            if (significant && change > 0) passed = false;
+        }
+    }
+    
+    if (benchCount == 0) {
+        std::cerr << "Error: No [[bench]] entries" << (settings.names.empty() ? "" : " with that name") << " in the selected packages" << std::endl;
+        return false;
+    }
+    return passed;
+}
+
+// Tests (cclank test)
+//
+// Every [[test]] entry and every file directly in tests/ is built into a
+// binary of its own against the package's sources, like a bench. The test
+// binaries then run in parallel, each with its output in a log file and a
+// timeout after which it is killed together with anything it started. The
+// longest tests of the previous run start first so a slow test doesn't end up
+// running alone at the end. --shard i/n runs every n-th test, for splitting a
+// suite across machines.
+
+const int defaultTestTimeout = 60;  // seconds
+
+struct TestCase {
+    std::string id;  // "<package>/<test>"
+    std::string exePath;
+    std::string workingDir;
+    std::vector<std::string> args;
+    int timeout = defaultTestTimeout;
+    std::string logPath;
+    
+    // Filled in by runTestCase
+    double seconds = 0;
+    int exitCode = 0;  // -1 if it couldn't start
+    bool timedOut = false;
+};
+
+void runTestCase(TestCase& test) {
+    SECURITY_ATTRIBUTES sa = {};
+    sa.nLength = sizeof(sa);
+    sa.bInheritHandle = TRUE;
+    
+    PROCESS_INFORMATION pi = {};
+    HANDLE job = CreateJobObjectA(NULL, NULL);
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    {
+        std::lock_guard<std::mutex> lock(processSpawnMutex);
+        
+        HANDLE log = CreateFileA(test.logPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (log == INVALID_HANDLE_VALUE || !job) {
+            if (log != INVALID_HANDLE_VALUE) CloseHandle(log);
+            if (job) CloseHandle(job);
+            test.exitCode = -1;
+            return;
+        }
+        
+        STARTUPINFOA si = {};
+        si.cb = sizeof(si);
+        si.dwFlags = STARTF_USESTDHANDLES;
+        si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+        si.hStdOutput = log;
+        si.hStdError = log;
+        
+        std::vector<std::string> argv = {test.exePath};
+        argv.insert(argv.end(), test.args.begin(), test.args.end());
+        std::string commandLine = joinCommandLine(argv);
+        std::vector<char> cmdLine(commandLine.begin(), commandLine.end());
+        cmdLine.push_back('\0');
+        
+        // Started suspended so everything it spawns is in the job too
+        BOOL created = CreateProcessA(NULL, cmdLine.data(), NULL, NULL, TRUE, CREATE_SUSPENDED, NULL,
+                                      test.workingDir.c_str(), &si, &pi);
+        CloseHandle(log);
+        if (!created) {
+            CloseHandle(job);
+            test.exitCode = -1;
+            return;
+        }
+        AssignProcessToJobObject(job, pi.hProcess);
+        QueryPerformanceCounter(&start);
+        ResumeThread(pi.hThread);
+    }
+    
+    if (WaitForSingleObject(pi.hProcess, static_cast<DWORD>(test.timeout) * 1000) == WAIT_TIMEOUT) {
+        test.timedOut = true;
+        TerminateJobObject(job, 1);
+        WaitForSingleObject(pi.hProcess, INFINITE);
+    }
+    QueryPerformanceCounter(&end);
+    test.seconds = static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+    
+    DWORD exitCode = 1;
+    GetExitCodeProcess(pi.hProcess, &exitCode);
+    test.exitCode = static_cast<int>(exitCode);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    CloseHandle(job);
+}
+
+// build/<profile>/test-durations.txt: "<seconds>\t<test id>" per line
+std::map<std::string, double> readTestDurations(const std::string& path) {
+    std::map<std::string, double> durations;
+    std::istringstream lines(readFile(path));
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t tab = line.find('\t');
+        if (tab != std::string::npos) durations[line.substr(tab + 1)] = atof(line.substr(0, tab).c_str());
+    }
+    return durations;
+}
+
+void writeTestDurations(const std::string& path, const std::map<std::string, double>& durations) {
+    std::string content;
+    char seconds[32];
+    for (const auto& entry : durations) {
+        snprintf(seconds, sizeof(seconds), "%.3f", entry.second);
+        content += std::string(seconds) + "\t" + entry.first + "\n";
+    }
+    writeFile(path, content);
+}
+
+struct TestSettings {
+    std::vector<std::string> filters;  // run tests whose id contains one of these; empty = all
+    int timeout = 0;      // seconds; 0 = each test's own setting
+    int shardIndex = 0;   // --shard i/n, 1-based; 0 = no sharding
+    int shardCount = 0;
+};
+
+// Builds and runs the tests; returns true if all of them passed
+bool testCommand(const TestSettings& settings, BuildOptions options) {
+    options.targets = "test";
+    if (!buildProject(options)) return false;
+    
+    std::vector<Package> packages;
+    std::vector<bool> selected;
+    if (!loadWorkspace(packages) || !selectPackages(packages, options.package, selected)) {
+        return false;
+    }
+    size_t packageCount = packages.size();
+    if (!addTargetPackages(packages, selected, options.targets)) return false;
+    
+    std::string cwd = currentDirectory();
+    std::vector<TestCase> tests;
+    for (size_t i = 0; i < packageCount; i++) {
+        if (!selected[i]) continue;
+        for (const auto& entry : packageTargets(packages[i], "test")) {
+            TestCase test;
+            test.id = packages[i].name + "/" + entry.name;
+            bool matches = settings.filters.empty();
+            for (const auto& filter : settings.filters) {
+                if (test.id.find(filter) != std::string::npos) matches = true;
+            }
+            if (!matches) continue;
+            
+            // Tests without a path run the package's own binary
+            std::string outputPath;
+            if (entry.path.empty()) {
+                if (packages[i].config.type != "bin") {
+                    std::cerr << "Error: Test '" << entry.name << "' has no path and " << packages[i].name << " is not a binary" << std::endl;
+                    return false;
+                }
+                outputPath = packageOutputPath(packages[i], options);
+            } else {
+                for (size_t t = packageCount; t < packages.size(); t++) {
+                    if (packages[t].name == packages[i].name && packages[t].target == "test/" + entry.name) {
+                        outputPath = packageOutputPath(packages[t], options);
+                    }
+                }
+            }
+            test.exePath = cwd + "/" + outputPath;
+            std::replace(test.exePath.begin(), test.exePath.end(), '/', '\\');
+            test.logPath = outputPath + ".log";
+            
+            // Tests run in their package's directory, so they find their data files
+            test.workingDir = packages[i].root.empty() ? cwd : cwd + "/" + packages[i].root;
+            test.args = entry.args;
+            if (settings.timeout > 0) test.timeout = settings.timeout;
+            else if (entry.timeout > 0) test.timeout = entry.timeout;
+            tests.push_back(test);
+        }
+    }
+    
+    // Shards take every n-th test by id, so each machine gets the same split
+    std::sort(tests.begin(), tests.end(), [](const TestCase& a, const TestCase& b) { return a.id < b.id; });
+    if (settings.shardCount > 0) {
+        std::vector<TestCase> shard;
+        for (size_t i = 0; i < tests.size(); i++) {
+            if (static_cast<int>(i % settings.shardCount) == settings.shardIndex - 1) shard.push_back(tests[i]);
+        }
+        tests = shard;
+    }
+    if (tests.empty()) {
+        std::cout << "No tests to run" << std::endl;
+        return true;
+    }
+    
+    // Longest first; tests without a previous duration are assumed to be long
+    std::string durationsPath = profileBuildPath(options) + "/test-durations.txt";
+    std::map<std::string, double> durations = readTestDurations(durationsPath);
+    std::stable_sort(tests.begin(), tests.end(), [&](const TestCase& a, const TestCase& b) {
+        double aDuration = durations.count(a.id) ? durations[a.id] : 1e30;
+        double bDuration = durations.count(b.id) ? durations[b.id] : 1e30;
+        return aDuration > bDuration;
+    });
+    
+    int jobCount = options.jobs > 0 ? options.jobs : getDefaultJobCount();
+    jobCount = std::max(1, std::min(jobCount, static_cast<int>(tests.size())));
+    std::cout << "\nRunning " << tests.size() << " test(s) on " << jobCount << " thread(s)";
+    if (settings.shardCount > 0) std::cout << " (shard " << settings.shardIndex << "/" << settings.shardCount << ")";
+    std::cout << "..." << std::endl;
+    
+    std::atomic<size_t> next(0);
+    std::mutex outputMutex;
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    
+    auto worker = [&]() {
+        for (size_t index = next++; index < tests.size(); index = next++) {
+            TestCase& test = tests[index];
+            runTestCase(test);
+            
+            std::string status = test.timedOut ? "TIMEOUT" : (test.exitCode == 0 ? "ok" : "FAILED");
+            char line[64];
+            snprintf(line, sizeof(line), " (%.2fs)", test.seconds);
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cout << "  test " << test.id << " ... " << status << line << std::endl;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < jobCount; i++) {
+        threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    QueryPerformanceCounter(&end);
+    
+    // Show the output of the failed tests once they have all finished
+    int passed = 0, failed = 0, timedOut = 0;
+    for (const auto& test : tests) {
+        if (test.exitCode == 0 && !test.timedOut) {
+            passed++;
+            durations[test.id] = test.seconds;
+            continue;
+        }
+        
+        std::cout << "\n---- " << test.id << " ";
+        if (test.timedOut) {
+            timedOut++;
+            std::cout << "timed out after " << test.timeout << "s";
+        } else if (test.exitCode < 0) {
+            failed++;
+            std::cout << "could not be started: " << test.exePath;
+        } else {
+            failed++;
+            durations[test.id] = test.seconds;
+            std::cout << "exited with code " << test.exitCode;
+        }
+        std::cout << " ----" << std::endl;
+        std::string output = readFile(test.logPath);
+        std::cout << output;
+        if (!output.empty() && output.back() != '\n') std::cout << std::endl;
+    }
+    writeTestDurations(durationsPath, durations);
+    
+    char summary[160];
+    snprintf(summary, sizeof(summary), "\nTest result: %s. %d passed, %d failed, %d timed out (%.2fs)",
+             failed + timedOut == 0 ? "ok" : "FAILED", passed, failed, timedOut,
+             static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart);
+    std::cout << summary << std::endl;
+    return failed + timedOut == 0;
+}
+
+// Binary size analysis (cclank bloat)
+//
+// Reads the symbol table of a built binary, ELF or PE/COFF, and attributes
+// the size of its code and data to symbols, to template instantiations
+// (demangled with c++filt and grouped with their template arguments
+// removed), and to the translation units whose objects define them. A saved
+// baseline (build/bloat/<package>/baseline.txt) shows what grew since.
+// ELF symbols carry their size; COFF ones don't, so a symbol there spans up
+// to the next symbol of its section.
+
+struct BinarySymbol {
+    std::string name;     // as in the symbol table (mangled)
+    std::string section;  // text, rodata, data, bss or other
+    ULONGLONG address = 0;
+    ULONGLONG size = 0;
+    bool global = false;
+    std::string file;     // source named by the closest preceding FILE symbol
+};
+
+struct BinaryImage {
+    std::string format;  // "ELF" or "PE"
+    std::map<std::string, ULONGLONG> sectionSizes;  // by kind, of the sections loaded into memory
+    std::vector<BinarySymbol> symbols;               // defined ones only
+};
+
+// The kind of a section by its name: .text.hot -> text, .rdata -> rodata
+std::string sectionKind(const std::string& name) {
+    const std::pair<const char*, const char*> kinds[] = {
+        {".text", "text"}, {".rodata", "rodata"}, {".rdata", "rodata"}, {".data.rel.ro", "rodata"},
+        {".data", "data"}, {".bss", "bss"}, {".tbss", "bss"}
+    };
+    for (const auto& kind : kinds) {
+        size_t length = strlen(kind.first);
+        if (name.compare(0, length, kind.first) == 0 && (name.length() == length || name[length] == '.' || name[length] == '$')) {
+            return kind.second;
+        }
+    }
+    return "other";
+}
+
+// Little-endian integer at offset, or 0 past the end of the data
+ULONGLONG readLittleEndian(const std::string& data, size_t offset, size_t size) {
+    ULONGLONG value = 0;
+    if (offset + size > data.size() || offset + size < offset) return 0;
+    for (size_t i = 0; i < size; i++) {
+        value |= static_cast<ULONGLONG>(static_cast<unsigned char>(data[offset + i])) << (8 * i);
+    }
+    return value;
+}
+
+std::string readCString(const std::string& data, size_t offset) {
+    if (offset >= data.size()) return "";
+    return std::string(data.c_str() + offset, strnlen(data.c_str() + offset, data.size() - offset));
+}
+
+// 64-bit ELF executables, shared libraries and objects: .symtab (or .dynsym
+// when stripped), with section sizes from the section headers
+bool readElfImage(const std::string& data, BinaryImage& image, std::string& error) {
+    if (data[4] != 2) {
+        error = "only 64-bit ELF files are supported";
+        return false;
+    }
+    image.format = "ELF";
+    size_t sectionHeaders = readLittleEndian(data, 0x28, 8);
+    size_t headerSize = readLittleEndian(data, 0x3a, 2);
+    size_t sectionCount = readLittleEndian(data, 0x3c, 2);
+    size_t namesIndex = readLittleEndian(data, 0x3e, 2);
+    auto header = [&](size_t index, size_t field, size_t size) {
+        return readLittleEndian(data, sectionHeaders + index * headerSize + field, size);
+    };
+    size_t sectionNames = header(namesIndex, 0x18, 8);
+    
+    std::vector<std::string> kinds(sectionCount);
+    size_t symbolTable = 0, dynamicTable = 0;
+    for (size_t i = 0; i < sectionCount; i++) {
+        std::string name = readCString(data, sectionNames + header(i, 0, 4));
+        kinds[i] = sectionKind(name);
+        ULONGLONG type = header(i, 4, 4);
+        if (type == 2) symbolTable = i;       // SHT_SYMTAB
+        if (type == 11) dynamicTable = i;     // SHT_DYNSYM
+        if (header(i, 8, 8) & 2) {            // SHF_ALLOC
+            image.sectionSizes[kinds[i]] += header(i, 0x20, 8);
+        }
+    }
+    size_t table = symbolTable ? symbolTable : dynamicTable;
+    if (table == 0) {
+        error = "it has no symbol table";
+        return false;
+    }
     
+    size_t offset = header(table, 0x18, 8);
+    size_t count = header(table, 0x20, 8) / 24;
+    size_t strings = header(header(table, 0x28, 4), 0x18, 8);
+    std::string file;
+    for (size_t i = 1; i < count; i++) {
+        size_t entry = offset + i * 24;
+        unsigned info = static_cast<unsigned>(readLittleEndian(data, entry + 4, 1));
+        size_t sectionIndex = readLittleEndian(data, entry + 6, 2);
+        std::string name = readCString(data, strings + readLittleEndian(data, entry, 4));
+        unsigned type = info & 0xf, binding = info >> 4;
+        if (type == 4) {  // STT_FILE
+            file = name;
+            continue;
+        }
+        if (sectionIndex == 0 || sectionIndex >= sectionCount || name.empty() || (type != 1 && type != 2)) continue;
+        
+        BinarySymbol symbol;
+        symbol.name = name;
+        symbol.section = kinds[sectionIndex];
+        symbol.address = readLittleEndian(data, entry + 8, 8);
+        symbol.size = readLittleEndian(data, entry + 16, 8);
+        symbol.global = binding != 0;
+        if (!symbol.global) symbol.file = file;
+        image.symbols.push_back(symbol);
+    }
     return true;
 }
 
-void createDefaultToml(const std::string& projectPath, const std::string& projectName) {
-    std::string tomlPath = projectPath + "/cclank.toml";
-    std::ofstream toml(tomlPath);
+// PE images (with the COFF symbol table GCC leaves in unless stripped) and COFF objects
+bool readCoffImage(const std::string& data, BinaryImage& image, std::string& error) {
+    size_t coff = 0;
+    if (data.compare(0, 2, "MZ") == 0) {
+        coff = readLittleEndian(data, 0x3c, 4) + 4;
+        if (coff + 20 > data.size() || data.compare(coff - 4, 4, std::string("PE\0\0", 4)) != 0) {
+            error = "it is not a PE file";
+            return false;
+        }
+    }
+    image.format = "PE";
+    size_t sectionCount = readLittleEndian(data, coff + 2, 2);
+    size_t symbolTable = readLittleEndian(data, coff + 8, 4);
+    size_t symbolCount = readLittleEndian(data, coff + 12, 4);
+    size_t sections = coff + 20 + readLittleEndian(data, coff + 16, 2);
+    size_t strings = symbolTable + symbolCount * 18;
+    if (symbolTable == 0 || symbolCount == 0) {
+        error = "it has no symbol table (stripped?)";
+        return false;
+    }
     
-    if (!toml) {
-        std::cerr << "Error: Could not create cclank.toml" << std::endl;
-        return;
+    // Names longer than 8 characters are "/<offset>" into the string table
+    auto shortName = [&](size_t offset) {
+        if (offset >= data.size()) return std::string();
+        std::string name = data.substr(offset, 8);
+        return name.substr(0, name.find('\0'));
+    };
+    std::vector<std::string> kinds;
+    std::vector<std::string> sectionNames;
+    std::vector<ULONGLONG> sectionSizes;
+    for (size_t i = 0; i < sectionCount; i++) {
+        size_t header = sections + i * 40;
+        std::string name = shortName(header);
+        if (name.length() > 1 && name[0] == '/') {
+            name = readCString(data, strings + atoi(name.c_str() + 1));
+        }
+        ULONGLONG size = coff == 0 ? readLittleEndian(data, header + 16, 4) : readLittleEndian(data, header + 8, 4);
+        sectionNames.push_back(name);
+        kinds.push_back(sectionKind(name));
+        sectionSizes.push_back(size);
+        bool discardable = readLittleEndian(data, header + 36, 4) & 0x02000000;  // IMAGE_SCN_MEM_DISCARDABLE (debug info)
+        if (!discardable && name.compare(0, 6, ".debug") != 0) {
+            image.sectionSizes[kinds.back()] += size;
+        }
     }
     
-    toml << "[package]\n";
-    toml << "name = \"" << projectName << "\"\n";
-    toml << "version = \"0.1.0\"\n";
-    toml << "platform = \"win\"\n";
-    toml << "type = \"bin\"\n";
-    toml << "icon = \"icon.ico\"\n";
-    toml << "\n";
-    toml << "[features]\n";
-    toml << "\n";
-    toml << "[profile.dev]\n";
-    toml << "opt-level = 0\n";
-    toml << "debug = true\n";
-    toml << "codegen-units = 4\n";
-    toml << "\n";
-    toml << "[profile.release]\n";
-    toml << "opt-level = 3\n";
-    toml << "debug = false\n";
-    toml << "lto = \"fat\"\n";
-    toml << "codegen-units = 1\n";
+    std::string file;
+    std::vector<BinarySymbol> symbols;
+    for (size_t i = 0; i < symbolCount; i++) {
+        size_t entry = symbolTable + i * 18;
+        std::string name = readLittleEndian(data, entry, 4) == 0 ? readCString(data, strings + readLittleEndian(data, entry + 4, 4)) : shortName(entry);
+        int section = static_cast<int16_t>(readLittleEndian(data, entry + 12, 2));
+        unsigned storageClass = static_cast<unsigned>(readLittleEndian(data, entry + 16, 1));
+        size_t auxCount = readLittleEndian(data, entry + 17, 1);
+        
+        if (storageClass == 103 && auxCount > 0) {  // IMAGE_SYM_CLASS_FILE: the name fills the aux records
+            std::string fileName = data.substr(entry + 18, std::min(auxCount * 18, data.size() - std::min(data.size(), entry + 18)));
+            file = fileName.substr(0, fileName.find('\0'));
+        }
+        else if (section > 0 && static_cast<size_t>(section) <= sectionCount && (storageClass == 2 || storageClass == 3) &&
+                 !name.empty() && name != sectionNames[section - 1] && name[0] != '.') {
+            BinarySymbol symbol;
+            symbol.name = name;
+            symbol.section = std::to_string(section - 1);  // resolved to the kind below
+            symbol.address = readLittleEndian(data, entry + 8, 4);
+            symbol.global = storageClass == 2;
+            if (!symbol.global) symbol.file = file;
+            symbols.push_back(symbol);
+        }
+        i += auxCount;
+    }
     
-    toml.close();
-    std::cout << "Created cclank.toml" << std::endl;
+    // A symbol ends where the next one of its section starts
+    std::sort(symbols.begin(), symbols.end(), [](const BinarySymbol& a, const BinarySymbol& b) {
+        int sectionA = atoi(a.section.c_str()), sectionB = atoi(b.section.c_str());
+        return sectionA != sectionB ? sectionA < sectionB : a.address < b.address;
+    });
+    for (size_t i = 0; i < symbols.size(); i++) {
+        size_t section = atoi(symbols[i].section.c_str());
+        ULONGLONG end = sectionSizes[section];
+        for (size_t next = i + 1; next < symbols.size() && symbols[next].section == symbols[i].section; next++) {
+            if (symbols[next].address > symbols[i].address) {
+                end = symbols[next].address;
+                break;
+            }
+        }
+        symbols[i].size = end > symbols[i].address ? end - symbols[i].address : 0;
+        symbols[i].section = kinds[section];
+    }
+    image.symbols = symbols;
+    return true;
+}
+
+bool readBinaryImage(const std::string& path, BinaryImage& image, std::string& error) {
+    std::string data = readFile(path);
+    if (data.size() >= 0x40 && data.compare(0, 4, "\x7f" "ELF") == 0) {
+        return readElfImage(data, image, error);
+    }
+    if (data.size() >= 0x40 && (data.compare(0, 2, "MZ") == 0 || readLittleEndian(data, 0, 2) == 0x8664)) {
+        return readCoffImage(data, image, error);
+    }
+    error = data.empty() ? "it could not be read" : "it is neither ELF nor PE/COFF";
+    return false;
+}
+
+// Demangled names through c++filt; names it can't demangle stay as they are
+std::map<std::string, std::string> demangleNames(const std::set<std::string>& names) {
+    std::map<std::string, std::string> demangled;
+    std::vector<std::string> batch;
+    auto flush = [&]() {
+        if (batch.empty()) return;
+        std::vector<std::string> args = {binutilsProgram("c++filt")};
+        args.insert(args.end(), batch.begin(), batch.end());
+        std::string output;
+        std::vector<std::string> lines;
+        if (runProcess(args, output) == 0) {
+            std::istringstream stream(output);
+            std::string line;
+            while (std::getline(stream, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                lines.push_back(line);
+            }
+        }
+        for (size_t i = 0; i < batch.size(); i++) {
+            demangled[batch[i]] = lines.size() == batch.size() ? lines[i] : batch[i];
+        }
+        batch.clear();
+    };
+    for (const auto& name : names) {
+        batch.push_back(name);
+        if (batch.size() == 2000) flush();
+    }
+    flush();
+    return demangled;
+}
+
+// A demangled template instantiation with its template arguments and
+// parameters removed, so all instantiations of a template group together:
+// "std::vector<int>::push_back(int const&)" -> "std::vector<>::push_back".
+// Empty for names that aren't part of a template.
+std::string templateGroup(const std::string& name) {
+    std::string group;
+    int depth = 0;
+    bool isTemplate = false;
+    for (size_t i = 0; i < name.length(); i++) {
+        char c = name[i];
+        if (depth == 0 && name.compare(i, 8, "operator") == 0) {
+            // Operators like operator<< and operator() are part of the name
+            size_t end = i + 8;
+            if (name.compare(end, 2, "()") == 0) end += 2;
+            while (end < name.length() && strchr("<>=!+-*/%^&|~[],", name[end])) end++;
+            group += name.substr(i, end - i);
+            i = end - 1;
+        }
+        else if (c == '<') {
+            if (depth++ == 0) group += "<>";
+            isTemplate = true;
+        }
+        else if (c == '>' && depth > 0) {
+            depth--;
+        }
+        else if (depth == 0 && c == '(' && name.compare(i, 21, "(anonymous namespace)") == 0) {
+            group += "(anonymous namespace)";
+            i += 20;
+        }
+        else if (depth == 0 && c == '(') {
+            break;
+        }
+        else if (depth == 0 && c == ' ' && group.compare(group.length() < 8 ? 0 : group.length() - 8, 8, "operator") != 0) {
+            // What came before is the return type of a function template
+            group.clear();
+        }
+        else if (depth == 0) {
+            group += c;
+        }
+    }
+    return isTemplate ? group : "";
+}
+
+struct BloatEntry {
+    ULONGLONG size;
+    std::string section;
+    std::string unit;  // translation unit, or [other] for the runtime and libraries
+    std::string name;  // demangled
+};
+
+// Every symbol of the binary with the translation unit that defines it. Global
+// symbols are looked up in the objects of the package and its dependencies
+// (the first object to define one is the one the linker used), local ones by
+// the source file the compiler recorded before them.
+std::vector<BloatEntry> attributeSizes(const BinaryImage& image, const std::vector<std::pair<std::string, std::string>>& objects) {
+    std::map<std::string, std::string> definedBy;
+    std::vector<std::string> units;
+    for (const auto& object : objects) {
+        BinaryImage objectImage;
+        std::string error;
+        units.push_back(object.second);
+        if (!readBinaryImage(object.first, objectImage, error)) continue;
+        for (const auto& symbol : objectImage.symbols) {
+            if (symbol.global) definedBy.insert({symbol.name, object.second});
+        }
+    }
+    
+    // Aliases such as complete and base object constructors share an address; count it once
+    std::set<std::pair<std::string, ULONGLONG>> seen;
+    std::set<std::string> names;
+    std::vector<BloatEntry> entries;
+    for (const auto& symbol : image.symbols) {
+        if (symbol.size == 0 || !seen.insert({symbol.section, symbol.address}).second) continue;
+        
+        std::string unit = "[other]";
+        auto definer = definedBy.find(symbol.name);
+        if (definer != definedBy.end()) {
+            unit = definer->second;
+        } else if (!symbol.file.empty()) {
+            std::string file = normalizePath(symbol.file);
+            for (const auto& candidate : units) {
+                if (candidate == file || (candidate.length() > file.length() && candidate.compare(candidate.length() - file.length() - 1, file.length() + 1, "/" + file) == 0)) {
+                    unit = candidate;
+                    break;
+                }
+            }
+        }
+        entries.push_back({symbol.size, symbol.section, unit, symbol.name});
+        names.insert(symbol.name);
+    }
+    
+    std::map<std::string, std::string> demangled = demangleNames(names);
+    for (auto& entry : entries) {
+        entry.name = demangled[entry.name];
+    }
+    std::sort(entries.begin(), entries.end(), [](const BloatEntry& a, const BloatEntry& b) {
+        return a.size != b.size ? a.size > b.size : a.name < b.name;
+    });
+    return entries;
+}
+
+// One "<size>\t<section>\t<unit>\t<name>" line per symbol, after a "# <revision> <time>" line
+std::string bloatReport(const std::vector<BloatEntry>& entries, const std::string& header) {
+    std::string report = "# " + header + "\n";
+    for (const auto& entry : entries) {
+        report += std::to_string(entry.size) + "\t" + entry.section + "\t" + entry.unit + "\t" + entry.name + "\n";
+    }
+    return report;
+}
+
+std::vector<BloatEntry> readBloatReport(const std::string& path, std::string& header) {
+    std::vector<BloatEntry> entries;
+    std::istringstream stream(readFile(path));
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (line.compare(0, 2, "# ") == 0) {
+            header = line.substr(2);
+            continue;
+        }
+        size_t first = line.find('\t');
+        size_t second = line.find('\t', first + 1);
+        size_t third = line.find('\t', second + 1);
+        if (third == std::string::npos) continue;
+        entries.push_back({std::stoull(line.substr(0, first)), line.substr(first + 1, second - first - 1),
+                           line.substr(second + 1, third - second - 1), line.substr(third + 1)});
+    }
+    return entries;
+}
+
+std::string formatSizeDelta(long long delta) {
+    return (delta < 0 ? "-" : "+") + formatSize(delta < 0 ? -delta : delta);
+}
+
+// Prints the largest of some totals, sorted by size (or by size change)
+void printLargest(const std::string& title, const std::map<std::string, long long>& sizes, size_t top, bool isDelta,
+                  const std::map<std::string, int>* counts = nullptr) {
+    std::vector<std::pair<long long, std::string>> sorted;
+    for (const auto& size : sizes) {
+        if (size.second != 0) sorted.push_back({size.second, size.first});
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<long long, std::string>& a, const std::pair<long long, std::string>& b) {
+        return std::llabs(a.first) != std::llabs(b.first) ? std::llabs(a.first) > std::llabs(b.first) : a.second < b.second;
+    });
+    if (sorted.empty()) return;
+    
+    std::cout << "\n" << title << ":" << std::endl;
+    for (size_t i = 0; i < std::min(top, sorted.size()); i++) {
+        std::string size = isDelta ? formatSizeDelta(sorted[i].first) : formatSize(sorted[i].first);
+        std::cout << "  " << std::string(size.length() < 11 ? 11 - size.length() : 0, ' ') << size << "  ";
+        if (counts) {
+            std::string count = std::to_string(counts->at(sorted[i].second)) + "x";
+            std::cout << std::string(count.length() < 6 ? 6 - count.length() : 0, ' ') << count << "  ";
+        }
+        const std::string& name = sorted[i].second;
+        std::cout << (name.length() > 160 ? name.substr(0, 157) + "..." : name) << std::endl;
+    }
+}
+
+struct BloatSettings {
+    size_t top = 15;
+    bool saveBaseline = false;
+};
+
+// Builds the selected binary, reports what its size is made of, and compares with the saved baseline
+bool bloatCommand(const BloatSettings& settings, const BuildOptions& options) {
+    std::vector<Package> packages;
+    if (!loadWorkspace(packages)) return false;
+    int index = findRunPackage(packages, options.package);
+    if (index < 0) return false;
+    if (packages[index].config.type == "lib") {
+        std::cerr << "Error: " << packages[index].name << " is a static library; cclank bloat looks at linked binaries" << std::endl;
+        return false;
+    }
+    
+    BuildOptions buildOptions = options;
+    buildOptions.package = packages[index].name;
+    
+    // LTO objects hold no machine code, so sizes couldn't be traced to them;
+    // such profiles are built again without LTO, next to the usual build
+    applyBuildProfile(packages, buildOptions);
+    TomlConfig::Profile profile = options.isRelease ? packages[index].config.release : packages[index].config.dev;
+    if (profile.lto != "off") {
+        buildOptions.noLto = true;
+        buildOptions.buildSuffix += "-nolto";
+        applyBuildProfile(packages, buildOptions);
+        std::cout << "Note: The profile uses LTO, analyzing a build without it in " << profileBuildPath(buildOptions) << std::endl;
+    }
+    if (!buildProject(buildOptions)) return false;
+    
+    // With target-cpus the output is the launcher; look at one level instead:
+    // CCLANK_TARGET_CPU if it names one, or the highest
+    if (!profile.targetCpus.empty()) {
+        std::vector<std::string> cpus = profile.targetCpus;
+        std::sort(cpus.begin(), cpus.end(), [](const std::string& a, const std::string& b) { return cpuLevel(a) > cpuLevel(b); });
+        std::string cpu = cpus[0];
+        const char* forced = getenv("CCLANK_TARGET_CPU");
+        if (forced && std::find(cpus.begin(), cpus.end(), forced) != cpus.end()) cpu = forced;
+        
+        std::vector<bool> selected(packages.size(), false);
+        selected[index] = true;
+        addCpuVariantPackages(packages, selected, options.isRelease);
+        for (size_t i = 0; i < packages.size(); i++) {
+            if (packages[i].name == packages[index].name && packages[i].target == cpu) {
+                index = static_cast<int>(i);
+                break;
+            }
+        }
+        std::cout << "Note: " << packages[index].name << " is built for several CPUs, analyzing the " << cpu << " build" << std::endl;
+    }
+    const Package& package = packages[index];
+    
+    std::string binaryPath = packageOutputPath(package, buildOptions);
+    BinaryImage image;
+    std::string error;
+    if (!readBinaryImage(binaryPath, image, error)) {
+        std::cerr << "Error: Can't analyze " << binaryPath << ": " << error << std::endl;
+        return false;
+    }
+    
+    // The objects of the package and of the static libraries linked into it
+    std::vector<std::pair<std::string, std::string>> objects;  // object path, translation unit
+    std::vector<size_t> linked = transitiveDependencies(packages, index);
+    linked.insert(linked.begin(), index);
+    for (size_t i : linked) {
+        std::string objDir = packageBuildPath(packages[i], buildOptions) + "/obj";
+        std::vector<std::string> pending = {""};
+        while (!pending.empty()) {
+            std::string dir = pending.back();
+            pending.pop_back();
+            for (const auto& name : listDirectory(objDir + "/" + dir)) {
+                std::string path = dir + name;
+                if (directoryExists(objDir + "/" + path)) pending.push_back(path + "/");
+                else if (path.length() > 2 && path.compare(path.length() - 2, 2, ".o") == 0) {
+                    objects.push_back({objDir + "/" + path, packages[i].root + path.substr(0, path.length() - 2)});
+                }
+            }
+        }
+    }
+    std::vector<BloatEntry> entries = attributeSizes(image, objects);
+    
+    // Totals by section, symbol, template and translation unit
+    std::map<std::string, long long> symbols, templates, units;
+    std::map<std::string, int> instantiations;
+    for (const auto& entry : entries) {
+        if (entry.section != "text" && entry.section != "rodata" && entry.section != "data") continue;
+        symbols[entry.name + "  (" + entry.section + ", " + entry.unit + ")"] += entry.size;
+        units[entry.unit] += entry.size;
+        std::string group = templateGroup(entry.name);
+        if (!group.empty()) {
+            templates[group] += entry.size;
+            instantiations[group]++;
+        }
+    }
+    ULONGLONG total = 0;
+    for (const auto& section : image.sectionSizes) {
+        if (section.first != "bss") total += section.second;
+    }
+    std::cout << "\n" << binaryPath << " (" << image.format << "): " << formatSize(total) << " loaded, not counting .bss" << std::endl;
+    for (const char* kind : {"text", "rodata", "data", "bss", "other"}) {
+        auto size = image.sectionSizes.find(kind);
+        if (size == image.sectionSizes.end() || size->second == 0) continue;
+        std::string text = formatSize(size->second);
+        std::cout << "  " << std::string(11 - std::min<size_t>(11, text.length()), ' ') << text << "  " << kind << std::endl;
+    }
+    printLargest("Largest symbols", symbols, settings.top, false);
+    printLargest("Largest templates (all instantiations)", templates, settings.top, false, &instantiations);
+    printLargest("Size by translation unit", units, settings.top, false);
+    
+    // Compare with the baseline, then keep this report as the latest one
+    std::string bloatDir = "build/bloat/" + package.name;
+    std::string baselinePath = bloatDir + "/baseline.txt";
+    std::string header = gitRevision() + " " + profileBuildPath(buildOptions).substr(6);
+    std::string report = bloatReport(entries, header);
+    createDirectories(bloatDir);
+    writeFile(bloatDir + "/latest.txt", report);
+    
+    if (settings.saveBaseline) {
+        writeFile(baselinePath, report);
+        std::cout << "\nSaved as the baseline in " << baselinePath << std::endl;
+        return true;
+    }
+    if (!fileExists(baselinePath)) {
+        std::cout << "\nNo baseline yet; save one with cclank bloat --save-baseline" << std::endl;
+        return true;
+    }
+    
+    std::string baselineHeader;
+    std::vector<BloatEntry> baseline = readBloatReport(baselinePath, baselineHeader);
+    std::map<std::string, long long> symbolDelta, unitDelta, sectionDelta;
+    for (const auto& entry : baseline) {
+        symbolDelta[entry.name] -= entry.size;
+        unitDelta[entry.unit] -= entry.size;
+        sectionDelta[entry.section] -= entry.size;
+    }
+    for (const auto& entry : entries) {
+        symbolDelta[entry.name] += entry.size;
+        unitDelta[entry.unit] += entry.size;
+        sectionDelta[entry.section] += entry.size;
+    }
+    long long change = 0;
+    for (const auto& section : sectionDelta) {
+        if (section.first != "bss") change += section.second;
+    }
+    std::cout << "\nCompared with the baseline (" << baselineHeader << "): " << formatSizeDelta(change) << " in symbols" << std::endl;
+    printLargest("Symbols that changed", symbolDelta, settings.top, true);
+    printLargest("Translation units that changed", unitDelta, settings.top, true);
+    return true;
+}
+
+// Header dependency analysis (cclank deps)
+//
+// Every source is preprocessed with -H, which prints the include tree with
+// one dot per nesting level. From those trees cclank reports, per header, how
+// many translation units recompile when it changes, how many files include it
+// directly or indirectly, and how many bytes it pulls into each includer.
+
+struct IncludeGraph {
+    std::map<std::string, std::vector<std::string>> includes;  // file -> headers it includes directly
+    std::map<std::string, std::vector<std::string>> unitHeaders;  // TU -> every header it reads
+};
+
+// Parses g++ -H output into edges of the graph, with srcFile as the root
+void parseIncludeTree(const std::string& output, const std::string& srcFile, IncludeGraph& graph) {
+    std::vector<std::string> stack = {srcFile};
+    std::vector<std::string>& headers = graph.unitHeaders[srcFile];
+    
+    std::istringstream lines(output);
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t depth = 0;
+        while (depth < line.length() && line[depth] == '.') depth++;
+        if (depth == 0 || depth >= line.length() || line[depth] != ' ') continue;
+        
+        std::string header = normalizePath(trim(line.substr(depth + 1)));
+        if (header.compare(0, 2, "./") == 0) header = header.substr(2);
+        
+        stack.resize(std::min(stack.size(), depth));
+        if (stack.empty()) continue;
+        
+        std::vector<std::string>& children = graph.includes[stack.back()];
+        if (std::find(children.begin(), children.end(), header) == children.end()) {
+            children.push_back(header);
+        }
+        headers.push_back(header);
+        stack.push_back(header);
+    }
+    
+    std::sort(headers.begin(), headers.end());
+    headers.erase(std::unique(headers.begin(), headers.end()), headers.end());
+}
+
+struct HeaderCost {
+    std::string header;
+    size_t units = 0;         // translation units that recompile when it changes
+    size_t fanIn = 0;         // files that include it, directly or through other headers
+    long long size = 0;       // bytes of the header and everything it includes
+    long long cost = 0;       // size * units: bytes the compiler reads because of it
+};
+
+// Every file reachable from start through edges, not counting start itself
+std::vector<std::string> reachableFrom(const std::map<std::string, std::vector<std::string>>& edges, const std::string& start) {
+    std::map<std::string, bool> seen;
+    std::vector<std::string> stack = {start};
+    std::vector<std::string> result;
+    while (!stack.empty()) {
+        std::string file = stack.back();
+        stack.pop_back();
+        auto it = edges.find(file);
+        if (it == edges.end()) continue;
+        for (const auto& next : it->second) {
+            if (seen[next] || next == start) continue;
+            seen[next] = true;
+            result.push_back(next);
+            stack.push_back(next);
+        }
+    }
+    return result;
 }
 
-void createMainCpp(const std::string& srcPath, const std::string& projectName) {
-    std::string mainPath = srcPath + "/main.cpp";
-    std::ofstream main(mainPath);
+std::vector<HeaderCost> analyzeIncludeGraph(const IncludeGraph& graph) {
+    std::map<std::string, std::vector<std::string>> includedBy;
+    for (const auto& entry : graph.includes) {
+        for (const auto& header : entry.second) {
+            includedBy[header].push_back(entry.first);
+        }
+    }
     
-    if (!main) {
-        std::cerr << "Error: Could not create main.cpp" << std::endl;
-        return;
+    std::map<std::string, size_t> units;
+    for (const auto& entry : graph.unitHeaders) {
+        for (const auto& header : entry.second) units[header]++;
     }
     
-    main << "#include <iostream>\n";
-    main << "\n";
-    main << "int main() {\n";
-    main << "    std::cout << \"Hello from " << projectName << "!\" << std::endl;\n";
-    main << "    return 0;\n";
-    main << "}\n";
+    std::map<std::string, long long> sizes;
+    auto sizeOf = [&](const std::string& file) {
+        auto it = sizes.find(file);
+        if (it != sizes.end()) return it->second;
+        return sizes[file] = getFileSize(file);
+    };
     
-    main.close();
-    std::cout << "Created src/main.cpp" << std::endl;
+    std::vector<HeaderCost> costs;
+    for (const auto& entry : units) {
+        HeaderCost cost;
+        cost.header = entry.first;
+        cost.units = entry.second;
+        cost.fanIn = reachableFrom(includedBy, entry.first).size();
+        cost.size = sizeOf(entry.first);
+        for (const auto& header : reachableFrom(graph.includes, entry.first)) {
+            cost.size += sizeOf(header);
+        }
+        cost.cost = cost.size * static_cast<long long>(cost.units);
+        costs.push_back(cost);
+    }
+    return costs;
 }
 
-void createNewProject(const std::string& projectName) {
-    // Check if directory already exists
-    if (directoryExists(projectName)) {
-        std::cerr << "Error: Directory '" << projectName << "' already exists" << std::endl;
+void depsCommand(const BuildOptions& options, bool heavy, bool json, int top) {
+    std::vector<Package> packages;
+    std::vector<bool> selected;
+    if (!loadWorkspace(packages) || !selectPackages(packages, options.package, selected)) {
         return;
     }
-    
-    // Create project directory
-    if (!createDirectory(projectName)) {
-        std::cerr << "Error: Could not create directory '" << projectName << "'" << std::endl;
+    applyBuildProfile(packages, options);
+    if (!createDirectory("build")) {
+        std::cerr << "Error: Could not create build directory" << std::endl;
         return;
     }
-    std::cout << "Created project directory: " << projectName << std::endl;
     
-    // Create src directory
-    std::string srcPath = projectName + "/src";
-    if (!createDirectory(srcPath)) {
-        std::cerr << "Error: Could not create src/ directory" << std::endl;
-        return;
-    }
-    std::cout << "Created src/ directory" << std::endl;
+    IncludeGraph graph;
+    std::mutex graphMutex;
+    std::vector<Job> jobs;
     
-    // Extract and save embedded icon
-    std::string iconPath = projectName + "/icon.ico";
-    if (extractEmbeddedIcon(iconPath)) {
-        std::cout << "Created icon.ico" << std::endl;
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (!selected[i]) continue;
+        const Package& package = packages[i];
+        std::string buildPath = packageBuildPath(package, options);
+        std::string indexPath = packageIndexPath(package);
+        std::string flags = compileFlags(package.config, options.isRelease) + packageIncludeFlags(packages, i);
+        
+        for (const auto& srcFile : findSourceFiles(package.config, indexPath)) {
+            // -H prints the include tree on stderr; the preprocessed output itself is discarded
+            std::string outputPath = objectPathFor(buildPath, srcFile, package.root) + ".deps.ii";
+            std::vector<std::string> command = {compilerFor(srcFile)};
+            appendFlags(command, flags);
+            command.insert(command.end(), {"-H", "-E", srcFile, "-o", outputPath});
+            
+            jobs.push_back({normalizePath(srcFile), [&graph, &graphMutex, srcFile, outputPath, command](std::string& output) {
+                createDirectories(outputPath.substr(0, outputPath.find_last_of('/')));
+                std::string tree;
+                int result = runProcess(command, tree);
+                DeleteFileA(outputPath.c_str());
+                if (result != 0) {
+                    output = tree;
+                    return result;
+                }
+                
+                std::lock_guard<std::mutex> lock(graphMutex);
+                parseIncludeTree(tree, normalizePath(srcFile), graph);
+                return 0;
+            }});
+            jobs.back().action = "Scanning";
+        }
     }
     
-    // Create cclank.toml
-    createDefaultToml(projectName, projectName);
-    
-    // Create main.cpp
-    createMainCpp(srcPath, projectName);
-    
-    std::cout << "\nProject '" << projectName << "' created successfully!" << std::endl;
-    std::cout << "Next steps:" << std::endl;
-    std::cout << "  cd " << projectName << std::endl;
-    std::cout << "  cclank build" << std::endl;
-}
-
-void buildProject(bool isRelease) {
-    // Check if cclank.toml exists
-    if (!fileExists("cclank.toml")) {
-        std::cerr << "Error: cclank.toml not found. Are you in a cclank project directory?" << std::endl;
+    if (jobs.empty()) {
+        std::cerr << "Error: No source files found" << std::endl;
         return;
     }
     
-    // Parse configuration
-    TomlConfig config = parseToml("cclank.toml");
-    std::string profileName = isRelease ? "release" : "debug";
-    std::string hostPlatform = getHostPlatform();
-    
-    std::cout << "Building " << config.name << " (" << profileName << " profile, " 
-              << config.type << " for " << config.platform << ")..." << std::endl;
-    
-    // Cross-compilation warning for binaries and dynamic libraries
-    if (config.platform != hostPlatform) {
-        if (config.type == "bin") {
-            std::cerr << "\nWarning: Cross-compilation is not available for binaries!" << std::endl;
-            std::cerr << "Project platform: " << config.platform << std::endl;
-            std::cerr << "Host platform: " << hostPlatform << std::endl;
-            std::cerr << "The resulting binary will only run on " << hostPlatform << ", not " << config.platform << std::endl;
-            std::cerr << "To build for " << config.platform << ", use a " << config.platform << " system.\n" << std::endl;
-        }
-        else if (config.type == "dylib" || config.type == "dll" || config.type == "so") {
-            std::cerr << "\nWarning: Cross-compilation is not available for dynamic libraries!" << std::endl;
-            std::cerr << "Project platform: " << config.platform << std::endl;
-            std::cerr << "Host platform: " << hostPlatform << std::endl;
-            std::cerr << "The resulting library will only work on " << hostPlatform << ", not " << config.platform << std::endl;
-            std::cerr << "To build for " << config.platform << ", use a " << config.platform << " system.\n" << std::endl;
-        }
-        else if (config.type == "lib") {
-            std::cout << "\nNote: Building static library with platform set to " << config.platform << std::endl;
-            std::cout << "Static libraries (.a, .lib) may be platform-specific depending on code." << std::endl;
-            std::cout << "For true cross-platform compatibility, build on the target platform.\n" << std::endl;
-        }
+    // Progress goes to stderr so --json output stays parseable
+    std::streambuf* stdoutBuffer = std::cout.rdbuf();
+    if (json) std::cout.rdbuf(std::cerr.rdbuf());
+    bool scanned = runJobs(jobs, options.jobs > 0 ? options.jobs : getDefaultJobCount());
+    std::cout.rdbuf(stdoutBuffer);
+    if (!scanned) {
+        std::cerr << "Error: Could not scan includes" << std::endl;
+        return;
     }
     
-    // Find all .cpp files in src/
-    std::vector<std::string> sourceFiles = findCppFiles("src");
-    if (sourceFiles.empty()) {
-        std::cerr << "Error: No .cpp files found in src/ directory" << std::endl;
-        return;
+    std::vector<HeaderCost> costs = analyzeIncludeGraph(graph);
+    std::sort(costs.begin(), costs.end(), [heavy](const HeaderCost& a, const HeaderCost& b) {
+        if (heavy && a.cost != b.cost) return a.cost > b.cost;
+        if (a.units != b.units) return a.units > b.units;
+        if (a.cost != b.cost) return a.cost > b.cost;
+        return a.header < b.header;
+    });
+    
+    std::string report = "{\"units\":" + std::to_string(graph.unitHeaders.size()) + ",\"headers\":[";
+    for (size_t i = 0; i < costs.size(); i++) {
+        const HeaderCost& cost = costs[i];
+        report += std::string(i > 0 ? "," : "") + "\n{\"header\":\"" + jsonEscape(cost.header) + "\",\"units\":" +
+                  std::to_string(cost.units) + ",\"fanIn\":" + std::to_string(cost.fanIn) + ",\"size\":" +
+                  std::to_string(cost.size) + ",\"cost\":" + std::to_string(cost.cost) + "}";
     }
+    report += "\n]}\n";
     
-    std::cout << "Found " << sourceFiles.size() << " source file(s)" << std::endl;
+    std::string reportPath = profileBuildPath(options) + "/deps.json";
+    createDirectories(reportPath.substr(0, reportPath.find_last_of('/')));
+    writeFile(reportPath, report);
     
-    // Create build directories
-    if (!createDirectory("build")) {
-        std::cerr << "Error: Could not create build directory" << std::endl;
+    if (json) {
+        std::cout << report;
         return;
     }
     
-    std::string buildPath = "build/" + profileName;
-    if (!createDirectory(buildPath)) {
-        std::cerr << "Error: Could not create " << buildPath << " directory" << std::endl;
-        return;
+    std::cout << "\n" << (heavy ? "Heaviest" : "Most included") << " headers across "
+              << graph.unitHeaders.size() << " translation unit(s):\n" << std::endl;
+    printf("%8s %8s %10s %10s  %s\n", "TUs", "Fan-in", "Size", "Cost", "Header");
+    for (size_t i = 0; i < costs.size() && static_cast<int>(i) < top; i++) {
+        const HeaderCost& cost = costs[i];
+        printf("%8zu %8zu %10s %10s  %s\n", cost.units, cost.fanIn, formatSize(cost.size).c_str(),
+               formatSize(cost.cost).c_str(), cost.header.c_str());
     }
+    fflush(stdout);
     
-    // Generate resource file if icon exists and type is bin
-    if (config.type == "bin" && config.platform == "win" && fileExists(config.icon)) {
-        std::cout << "Compiling icon resource..." << std::endl;
-        
-        // Create resource.rc
-        std::ofstream rc("resource.rc");
-        rc << "#include <windows.h>\n";
-        rc << "IDI_ICON1 ICON \"" << config.icon << "\"\n";
-        rc.close();
-        
-        // Compile resource
-        std::string rcCmd = "windres resource.rc -O coff -o resource.o";
-        int rcResult = system(rcCmd.c_str());
-        if (rcResult != 0) {
-            std::cerr << "Warning: Icon resource compilation failed" << std::endl;
-        }
+    std::cout << "\nTUs: files recompiled when the header changes. Fan-in: files including it, directly or not." << std::endl;
+    std::cout << "Size: the header plus everything it includes. Cost: size x TUs." << std::endl;
+    std::cout << "Full report written to " << reportPath << std::endl;
+}
+
+// Watch mode (cclank watch)
+//
+// Directories are watched with ReadDirectoryChangesW: the project recursively,
+// plus the directory of every header outside it that the last build read.
+// Changes are debounced, and one arriving during a build cancels that build.
+
+struct WatchState {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::string> pendingChanges;
+    ULONGLONG lastChange = 0;
+    bool building = false;
+    std::map<std::string, bool> watchedDirectories;
+};
+
+// Milliseconds since boot, for debouncing
+ULONGLONG tickCount() {
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return static_cast<ULONGLONG>(counter.QuadPart * 1000 / frequency.QuadPart);
+}
+
+// Changes cclank makes itself, or that can't affect the build, are ignored
+bool isIgnoredChange(const std::string& path) {
+    if (path.compare(0, 6, "build/") == 0 || path == "build") return true;
+    size_t start = 0;
+    while (start < path.length()) {
+        if (path[start] == '.' && path.compare(start, 3, "../") != 0) return true;
+        size_t slash = path.find('/', start);
+        if (slash == std::string::npos) break;
+        start = slash + 1;
+    }
+    return false;
+}
+
+void watchDirectory(WatchState& state, const std::string& dir, bool recursive) {
+    HANDLE handle = CreateFileA(dir.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        std::cerr << "Warning: Could not watch " << dir << std::endl;
+        return;
     }
     
-    // Build the project
-    if (config.type == "lib") {
-        // Static library: compile to object files, then use ar
-        std::cout << "Compiling object files..." << std::endl;
-        
-        std::vector<std::string> objectFiles;
-        bool compileFailed = false;
+    std::thread([&state, handle, dir, recursive]() {
+        std::string prefix = (dir == ".") ? "" : dir + "/";
+        DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+                       FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+        std::vector<DWORD> buffer(16384);  // DWORD-aligned, as ReadDirectoryChangesW requires
         
-        for (const auto& srcFile : sourceFiles) {
-            // Extract filename without path
-            size_t lastSlash = srcFile.find_last_of("\\/");
-            std::string filename = (lastSlash != std::string::npos) ? srcFile.substr(lastSlash + 1) : srcFile;
-            std::string objName = filename.substr(0, filename.find_last_of('.')) + ".o";
-            std::string objPath = buildPath + "/" + objName;
-            
-            std::string compileCmd = buildCommand(config, isRelease, {srcFile}) + objName;
-            std::cout << "  Compiling " << filename << "..." << std::endl;
-            
-            int result = system(compileCmd.c_str());
-            if (result != 0) {
-                std::cerr << "Error: Compilation failed for " << filename << std::endl;
-                compileFailed = true;
+        while (true) {
+            DWORD bytes = 0;
+            if (!ReadDirectoryChangesW(handle, buffer.data(), static_cast<DWORD>(buffer.size() * sizeof(DWORD)),
+                                       recursive, filter, &bytes, NULL, NULL)) {
                 break;
             }
             
-            objectFiles.push_back(objPath);
-        }
-        
-        if (!compileFailed && !objectFiles.empty()) {
-            // Create static library with ar
-            std::string outputFilename = getOutputFilename(config.name, config.type, config.platform);
-            std::string libPath = buildPath + "/" + outputFilename;
-            
-            std::string arCmd = "ar rcs " + libPath;
-            for (const auto& obj : objectFiles) {
-                arCmd += " " + obj;
+            std::vector<std::string> paths;
+            if (bytes == 0) {
+                paths.push_back(prefix + "*");  // the buffer overflowed: something changed
+            }
+            for (DWORD offset = 0; bytes > 0; ) {
+                const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(
+                    reinterpret_cast<const char*>(buffer.data()) + offset);
+                int length = static_cast<int>(info->FileNameLength / sizeof(WCHAR));
+                std::string name(WideCharToMultiByte(CP_UTF8, 0, info->FileName, length, NULL, 0, NULL, NULL), '\0');
+                WideCharToMultiByte(CP_UTF8, 0, info->FileName, length, &name[0], static_cast<int>(name.size()), NULL, NULL);
+                
+                std::string path = normalizePath(prefix + name);
+                if (!isIgnoredChange(path)) {
+                    paths.push_back(path);
+                }
+                if (info->NextEntryOffset == 0) break;
+                offset += info->NextEntryOffset;
             }
             
-            std::cout << "Creating static library..." << std::endl;
-            std::cout << "Running: " << arCmd << std::endl;
-            
-            int result = system(arCmd.c_str());
-            if (result == 0) {
-                std::cout << "Build successful!" << std::endl;
-                std::cout << "Output: " << libPath << std::endl;
-            } else {
-                std::cerr << "Build failed!" << std::endl;
+            if (paths.empty()) continue;
+            bool cancel;
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.pendingChanges.insert(state.pendingChanges.end(), paths.begin(), paths.end());
+                state.lastChange = tickCount();
+                cancel = state.building;
             }
+            if (cancel) {
+                cancelBuild();
+            }
+            state.changed.notify_all();
         }
-    } else {
-        // Binary or dynamic library: compile and link in one step
-        std::string cmd = buildCommand(config, isRelease, sourceFiles);
-        std::cout << "Running: " << cmd << std::endl;
-        
-        int result = system(cmd.c_str());
-        
-        if (result == 0) {
-            std::cout << "Build successful!" << std::endl;
-            std::string outputFilename = getOutputFilename(config.name, config.type, config.platform);
-            std::cout << "Output: build/" << profileName << "/" << outputFilename << std::endl;
-        } else {
-            std::cerr << "Build failed!" << std::endl;
+        CloseHandle(handle);
+    }).detach();
+}
+
+// Watches the directories of inputs the last build read from outside the workspace
+void watchExternalInputs(WatchState& state, const std::vector<Package>& packages, const BuildOptions& options) {
+    std::vector<ManifestEntry> inputs;
+    for (const auto& package : packages) {
+        BuildManifest manifest;
+        if (readManifest(manifestPathFor(packageBuildPath(package, options)), manifest)) {
+            inputs.insert(inputs.end(), manifest.inputs.begin(), manifest.inputs.end());
         }
     }
     
-    // Clean up temporary files
-    if (fileExists("resource.rc")) {
-        DeleteFileA("resource.rc");
+    for (const auto& input : inputs) {
+        std::string path = normalizePath(input.path);
+        bool external = path.compare(0, 3, "../") == 0 || path[0] == '/' || (path.length() > 1 && path[1] == ':');
+        if (!external || path.find('/') == std::string::npos) continue;
+        
+        std::string dir = path.substr(0, path.find_last_of('/'));
+        if (state.watchedDirectories[dir]) continue;
+        state.watchedDirectories[dir] = true;
+        watchDirectory(state, dir, false);
+    }
+}
+
+// Which units read which files, from their depfiles, so a change maps to the
+// units it affects without planning the workspace again
+struct WatchIndex {
+    std::map<std::pair<size_t, size_t>, std::vector<std::string>> inputs;  // (package, unit) -> files it read
+    std::map<std::string, std::set<std::pair<size_t, size_t>>> readers;    // file -> units that read it
+    std::set<std::string> pchInputs;  // files a precompiled header read
+};
+
+// Paths as depfiles and change notifications both can name a file
+std::string watchKey(const std::string& path) {
+    std::string key = joinPath("", path);
+    if (!key.empty()) key.pop_back();
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    return key;
+}
+
+void indexUnit(WatchIndex& index, const BuildSession& session, size_t package, size_t unit) {
+    std::pair<size_t, size_t> id(package, unit);
+    for (const auto& file : index.inputs[id]) {
+        index.readers[file].erase(id);
+    }
+    
+    const PackagePlan::Unit& planned = session.plans[package].units[unit];
+    std::vector<std::string> files = {watchKey(planned.source)};
+    for (const auto& dep : parseDepfile(depfilePathFor(planned.object))) {
+        files.push_back(watchKey(dep));
     }
-    if (fileExists("resource.o")) {
-        DeleteFileA("resource.o");
+    for (const auto& file : files) {
+        index.readers[file].insert(id);
     }
+    index.inputs[id] = files;
 }
 
-void runProject(bool isRelease) {
-    // Check if cclank.toml exists to get config
-    if (!fileExists("cclank.toml")) {
-        std::cerr << "Error: cclank.toml not found. Are you in a cclank project directory?" << std::endl;
-        return;
+void indexSession(WatchIndex& index, const BuildSession& session) {
+    index = WatchIndex();
+    for (size_t i = 0; i < session.packages.size(); i++) {
+        if (!session.selected[i]) continue;
+        const PackagePlan& plan = session.plans[i];
+        for (size_t unit = 0; unit < plan.units.size(); unit++) {
+            indexUnit(index, session, i, unit);
+        }
+        if (!plan.pchFile.empty()) {
+            for (const auto& dep : parseDepfile(depfilePathFor(plan.pchFile))) {
+                index.pchInputs.insert(watchKey(dep));
+            }
+        }
+    }
+}
+
+enum class WatchBuild { Built, Failed, Full };
+
+// Recompiles the units that read a changed file and relinks the packages they
+// end up in, along with the ones linking those. Returns Full when the change
+// needs a full build instead: a source was added or deleted, a precompiled
+// header's input changed, the notifications overflowed, or a package uses
+// modules, whose units depend on each other's order.
+WatchBuild rebuildChanged(BuildSession& session, WatchIndex& index, const BuildOptions& options,
+                          const std::vector<std::string>& changes) {
+    const std::vector<Package>& packages = session.packages;
+    const std::vector<PackagePlan>& plans = session.plans;
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (session.selected[i] && !plans[i].watchable) return WatchBuild::Full;
     }
     
-    TomlConfig config = parseToml("cclank.toml");
+    std::set<std::pair<size_t, size_t>> affected;
+    for (const auto& change : changes) {
+        if (change.back() == '*') return WatchBuild::Full;
+        std::string key = watchKey(change);
+        if (index.pchInputs.count(key)) return WatchBuild::Full;
+        
+        auto readers = index.readers.find(key);
+        if (readers != index.readers.end() && !readers->second.empty()) {
+            if (!fileExists(change)) return WatchBuild::Full;
+            affected.insert(readers->second.begin(), readers->second.end());
+        }
+        else if (isSourceFile(change)) {
+            return WatchBuild::Full;
+        }
+    }
+    if (affected.empty()) {
+        std::cout << "Nothing to rebuild" << std::endl;
+        return WatchBuild::Built;
+    }
     
-    // Only binaries can be run
-    if (config.type != "bin") {
-        std::cerr << "Error: Cannot run non-binary project (type = " << config.type << ")" << std::endl;
-        std::cerr << "Only projects with type = \"bin\" can be executed" << std::endl;
-        return;
+    std::vector<Job> jobs;
+    std::vector<std::vector<size_t>> compileJobs(packages.size());
+    bool useCache = false;
+    for (const auto& id : affected) {
+        Job job = plans[id.first].units[id.second].compile;
+        job.dependencies.clear();
+        compileJobs[id.first].push_back(jobs.size());
+        jobs.push_back(job);
+        if (packages[id.first].config.cache) useCache = true;
     }
     
-    // Check if platform matches host
-    std::string hostPlatform = getHostPlatform();
-    if (config.platform != hostPlatform) {
-        std::cerr << "Error: Cannot use 'run' when the platform doesn't match the host platform" << std::endl;
-        std::cerr << "Project platform: " << config.platform << std::endl;
-        std::cerr << "Host platform: " << hostPlatform << std::endl;
-        std::cerr << "Change platform to \"" << hostPlatform << "\" in cclank.toml to run on this system" << std::endl;
-        return;
+    // Packages are in dependency order, so a library's link job exists before its dependents look for it
+    std::vector<size_t> linkJobs(packages.size(), SIZE_MAX);
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (!session.selected[i] || !plans[i].link.run || plans[i].units.empty()) continue;
+        
+        Job link = plans[i].link;
+        link.dependencies = compileJobs[i];
+        if (packages[i].config.type != "lib") {
+            for (size_t dep : transitiveDependencies(packages, i)) {
+                const TomlConfig& depConfig = packages[dep].config;
+                if (linkJobs[dep] != SIZE_MAX && (depConfig.type == "lib" || isDynamicLibrary(depConfig))) {
+                    link.dependencies.push_back(linkJobs[dep]);
+                }
+            }
+        }
+        if (link.dependencies.empty()) continue;
+        linkJobs[i] = jobs.size();
+        jobs.push_back(link);
     }
     
-    std::string profileName = isRelease ? "release" : "debug";
-    std::string outputFilename = getOutputFilename(config.name, config.type, config.platform);
-    std::string exePath = "build\\" + profileName + "\\" + outputFilename;
+    int jobCount = options.jobs > 0 ? options.jobs : getDefaultJobCount() + session.executor->slotCount();
+    std::cout << "Compiling " << affected.size() << " file(s) with " << jobCount << " job(s)..." << std::endl;
+    if (useCache) openObjectCache(session.cache);
+    bool built = runJobs(jobs, jobCount);
+    if (useCache) closeObjectCache(session.cache);
+    if (!built) {
+        printBuildFailed();
+        return WatchBuild::Failed;
+    }
+    
+    for (const auto& id : affected) {
+        indexUnit(index, session, id.first, id.second);
+    }
+    std::cout << "Build successful!" << std::endl;
+    return WatchBuild::Built;
+}
+
+void stopProgram(PROCESS_INFORMATION& program) {
+    if (!program.hProcess) return;
+    if (WaitForSingleObject(program.hProcess, 0) == WAIT_TIMEOUT) {
+        TerminateProcess(program.hProcess, 1);
+        WaitForSingleObject(program.hProcess, INFINITE);
+    }
+    CloseHandle(program.hProcess);
+    CloseHandle(program.hThread);
+    program = {};
+}
+
+void watchProject(const BuildOptions& options) {
+    std::vector<Package> packages;
+    if (!loadWorkspace(packages)) return;
     
-    // Check if the executable exists, if not build it first
-    if (!fileExists(exePath)) {
-        std::cout << "Executable not found, building first..." << std::endl;
-        buildProject(isRelease);
+    // With --run, build and restart one binary; otherwise build everything selected
+    BuildOptions buildOptions = options;
+    std::string exePath;
+    if (options.run) {
+        int index = findRunPackage(packages, options.package);
+        if (index < 0) return;
         
-        // Check again after build
-        if (!fileExists(exePath)) {
-            std::cerr << "Error: Build failed, executable not found" << std::endl;
+        const TomlConfig& config = packages[index].config;
+        if (config.type != "bin") {
+            std::cerr << "Error: Cannot run non-binary project (type = " << config.type << ")" << std::endl;
             return;
         }
+        buildOptions.package = packages[index].name;
+        exePath = packageOutputPath(packages[index], options);
+        std::replace(exePath.begin(), exePath.end(), '/', '\\');
     }
     
-    // Run the executable in the same terminal using quotes
-    std::cout << "Running " << exePath << "...\n" << std::endl;
-    std::string runCmd = "\"" + exePath + "\"";
-    system(runCmd.c_str());
+    buildJobObject = CreateJobObjectA(NULL, NULL);
+    WatchState state;
+    watchDirectory(state, ".", true);
+    
+    // The workspace stays loaded and planned between builds. A change only
+    // recompiles the units that read the changed files, unless it needs a
+    // full build; a changed cclank.toml loads the workspace again.
+    BuildSession session;
+    WatchIndex index;
+    buildOptions.planAll = true;
+    bool lastBuilt = false;
+    std::vector<std::string> changes;
+    
+    PROCESS_INFORMATION program = {};
+    while (true) {
+        // A running program keeps its exe locked, so stop it before relinking
+        if (options.run) {
+            stopProgram(program);
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            buildCancelled = false;
+            state.building = true;
+        }
+        if (options.timings) startTimings(options.timeTrace);
+        WatchBuild result = WatchBuild::Full;
+        if (lastBuilt && !options.pgo) {
+            result = rebuildChanged(session, index, buildOptions, changes);
+        }
+        bool built = result == WatchBuild::Built;
+        if (result == WatchBuild::Full) {
+            if (options.pgo) {
+                session.packages.clear();
+                built = buildWithPgo(buildOptions) && loadWorkspace(session.packages);
+            } else {
+                built = runBuild(buildOptions, &session);
+                if (built) indexSession(index, session);
+            }
+            if (built) {
+                watchExternalInputs(state, session.packages, options);
+            }
+        }
+        if (options.timings) writeTimings(profileBuildPath(buildOptions));
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.building = false;
+        }
+        lastBuilt = built;
+        
+        if (built) {
+            if (options.run) {
+                std::cout << "Running " << exePath << "...\n" << std::endl;
+                
+                STARTUPINFOA si = {};
+                si.cb = sizeof(si);
+                std::string runCmd = quoteArgument(exePath);
+                std::vector<char> cmdLine(runCmd.begin(), runCmd.end());
+                cmdLine.push_back('\0');
+                if (!CreateProcessA(NULL, cmdLine.data(), NULL, NULL, FALSE, 0, NULL, NULL, &si, &program)) {
+                    std::cerr << "Error: Could not start " << exePath << std::endl;
+                    program = {};
+                }
+            }
+        }
+        
+        std::cout << "\nWatching for changes (Ctrl+C to stop)..." << std::endl;
+        
+        // Wait for a change, then until no further change arrives for a moment
+        const ULONGLONG debounceMs = 100;
+        changes.clear();
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.changed.wait(lock, [&]() { return !state.pendingChanges.empty(); });
+            while (tickCount() - state.lastChange < debounceMs) {
+                state.changed.wait_for(lock, std::chrono::milliseconds(debounceMs));
+            }
+            changes.swap(state.pendingChanges);
+        }
+        
+        // Report files rather than the directories whose write time they bumped
+        std::vector<std::string> files;
+        for (const auto& path : changes) {
+            if (!directoryExists(path)) files.push_back(path);
+        }
+        if (!files.empty()) changes.swap(files);
+        std::sort(changes.begin(), changes.end());
+        changes.erase(std::unique(changes.begin(), changes.end()), changes.end());
+        std::cout << "\nChanged: " << changes[0];
+        if (changes.size() > 1) std::cout << " (and " << changes.size() - 1 << " more)";
+        std::cout << std::endl;
+        
+        // Members, dependencies or settings may have changed
+        for (const auto& path : changes) {
+            if (getFileName(path) == "cclank.toml") {
+                session.packages.clear();
+                session.executor.reset();
+                lastBuilt = false;
+            }
+        }
+    }
 }
 
 void cleanProject() {
@@ -577,11 +8285,7 @@ void cleanProject() {
     
     std::cout << "Cleaning build directory..." << std::endl;
     
-    // Remove build directory recursively
-    std::string cmd = "rmdir /s /q build";
-    int result = system(cmd.c_str());
-    
-    if (result == 0) {
+    if (removeDirectoryTree("build")) {
         std::cout << "Clean successful!" << std::endl;
     } else {
         std::cerr << "Clean failed!" << std::endl;
@@ -594,9 +8298,109 @@ void printUsage() {
     std::cout << "  cclank new <n>        Create new project with default structure" << std::endl;
     std::cout << "  cclank build             Build using dev profile" << std::endl;
     std::cout << "  cclank build --release   Build using release profile" << std::endl;
+    std::cout << "  cclank build -j <N>      Build with N parallel jobs (default: CPU count)" << std::endl;
+    std::cout << "  cclank build --timings   Write a trace and summary of where build time went" << std::endl;
+    std::cout << "  cclank build --time-trace  Like --timings, plus the compiler's per-file timings" << std::endl;
+    std::cout << "  cclank build -p <name>   Build one workspace package and its dependencies" << std::endl;
+    std::cout << "  cclank build --release --pgo  Train with the profile's pgo commands, then rebuild with the profile" << std::endl;
     std::cout << "  cclank run               Build and run (dev profile)" << std::endl;
     std::cout << "  cclank run --release     Build and run (release profile)" << std::endl;
+    std::cout << "  cclank build --build-profile=<name>  Build a custom [profile.<name>] into build/<name>" << std::endl;
+    std::cout << "  cclank run --profile=perf  Build the profiling profile, sample the program and write a flame graph" << std::endl;
+    std::cout << "  cclank watch             Rebuild whenever a source file changes" << std::endl;
+    std::cout << "  cclank watch --run       Rebuild and restart the program on every change" << std::endl;
     std::cout << "  cclank clean             Remove build directory" << std::endl;
+    std::cout << "  cclank test [filters]    Build and run the tests in parallel (--shard i/n, --timeout S)" << std::endl;
+    std::cout << "  cclank bench [names]     Run the [[bench]] targets and compare with the saved baseline" << std::endl;
+    std::cout << "  cclank deps [--heavy]    Show the headers that cause the most recompilation" << std::endl;
+    std::cout << "  cclank bloat [--top N]   Show what the release binary's size is made of (--save-baseline to compare later)" << std::endl;
+    std::cout << "  cclank worker            Compile for remote builds (--listen ADDR to accept other machines, --port N)" << std::endl;
+    std::cout << "  cclank cache stats       Show object cache hit rate and size" << std::endl;
+    std::cout << "  cclank cache clear       Remove all cached objects" << std::endl;
+}
+
+// Parses the flags shared by build, run and watch, starting at argv[first]
+bool parseBuildOptions(int argc, char* argv[], int first, BuildOptions& options) {
+    for (int i = first; i < argc; i++) {
+        std::string arg = argv[i];
+        std::string jobsValue;
+        
+        if (arg == "--release") {
+            options.isRelease = true;
+            continue;
+        }
+        else if (arg == "--timings") {
+            options.timings = true;
+            continue;
+        }
+        else if (arg == "--pgo") {
+            options.pgo = true;
+            continue;
+        }
+        else if (arg == "-p" || arg == "--package") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " requires a package name" << std::endl;
+                return false;
+            }
+            options.package = argv[++i];
+            continue;
+        }
+        else if (arg.rfind("--package=", 0) == 0) {
+            options.package = arg.substr(10);
+            continue;
+        }
+        else if (arg == "--run") {
+            options.run = true;
+            continue;
+        }
+        else if (arg == "--build-profile" || arg.rfind("--build-profile=", 0) == 0) {
+            if (arg == "--build-profile" && i + 1 >= argc) {
+                std::cerr << "Error: --build-profile requires a profile name" << std::endl;
+                return false;
+            }
+            options.profile = arg == "--build-profile" ? argv[++i] : arg.substr(16);
+            continue;
+        }
+        else if (arg == "--profile" || arg.rfind("--profile=", 0) == 0) {
+            std::string profiler = arg == "--profile" ? (i + 1 < argc ? argv[++i] : "") : arg.substr(10);
+            if (profiler != "perf") {
+                std::cerr << "Error: --profile takes \"perf\" (use --build-profile to choose a [profile.<name>])" << std::endl;
+                return false;
+            }
+            options.profiler = profiler;
+            continue;
+        }
+        else if (arg == "--time-trace") {
+            options.timings = true;
+            options.timeTrace = true;
+            continue;
+        }
+        else if (arg == "-j" || arg == "--jobs") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " requires a number of jobs" << std::endl;
+                return false;
+            }
+            jobsValue = argv[++i];
+        }
+        else if (arg.rfind("--jobs=", 0) == 0) {
+            jobsValue = arg.substr(7);
+        }
+        else if (arg.rfind("-j", 0) == 0) {
+            jobsValue = arg.substr(2);
+        }
+        else {
+            std::cerr << "Warning: Ignoring unknown option '" << arg << "'" << std::endl;
+            continue;
+        }
+        
+        int jobs = atoi(jobsValue.c_str());
+        if (jobs <= 0) {
+            std::cerr << "Error: Invalid number of jobs '" << jobsValue << "'" << std::endl;
+            return false;
+        }
+        options.jobs = jobs;
+    }
+    return true;
 }
 
 int main(int argc, char* argv[]) {
@@ -617,16 +8421,136 @@ int main(int argc, char* argv[]) {
         createNewProject(projectName);
     }
     else if (command == "build") {
-        bool isRelease = (argc > 2 && std::string(argv[2]) == "--release");
-        buildProject(isRelease);
+        BuildOptions options;
+        if (!parseBuildOptions(argc, argv, 2, options) || !enterWorkspaceRoot(options) || !selectBuildProfile(options)) return 1;
+        buildProject(options);
     }
     else if (command == "run") {
-        bool isRelease = (argc > 2 && std::string(argv[2]) == "--release");
-        runProject(isRelease);
+        BuildOptions options;
+        if (!parseBuildOptions(argc, argv, 2, options) || !enterWorkspaceRoot(options) || !selectBuildProfile(options)) return 1;
+        runProject(options);
+    }
+    else if (command == "watch") {
+        BuildOptions options;
+        if (!parseBuildOptions(argc, argv, 2, options) || !enterWorkspaceRoot(options) || !selectBuildProfile(options)) return 1;
+        watchProject(options);
     }
     else if (command == "clean") {
         cleanProject();
     }
+    else if (command == "deps") {
+        // deps takes the build options plus its own report options
+        BuildOptions options;
+        bool heavy = false;
+        bool json = false;
+        int top = 20;
+        std::vector<char*> buildArgs;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--heavy") heavy = true;
+            else if (arg == "--json") json = true;
+            else if (arg == "--top" && i + 1 < argc) top = std::max(1, atoi(argv[++i]));
+            else buildArgs.push_back(argv[i]);
+        }
+        if (!parseBuildOptions(static_cast<int>(buildArgs.size()), buildArgs.data(), 0, options) ||
+            !enterWorkspaceRoot(options) || !selectBuildProfile(options)) return 1;
+        depsCommand(options, heavy, json, top);
+    }
+    else if (command == "bench") {
+        // bench takes bench names and its own options plus the build options
+        BuildOptions options;
+        BenchSettings settings;
+        std::vector<char*> buildArgs;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--runs" && i + 1 < argc) settings.runs = std::max(1, atoi(argv[++i]));
+            else if (arg == "--warmup" && i + 1 < argc) settings.warmup = std::max(0, atoi(argv[++i]));
+            else if (arg == "--cpu" && i + 1 < argc) {
+                std::string cpu = argv[++i];
+                settings.cpu = cpu == "none" ? -1 : std::max(0, atoi(cpu.c_str()));
+            }
+            else if (arg == "--save-baseline") settings.saveBaseline = true;
+            else if ((arg == "-p" || arg == "--package" || arg == "-j" || arg == "--build-profile") && i + 1 < argc) {
+                buildArgs.push_back(argv[i]);
+                buildArgs.push_back(argv[++i]);
+            }
+            else if (!arg.empty() && arg[0] != '-') settings.names.push_back(arg);
+            else buildArgs.push_back(argv[i]);
+        }
+        if (!parseBuildOptions(static_cast<int>(buildArgs.size()), buildArgs.data(), 0, options) ||
+            !enterWorkspaceRoot(options) || !selectBuildProfile(options)) return 1;
+        return benchCommand(settings, options) ? 0 : 1;
+    }
+    else if (command == "test") {
+        // test takes name filters and its own options plus the build options
+        BuildOptions options;
+        TestSettings settings;
+        std::vector<char*> buildArgs;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--timeout" && i + 1 < argc) settings.timeout = std::max(1, atoi(argv[++i]));
+            else if (arg == "--shard" && i + 1 < argc) {
+                std::string shard = argv[++i];
+                size_t slash = shard.find('/');
+                settings.shardIndex = atoi(shard.substr(0, slash).c_str());
+                settings.shardCount = slash == std::string::npos ? 0 : atoi(shard.substr(slash + 1).c_str());
+                if (settings.shardCount < 1 || settings.shardIndex < 1 || settings.shardIndex > settings.shardCount) {
+                    std::cerr << "Error: --shard takes i/n with 1 <= i <= n, e.g. --shard 2/4" << std::endl;
+                    return 1;
+                }
+            }
+            else if ((arg == "-p" || arg == "--package" || arg == "-j" || arg == "--build-profile") && i + 1 < argc) {
+                buildArgs.push_back(argv[i]);
+                buildArgs.push_back(argv[++i]);
+            }
+            else if (!arg.empty() && arg[0] != '-') settings.filters.push_back(arg);
+            else buildArgs.push_back(argv[i]);
+        }
+        if (!parseBuildOptions(static_cast<int>(buildArgs.size()), buildArgs.data(), 0, options) ||
+            !enterWorkspaceRoot(options) || !selectBuildProfile(options)) return 1;
+        return testCommand(settings, options) ? 0 : 1;
+    }
+    else if (command == "bloat") {
+        // bloat analyzes the release build unless another profile is chosen
+        BuildOptions options;
+        options.isRelease = true;
+        BloatSettings settings;
+        std::vector<char*> buildArgs;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--top" && i + 1 < argc) settings.top = std::max(1, atoi(argv[++i]));
+            else if (arg == "--save-baseline") settings.saveBaseline = true;
+            else buildArgs.push_back(argv[i]);
+        }
+        if (!parseBuildOptions(static_cast<int>(buildArgs.size()), buildArgs.data(), 0, options) ||
+            !enterWorkspaceRoot(options) || !selectBuildProfile(options)) return 1;
+        return bloatCommand(settings, options) ? 0 : 1;
+    }
+    else if (command == "worker") {
+        int port = defaultWorkerPort;
+        int jobs = 0;
+        std::string listenAddress;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--port" && i + 1 < argc) port = atoi(argv[++i]);
+            else if (arg == "--listen" && i + 1 < argc) listenAddress = argv[++i];
+            else if (arg == "-j" && i + 1 < argc) jobs = atoi(argv[++i]);
+            else {
+                std::cerr << "Error: Unknown worker option '" << arg << "'" << std::endl;
+                std::cout << "Usage: cclank worker [--listen <address>] [--port <N>] [-j <N>]" << std::endl;
+                return 1;
+            }
+        }
+        workerCommand(listenAddress, port, jobs);
+    }
+    else if (command == "cache") {
+        if (argc < 3) {
+            std::cerr << "Error: Cache command required" << std::endl;
+            std::cout << "Usage: cclank cache <stats|clear>" << std::endl;
+            return 1;
+        }
+        cacheCommand(argv[2]);
+    }
     else {
         std::cerr << "Error: Unknown command '" << command << "'" << std::endl;
         printUsage();